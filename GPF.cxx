@@ -9,630 +9,8877 @@
 
 #include <algorithm>
 #include <set>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iomanip>
+#include <functional>
+#include <filesystem>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #undef LoadImage
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
 
-namespace std
+namespace GPF
 {
-    template<>
-    struct hash<GPF::Vertex1P1N1UV1T1BT>
+    /* Profiling */
+
+    ProfilerManager g_Profiler;
+
+    struct ProfileThreadSlot
     {
-        size_t operator()(const GPF::Vertex1P1N1UV1T1BT &inVertex) const
+        ProfileThread *Thread = nullptr;
+
+        ~ProfileThreadSlot()
         {
-            return ((hash<glm::vec3>()(inVertex.Position) ^
-                    (hash<glm::vec3>()(inVertex.Normal) << 1)) >> 1) ^
-                    (hash<glm::vec2>()(inVertex.TexCoord ) << 1);
+            if (Thread)
+            {
+                Thread->Active.store(false, std::memory_order_release);
+            }
         }
     };
-}
 
-namespace GPF
-{
-    /* Profiling */
+    static thread_local ProfileThreadSlot t_ProfileThread;
+
+    static constexpr U64 kProfilePathSeed = 14695981039346656037ULL;
+
+    static inline U64 HashProfilePath(U64 inParentPath, const char *inTag)
+    {
+        // FNV-1a over the tag characters, so equal tags from different
+        // translation units end up in the same scope
+        U64 hash = inParentPath ? inParentPath : kProfilePathSeed;
+
+        for (const char *c = inTag; *c; ++c)
+        {
+            hash ^= static_cast<U8>(*c);
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    static inline U64 ProfileStatsKey(U64 inPath, U64 inThread, U32 inType)
+    {
+        // threads are aggregated by name, so short lived workers with the same name share their scopes
+        return inPath ^ (inThread * 0x9E3779B97F4A7C15ULL) ^ (static_cast<U64>(inType) << 63);
+    }
+
+    static inline U64 CurrentProfilePath(const ProfileThread &inThread)
+    {
+        const U32 depth = std::min<U32>(inThread.Depth, GPF_PROFILER_MAX_DEPTH);
+        return depth > 0 ? inThread.Stack[depth - 1] : 0;
+    }
+
+    struct TraceEvent
+    {
+        enum EventType : U32
+        {
+            Scope, Frame, ThreadName
+        } Type;
+
+        ProfileSample Sample;
+        U64 FrameIndex;
+        std::string Name;
+    };
+
+    struct TraceWriter
+    {
+        std::ofstream File;
+        std::thread Worker;
+        std::mutex Mutex;
+        std::condition_variable Wakeup;
+        std::vector< TraceEvent > Pending;
+        size_t MaxPendingEvents = 0;
+        U64 Dropped = 0;
+        bool IsRunning = true;
+        bool IsFirstEvent = true;
+
+        // collector side, guarded by ProfilerManager::StatsMutex
+        std::unordered_map< U32, std::string > ThreadNames;
+
+        void Push(std::vector< TraceEvent > &outEvents)
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+
+            for (auto &event : outEvents)
+            {
+                if (Pending.size() < MaxPendingEvents)
+                {
+                    Pending.push_back( std::move(event) );
+                }
+                else
+                {
+                    Dropped++;
+                }
+            }
+
+            outEvents.clear();
+
+            if (Pending.size() >= MaxPendingEvents / 2)
+            {
+                Wakeup.notify_one();
+            }
+        }
+
+        void Run()
+        {
+            std::vector< TraceEvent > batch;
+            std::string buffer;
+            bool isDone = false;
+
+            while (!isDone)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(Mutex);
+                    Wakeup.wait_for(lock, std::chrono::milliseconds(100), [this]()
+                    {
+                        return !IsRunning || Pending.size() >= MaxPendingEvents / 2;
+                    });
+
+                    batch.swap(Pending);
+                    isDone = !IsRunning;
+                }
+
+                for (const auto &event : batch)
+                {
+                    Format(event, buffer);
+                }
+
+                File.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+                batch.clear();
+            }
+        }
+
+        static void AppendEscaped(const char *inText, std::string &outBuffer)
+        {
+            for (const char *c = inText; *c; ++c)
+            {
+                if (*c == '"' || *c == '\\')
+                {
+                    outBuffer += '\\';
+                    outBuffer += *c;
+                }
+                else if (static_cast<U8>(*c) >= 0x20)
+                {
+                    outBuffer += *c;
+                }
+            }
+        }
+
+        void Format(const TraceEvent &inEvent, std::string &outBuffer)
+        {
+            char numbers[128];
+
+            outBuffer += IsFirstEvent ? "\n" : ",\n";
+            IsFirstEvent = false;
+
+            switch (inEvent.Type)
+            {
+            case TraceEvent::ThreadName:
+                snprintf(numbers, sizeof(numbers), "\"pid\":1,\"tid\":%u", inEvent.Sample.Thread);
+                outBuffer += "{\"name\":\"thread_name\",\"ph\":\"M\",";
+                outBuffer += numbers;
+                outBuffer += ",\"args\":{\"name\":\"";
+                AppendEscaped(inEvent.Name.c_str(), outBuffer);
+                outBuffer += "\"}}";
+                break;
+
+            case TraceEvent::Frame:
+                snprintf(numbers, sizeof(numbers), "{\"name\":\"Frame %llu\",\"cat\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                    static_cast<unsigned long long>(inEvent.FrameIndex), inEvent.Sample.StartTime * 1000.0, inEvent.Sample.Duration * 1000.0);
+                outBuffer += numbers;
+                break;
+
+            case TraceEvent::Scope:
+                outBuffer += "{\"name\":\"";
+                AppendEscaped(inEvent.Sample.Tag, outBuffer);
+                snprintf(numbers, sizeof(numbers), "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    inEvent.Sample.Type == Profile::GPU ? "GPU" : "CPU", TraceThreadID(inEvent.Sample),
+                    inEvent.Sample.StartTime * 1000.0, inEvent.Sample.Duration * 1000.0);
+                outBuffer += numbers;
+                break;
+            }
+        }
+
+        static U32 TraceThreadID(const ProfileSample &inSample)
+        {
+            // tid 0 is the frame track, GPU scopes get a track next to their CPU thread
+            return inSample.Type == Profile::GPU ? 1000 + inSample.Thread : 1 + inSample.Thread;
+        }
+    };
+
+    ProfilerManager::ProfilerManager() = default;
+
+    ProfilerManager::~ProfilerManager()
+    {
+        EndTraceCapture();
+    }
+
+    F64 ProfilerManager::Now()
+    {
+        static const auto start = std::chrono::steady_clock::now();
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<F64, std::milli>(elapsed).count();
+    }
+
+    ProfileThread& ProfilerManager::GetThread()
+    {
+        if (!t_ProfileThread.Thread)
+        {
+            std::lock_guard<std::mutex> lock(ThreadsMutex);
+
+            for (const auto &thread : Threads)
+            {
+                // samples the old thread left in the ring would be collected under the new name, wait for Collect to drain them
+                const bool isDrained = thread->Tail.load(std::memory_order_acquire) == thread->Head.load(std::memory_order_acquire);
+
+                if (!thread->Active.load(std::memory_order_acquire) && isDrained)
+                {
+                    thread->Active.store(true, std::memory_order_relaxed);
+                    thread->Depth = 0;
+                    thread->Name = "Thread " + std::to_string(thread->Index);
+
+                    t_ProfileThread.Thread = thread.get();
+                    return *t_ProfileThread.Thread;
+                }
+            }
+
+            std::unique_ptr<ProfileThread> thread(new ProfileThread());
+            thread->Index = static_cast<U32>(Threads.size());
+            thread->Name = "Thread " + std::to_string(thread->Index);
+
+            t_ProfileThread.Thread = thread.get();
+            Threads.push_back( std::move(thread) );
+        }
+
+        return *t_ProfileThread.Thread;
+    }
+
+    void ProfilerManager::SetThreadName(const char *inName)
+    {
+        ProfileThread &thread = GetThread();
+
+        std::lock_guard<std::mutex> lock(ThreadsMutex);
+        thread.Name = inName;
+    }
+
+    void ProfilerManager::BeginScope(const char *inTag, ProfileSample &outSample)
+    {
+        ProfileThread &thread = GetThread();
+
+        outSample.Tag = inTag;
+        outSample.ParentPath = CurrentProfilePath(thread);
+        outSample.Path = HashProfilePath(outSample.ParentPath, inTag);
+        outSample.Depth = thread.Depth;
+        outSample.Thread = thread.Index;
+
+        if (thread.Depth < GPF_PROFILER_MAX_DEPTH)
+        {
+            thread.Stack[thread.Depth] = outSample.Path;
+        }
+
+        thread.Depth++;
+
+        outSample.StartTime = Now();
+    }
+
+    void ProfilerManager::EndScope(ProfileSample &outSample)
+    {
+        outSample.Duration = Now() - outSample.StartTime;
+
+        ProfileThread &thread = GetThread();
+
+        if (thread.Depth > 0)
+        {
+            thread.Depth--;
+        }
+
+        Submit(thread, outSample);
+    }
 
     void ProfilerManager::Store( const char *inTag, F64 inTime )
     {
-        ProfilingMap.emplace( inTag, inTime );
+        ProfileThread &thread = GetThread();
+
+        ProfileSample sample;
+        sample.Tag = inTag;
+        sample.ParentPath = CurrentProfilePath(thread);
+        sample.Path = HashProfilePath(sample.ParentPath, inTag);
+        sample.Depth = thread.Depth;
+        sample.Thread = thread.Index;
+        sample.Type = Profile::CPU;
+        sample.Duration = inTime;
+        sample.StartTime = Now() - inTime;
+
+        Submit(thread, sample);
     }
 
-    void ProfilerManager::DumpToConsole()
+    void ProfilerManager::Submit( ProfileThread &outThread, const ProfileSample &inSample )
     {
-        // TODO: implememnt dump to std::cout
+        const U32 head = outThread.Head.load(std::memory_order_relaxed);
+        const U32 tail = outThread.Tail.load(std::memory_order_acquire);
+
+        if (head - tail >= GPF_PROFILER_RING_SIZE)
+        {
+            // collector is behind, never block the profiled thread
+            outThread.Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        outThread.Ring[head & (GPF_PROFILER_RING_SIZE - 1)] = inSample;
+        outThread.Head.store(head + 1, std::memory_order_release);
     }
 
-    void ProfilerManager::DumpToCSV(const std::string &inFileName)
+    U32 ProfilerManager::BeginGPUScope(const char *inTag)
     {
-        // TODO: implement export to csv code
+        if (!GPUInitialized)
+        {
+            // align GPU timestamps with the CPU timeline
+            GLint64 gpuTime = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+
+            GPUTimeOffset = static_cast<F64>(gpuTime) * 0.000001 - Now();
+            GPUInitialized = true;
+        }
+
+        const U32 slot = static_cast<U32>(FrameIndex % GPF_PROFILER_GPU_LATENCY);
+        GPUProfileFrame &frame = GPUFrames[slot];
+
+        if (frame.Pending)
+        {
+            // GPU is more than GPF_PROFILER_GPU_LATENCY frames behind, skip rather than stall
+            return InvalidGPUScope;
+        }
+
+        if (frame.Scopes.empty())
+        {
+            frame.Frame = FrameIndex;
+        }
+
+        if (frame.UsedQueries + 2 > frame.Queries.size())
+        {
+            const size_t first = frame.Queries.size();
+            frame.Queries.resize(first + 32);
+            glGenQueries(32, &frame.Queries[first]);
+        }
+
+        ProfileThread &thread = GetThread();
+
+        GPUProfileScope scope;
+        scope.Sample.Tag = inTag;
+        scope.Sample.ParentPath = GPUDepth > 0 ? GPUStack[std::min<U32>(GPUDepth, GPF_PROFILER_MAX_DEPTH) - 1] : 0;
+        scope.Sample.Path = HashProfilePath(scope.Sample.ParentPath, inTag);
+        scope.Sample.Depth = GPUDepth;
+        scope.Sample.Thread = thread.Index;
+        scope.Sample.Type = Profile::GPU;
+        scope.BeginQuery = frame.Queries[frame.UsedQueries++];
+        scope.EndQuery = frame.Queries[frame.UsedQueries++];
+
+        if (GPUDepth < GPF_PROFILER_MAX_DEPTH)
+        {
+            GPUStack[GPUDepth] = scope.Sample.Path;
+        }
+
+        GPUDepth++;
+
+        glQueryCounter(scope.BeginQuery, GL_TIMESTAMP);
+
+        frame.Scopes.push_back(scope);
+
+        // the handle carries the frame slot, a scope still open at EndFrame ends in the frame it began in. The low
+        // frame bits keep a late end from landing on a scope of a later frame once the slot has been recycled.
+        const U32 index = static_cast<U32>(frame.Scopes.size() - 1);
+        return ((index << 8) | static_cast<U32>(frame.Frame & 0xFF)) * GPF_PROFILER_GPU_LATENCY + slot;
     }
 
-    Profile::Profile( const char *inTag, ProfilingType inType )
-        : Tag( inTag )
-        , Type( inType )
-        , IsEnded( false )
+    void ProfilerManager::EndGPUScope(U32 inScope)
     {
-        if (inType == ProfilingType::CPU)
-            StartTime = glfwGetTime();
-        else 
-            glBeginQuery(GL_TIME_ELAPSED, Query);
+        if (inScope == InvalidGPUScope)
+        {
+            return;
+        }
+
+        GPUProfileFrame &frame = GPUFrames[inScope % GPF_PROFILER_GPU_LATENCY];
+        const U32 index = (inScope / GPF_PROFILER_GPU_LATENCY) >> 8;
+        const U32 frameBits = (inScope / GPF_PROFILER_GPU_LATENCY) & 0xFF;
+
+        if (index >= frame.Scopes.size() || frameBits != (frame.Frame & 0xFF) || frame.Scopes[index].IsEnded)
+        {
+            // dropped by ResolveGPU, its depth was given back there
+            return;
+        }
+
+        GPUProfileScope &scope = frame.Scopes[index];
+        glQueryCounter(scope.EndQuery, GL_TIMESTAMP);
+        scope.IsEnded = true;
+
+        if (GPUDepth > 0)
+        {
+            GPUDepth--;
+        }
     }
-    
-    Profile::~Profile()
+
+    static bool IsQueryAvailable(U32 inQuery)
     {
-        EndProfiling();
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(inQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        return available == GL_TRUE;
     }
 
-    void Profile::EndProfiling()
+    void ProfilerManager::ResolveGPU()
     {
-        if (!IsEnded)
+        if (!GPUInitialized)
         {
-            IsEnded = true;
-            F64 endTime = 0.0f;
+            return;
+        }
 
-            if (Type == ProfilingType::CPU)
+        ProfileThread &thread = GetThread();
+
+        for (U32 i = 0; i < GPF_PROFILER_GPU_LATENCY; ++i)
+        {
+            GPUProfileFrame &frame = GPUFrames[i];
+
+            if (!frame.Pending)
             {
-                endTime = glfwGetTime() - StartTime;
+                continue;
             }
-            else 
+
+            // an open scope may still end in a later frame, until its slot is needed again by the next frame
+            const bool isExpired = FrameIndex - frame.Frame + 1 >= GPF_PROFILER_GPU_LATENCY;
+
+            // never wait on the driver, results that are not back yet are polled next frame. Only issued queries
+            // are polled, the end query of an open scope never becomes available.
+            bool isAvailable = true;
+
+            for (auto it = frame.Scopes.rbegin(); it != frame.Scopes.rend() && isAvailable; ++it)
+            {
+                isAvailable = it->IsEnded ? IsQueryAvailable(it->EndQuery) && IsQueryAvailable(it->BeginQuery)
+                                          : isExpired && IsQueryAvailable(it->BeginQuery);
+            }
+
+            if (!isAvailable)
+            {
+                continue;
+            }
+
+            for (auto &scope : frame.Scopes)
             {
-                glEndQuery(GL_TIME_ELAPSED);
-                endTime = Query * 0.000001;
+                if (!scope.IsEnded)
+                {
+                    if (GPUDroppedScopes++ == 0)
+                    {
+                        std::cerr << "Warning: GPU profile scope \"" << scope.Sample.Tag << "\" was begun but never ended, dropping it\n";
+                    }
+
+                    GPUDepth = GPUDepth > 0 ? GPUDepth - 1 : 0;
+                    continue;
+                }
+
+                GLuint64 begin = 0;
+                GLuint64 end = 0;
+                glGetQueryObjectui64v(scope.BeginQuery, GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(scope.EndQuery, GL_QUERY_RESULT, &end);
+
+                scope.Sample.StartTime = static_cast<F64>(begin) * 0.000001 - GPUTimeOffset;
+                scope.Sample.Duration = static_cast<F64>(end - begin) * 0.000001;
+
+                Submit(thread, scope.Sample);
             }
-            
-            g_Profiler.Store(Tag, endTime);
+
+            frame.Scopes.clear();
+            frame.UsedQueries = 0;
+            frame.Pending = false;
         }
     }
 
-    /* Converters */
+    void ProfilerManager::ShutdownGPU()
+    {
+        for (auto &frame : GPUFrames)
+        {
+            if (!frame.Queries.empty())
+            {
+                glDeleteQueries(static_cast<GLsizei>(frame.Queries.size()), frame.Queries.data());
+            }
 
-    static constexpr GLenum BufferToGlBuffer(BufferType inBuffer)
+            frame = GPUProfileFrame();
+        }
+
+        GPUDepth = 0;
+        GPUInitialized = false;
+    }
+
+    void ProfilerManager::Collect()
     {
-        switch (inBuffer)
+        static_assert((GPF_PROFILER_RING_SIZE & (GPF_PROFILER_RING_SIZE - 1)) == 0, "GPF_PROFILER_RING_SIZE must be a power of two");
+
+        // name and head are read together, samples of a thread that reuses the slot later all lie past that head
+        struct ThreadSnapshot
         {
-        case BufferType::Array: return GL_ARRAY_BUFFER;
-        case BufferType::Index: return GL_ELEMENT_ARRAY_BUFFER;
-        case BufferType::CopyRead: return GL_COPY_READ_BUFFER;
-        case BufferType::CopyWrite: return GL_COPY_WRITE_BUFFER;
-        case BufferType::PixelUnpack: return GL_PIXEL_UNPACK_BUFFER;
-        case BufferType::PixelPack: return GL_PIXEL_PACK_BUFFER;
-        //case PxBuffer::Query: return GL_QUERY_BUFFER;
-        case BufferType::Texture: return GL_TEXTURE_BUFFER;
-        case BufferType::TransformFeedback: return GL_TRANSFORM_FEEDBACK_BUFFER;
-        case BufferType::Uniform: return GL_UNIFORM_BUFFER;
-        case BufferType::DrawIndirect: return GL_DRAW_INDIRECT_BUFFER;
-        case BufferType::AtomicCounter: return GL_ATOMIC_COUNTER_BUFFER;
-        case BufferType::DispatchIndirect: return GL_DISPATCH_INDIRECT_BUFFER;
-        case BufferType::ShaderStorage: return GL_SHADER_STORAGE_BUFFER;
+            ProfileThread *Thread;
+            std::string Name;
+            U32 Head;
+        };
+
+        std::vector< ThreadSnapshot > threads;
+        {
+            std::lock_guard<std::mutex> lock(ThreadsMutex);
+
+            for (const auto &thread : Threads)
+            {
+                threads.push_back( ThreadSnapshot{ thread.get(), thread->Name, thread->Head.load(std::memory_order_acquire) } );
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(StatsMutex);
+
+        std::vector< TraceEvent > traceEvents;
+
+        for (const auto &entry : threads)
+        {
+            ProfileThread *thread = entry.Thread;
+            const U64 threadHash = HashProfilePath(0, entry.Name.c_str());
+
+            const U32 head = entry.Head;
+            U32 tail = thread->Tail.load(std::memory_order_relaxed);
+
+            for (; tail != head; ++tail)
+            {
+                const ProfileSample &sample = thread->Ring[tail & (GPF_PROFILER_RING_SIZE - 1)];
+
+                if (Trace)
+                {
+                    const U32 tid = TraceWriter::TraceThreadID(sample);
+                    const std::string name = sample.Type == Profile::GPU ? entry.Name + " GPU" : entry.Name;
+                    auto &knownName = Trace->ThreadNames[tid];
+
+                    if (knownName != name)
+                    {
+                        knownName = name;
+
+                        TraceEvent event = {};
+                        event.Type = TraceEvent::ThreadName;
+                        event.Sample.Thread = tid;
+                        event.Name = name;
+                        traceEvents.push_back( std::move(event) );
+                    }
+
+                    TraceEvent event = {};
+                    event.Type = TraceEvent::Scope;
+                    event.Sample = sample;
+                    traceEvents.push_back( std::move(event) );
+                }
+
+                const U64 key = ProfileStatsKey(sample.Path, threadHash, sample.Type);
+
+                auto founded = Stats.find(key);
+
+                if (founded == std::end(Stats))
+                {
+                    ProfileStats stats;
+                    stats.Tag = sample.Tag;
+                    stats.Path = sample.Path;
+                    stats.ParentPath = sample.ParentPath;
+                    stats.Depth = sample.Depth;
+                    stats.Thread = entry.Name;
+                    stats.Type = sample.Type;
+                    stats.History.reserve(GPF_PROFILER_HISTORY_SIZE);
+
+                    founded = Stats.emplace(key, std::move(stats)).first;
+                    StatsOrder.push_back(key);
+                }
+
+                ProfileStats &stats = founded->second;
+                stats.Calls++;
+                stats.FrameCalls++;
+                stats.FrameTime += sample.Duration;
+            }
+
+            thread->Tail.store(tail, std::memory_order_release);
+        }
+
+        if (Trace && !traceEvents.empty())
+        {
+            Trace->Push(traceEvents);
+        }
+    }
+
+    bool ProfilerManager::BeginTraceCapture(const std::string &inFileName, size_t inMaxPendingEvents)
+    {
+        EndTraceCapture();
+
+        std::unique_ptr<TraceWriter> trace(new TraceWriter());
+        trace->File.open(inFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!trace->File.is_open())
+        {
+            std::cerr << "Failed to open trace file - " << inFileName << "\n";
+            return false;
+        }
+
+        trace->File << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        trace->MaxPendingEvents = std::max<size_t>(inMaxPendingEvents, 2);
+        trace->Pending.reserve(trace->MaxPendingEvents);
+        trace->ThreadNames[0] = "Frames";
+
+        TraceEvent frames = {};
+        frames.Type = TraceEvent::ThreadName;
+        frames.Sample.Thread = 0;
+        frames.Name = "Frames";
+
+        std::vector< TraceEvent > events;
+        events.push_back( std::move(frames) );
+        trace->Push(events);
+
+        TraceWriter *writer = trace.get();
+        trace->Worker = std::thread([writer]() { writer->Run(); });
+
+        // samples recorded before the capture started stay out of the trace
+        Collect();
+
+        std::lock_guard<std::mutex> lock(StatsMutex);
+        Trace = std::move(trace);
+        FrameStartTime = Now();
+
+        return true;
+    }
+
+    void ProfilerManager::EndTraceCapture()
+    {
+        if (!Trace)
+        {
+            return;
+        }
+
+        Collect();
+
+        std::unique_ptr<TraceWriter> trace;
+        {
+            std::lock_guard<std::mutex> lock(StatsMutex);
+            trace = std::move(Trace);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(trace->Mutex);
+            trace->IsRunning = false;
+        }
+
+        trace->Wakeup.notify_one();
+        trace->Worker.join();
+
+        trace->File << "\n]}\n";
+        trace->File.close();
+
+        if (trace->Dropped > 0)
+        {
+            std::cerr << "Warning: trace capture dropped " << trace->Dropped << " events\n";
+        }
+    }
+
+    void ProfilerManager::EndFrame()
+    {
+        if (GPUInitialized)
+        {
+            GPUProfileFrame &frame = GPUFrames[FrameIndex % GPF_PROFILER_GPU_LATENCY];
+            frame.Pending = !frame.Scopes.empty();
+
+            ResolveGPU();
+
+            if (GPUFrames[(FrameIndex + 1) % GPF_PROFILER_GPU_LATENCY].Pending)
+            {
+                GPUSkippedFrames++;
+            }
+        }
+
+        Collect();
+
+        std::lock_guard<std::mutex> lock(StatsMutex);
+
+        if (Trace)
+        {
+            const F64 now = Now();
+
+            TraceEvent event = {};
+            event.Type = TraceEvent::Frame;
+            event.FrameIndex = FrameIndex;
+            event.Sample.StartTime = FrameStartTime;
+            event.Sample.Duration = now - FrameStartTime;
+
+            std::vector< TraceEvent > events;
+            events.push_back( std::move(event) );
+            Trace->Push(events);
+
+            FrameStartTime = now;
+        }
+
+        for (auto &entry : Stats)
+        {
+            ProfileStats &stats = entry.second;
+
+            if (stats.FrameCalls == 0)
+            {
+                continue;
+            }
+
+            if (stats.History.size() < GPF_PROFILER_HISTORY_SIZE)
+            {
+                stats.History.push_back(stats.FrameTime);
+            }
+            else
+            {
+                stats.History[stats.HistoryHead] = stats.FrameTime;
+            }
+
+            stats.HistoryHead = (stats.HistoryHead + 1) % GPF_PROFILER_HISTORY_SIZE;
+            stats.FrameTime = 0.0;
+            stats.FrameCalls = 0;
+        }
+
+        FrameIndex++;
+    }
+
+    void ProfilerManager::Reset()
+    {
+        Collect();
+
+        std::lock_guard<std::mutex> lock(StatsMutex);
+        Stats.clear();
+        StatsOrder.clear();
+    }
+
+    static inline F64 Percentile(const std::vector<F64> &inSorted, F64 inPercent)
+    {
+        // nearest rank
+        const size_t rank = static_cast<size_t>( std::ceil(inPercent * inSorted.size()) );
+        return inSorted[ std::min(std::max<size_t>(rank, 1), inSorted.size()) - 1 ];
+    }
+
+    std::vector< ProfileSummary > ProfilerManager::Summarize()
+    {
+        Collect();
+
+        std::lock_guard<std::mutex> lock(StatsMutex);
+
+        std::unordered_map< U64, std::vector<U64> > children;
+        std::vector< U64 > roots;
+
+        for (U64 key : StatsOrder)
+        {
+            const ProfileStats &stats = Stats[key];
+            const U64 parentKey = ProfileStatsKey(stats.ParentPath, HashProfilePath(0, stats.Thread.c_str()), stats.Type);
+
+            if (stats.ParentPath != 0 && Stats.count(parentKey) != 0)
+            {
+                children[parentKey].push_back(key);
+            }
+            else
+            {
+                roots.push_back(key);
+            }
+        }
+
+        std::stable_sort(roots.begin(), roots.end(), [this](U64 inLhs, U64 inRhs)
+        {
+            const ProfileStats &lhs = Stats[inLhs];
+            const ProfileStats &rhs = Stats[inRhs];
+            return lhs.Thread != rhs.Thread ? lhs.Thread < rhs.Thread : lhs.Type < rhs.Type;
+        });
+
+        std::vector< ProfileSummary > result;
+        std::vector< F64 > values;
+
+        std::function<void(U64, const std::string&)> visit = [&](U64 inKey, const std::string &inParentName)
+        {
+            const ProfileStats &stats = Stats[inKey];
+
+            values.assign(stats.History.begin(), stats.History.end());
+
+            if (stats.FrameCalls > 0)
+            {
+                // include the frame that is still open, so dumps work without EndFrame
+                values.push_back(stats.FrameTime);
+            }
+
+            ProfileSummary summary = {};
+            summary.Name = stats.Tag;
+            summary.FullName = inParentName.empty() ? stats.Tag : inParentName + "/" + stats.Tag;
+            summary.Thread = stats.Thread;
+            summary.Depth = stats.Depth;
+            summary.Type = stats.Type;
+            summary.Calls = stats.Calls;
+            summary.Frames = static_cast<U32>(values.size());
+
+            if (!values.empty())
+            {
+                summary.Last = stats.FrameCalls > 0 ? stats.FrameTime : stats.History[(stats.HistoryHead + stats.History.size() - 1) % stats.History.size()];
+
+                std::sort(values.begin(), values.end());
+
+                F64 total = 0.0;
+                for (F64 value : values)
+                {
+                    total += value;
+                }
+
+                summary.Min = values.front();
+                summary.Max = values.back();
+                summary.Avg = total / values.size();
+                summary.P95 = Percentile(values, 0.95);
+                summary.P99 = Percentile(values, 0.99);
+            }
+
+            result.push_back(summary);
+
+            const auto founded = children.find(inKey);
+
+            if (founded != std::end(children))
+            {
+                const std::string fullName = result.back().FullName;
+
+                for (U64 child : founded->second)
+                {
+                    visit(child, fullName);
+                }
+            }
+        };
+
+        for (U64 root : roots)
+        {
+            visit(root, std::string());
+        }
+
+        return result;
+    }
+
+    void ProfilerManager::DumpToConsole()
+    {
+        const auto summaries = Summarize();
+
+        U64 dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(ThreadsMutex);
+
+            for (const auto &thread : Threads)
+            {
+                dropped += thread->Dropped.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::cout << "Profiler - frame " << FrameIndex << ", dropped samples " << dropped << ", skipped GPU frames " << GPUSkippedFrames
+                  << ", dropped GPU scopes " << GPUDroppedScopes << "\n";
+        std::cout << std::left << std::setw(16) << "Thread" << std::setw(40) << "Scope"
+                  << std::right << std::setw(10) << "Calls"
+                  << std::setw(10) << "Min" << std::setw(10) << "Avg" << std::setw(10) << "P95"
+                  << std::setw(10) << "P99" << std::setw(10) << "Max" << " (ms / frame)\n";
+
+        const auto flags = std::cout.flags();
+        const auto precision = std::cout.precision();
+
+        std::cout << std::fixed << std::setprecision(3);
+
+        for (const auto &summary : summaries)
+        {
+            const std::string name = std::string(summary.Depth * 2, ' ') + summary.Name + (summary.Type == Profile::GPU ? " [GPU]" : "");
+
+            std::cout << std::left << std::setw(16) << summary.Thread << std::setw(40) << name
+                      << std::right << std::setw(10) << summary.Calls
+                      << std::setw(10) << summary.Min << std::setw(10) << summary.Avg << std::setw(10) << summary.P95
+                      << std::setw(10) << summary.P99 << std::setw(10) << summary.Max << "\n";
+        }
+
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+
+    void ProfilerManager::DumpToCSV(const std::string &inFileName)
+    {
+        std::ofstream file(inFileName.c_str(), std::ios::out | std::ios::trunc);
+
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to open profiler csv - " << inFileName << "\n";
+            return;
+        }
+
+        file << "Thread,Type,Depth,Scope,Calls,Frames,Min(ms),Avg(ms),P95(ms),P99(ms),Max(ms),Last(ms)\n";
+
+        for (const auto &summary : Summarize())
+        {
+            file << "\"" << summary.Thread << "\","
+                 << (summary.Type == Profile::GPU ? "GPU" : "CPU") << ","
+                 << summary.Depth << ","
+                 << "\"" << summary.FullName << "\","
+                 << summary.Calls << ","
+                 << summary.Frames << ","
+                 << summary.Min << ","
+                 << summary.Avg << ","
+                 << summary.P95 << ","
+                 << summary.P99 << ","
+                 << summary.Max << ","
+                 << summary.Last << "\n";
+        }
+    }
+
+    Profile::Profile( const char *inTag, ProfilingType inType )
+        : Type( inType )
+        , Tag( inTag )
+        , Query( 0 )
+        , IsEnded( false )
+    {
+        if (inType == ProfilingType::CPU)
+        {
+            Sample.Type = ProfilingType::CPU;
+            g_Profiler.BeginScope(inTag, Sample);
+        }
+        else 
+        {
+            Query = g_Profiler.BeginGPUScope(inTag);
+        }
+    }
+    
+    Profile::~Profile()
+    {
+        EndProfiling();
+    }
+
+    void Profile::EndProfiling()
+    {
+        if (!IsEnded)
+        {
+            IsEnded = true;
+
+            if (Type == ProfilingType::CPU)
+            {
+                g_Profiler.EndScope(Sample);
+            }
+            else 
+            {
+                g_Profiler.EndGPUScope(Query);
+            }
+        }
+    }
+
+    /* Statistics */
+
+    FrameStats g_FrameStats;
+
+    static FrameStats s_LastFrameStats;
+
+    const FrameStats& GetFrameStats()
+    {
+        return s_LastFrameStats;
+    }
+
+    void EndFrameStats()
+    {
+        s_LastFrameStats = g_FrameStats;
+        g_FrameStats = FrameStats();
+    }
+
+    void DumpFrameStats(const FrameStats &inStats)
+    {
+        std::cout << "Draw calls - " << inStats.DrawCalls << "\n"
+                  << "Binds - program " << inStats.ProgramBinds
+                  << ", vao " << inStats.VAOBinds
+                  << ", buffer " << inStats.BufferBinds
+                  << ", texture " << inStats.TextureBinds
+                  << ", sampler " << inStats.SamplerBinds
+                  << ", framebuffer " << inStats.FramebufferBinds << "\n"
+                  << "Uniform updates - " << inStats.UniformUpdates << "\n"
+                  << "Buffer uploads - " << inStats.BufferUploads << " (" << inStats.BufferBytesUploaded << " bytes)\n"
+                  << "Texture uploads - " << inStats.TextureUploads << " (" << inStats.TextureBytesUploaded << " bytes)\n";
+    }
+
+    /* Jobs */
+
+    JobSystem g_Jobs;
+
+    JobSystem::~JobSystem()
+    {
+        Stop();
+    }
+
+    void JobSystem::Start(U32 inThreadCount)
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+
+        if (IsRunning)
+        {
+            return;
+        }
+
+        if (inThreadCount == 0)
+        {
+            const U32 hardwareThreads = std::thread::hardware_concurrency();
+            inThreadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        IsRunning = true;
+
+        for (U32 i = 0; i < inThreadCount; ++i)
+        {
+            Workers.emplace_back([this, i]()
+            {
+                const std::string name = "Worker " + std::to_string(i);
+                g_Profiler.SetThreadName(name.c_str());
+
+                while (true)
+                {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(Mutex);
+                        Wakeup.wait(lock, [this]() { return !IsRunning || !Queue.empty(); });
+
+                        if (Queue.empty())
+                        {
+                            return;
+                        }
+
+                        job = std::move(Queue.front());
+                        Queue.pop_front();
+                    }
+
+                    job();
+                }
+            });
+        }
+    }
+
+    void JobSystem::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            IsRunning = false;
+        }
+
+        // queued jobs are drained before the workers exit
+        Wakeup.notify_all();
+
+        for (auto &worker : Workers)
+        {
+            worker.join();
+        }
+
+        Workers.clear();
+    }
+
+    void JobSystem::Submit(std::function<void()> inJob)
+    {
+        Start();
+
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Queue.push_back( std::move(inJob) );
+        }
+
+        Wakeup.notify_one();
+    }
+
+    U32 JobSystem::ThreadCount()
+    {
+        Start();
+
+        std::lock_guard<std::mutex> lock(Mutex);
+        return static_cast<U32>(Workers.size());
+    }
+
+    struct ParallelForState
+    {
+        std::atomic<size_t> NextRange{ 0 };
+        std::atomic<size_t> DoneRanges{ 0 };
+        std::mutex Mutex;
+        std::condition_variable Done;
+    };
+
+    void ParallelFor(size_t inCount, size_t inGrain, const std::function<void(size_t, size_t)> &inFunction)
+    {
+        if (inCount == 0)
+        {
+            return;
+        }
+
+        const size_t threads = static_cast<size_t>(g_Jobs.ThreadCount()) + 1;
+        const size_t grain = std::max<size_t>( std::max<size_t>(inGrain, 1), (inCount + threads * 4 - 1) / (threads * 4) );
+        const size_t ranges = (inCount + grain - 1) / grain;
+
+        if (ranges == 1)
+        {
+            inFunction(0, inCount);
+            return;
+        }
+
+        auto state = std::make_shared<ParallelForState>();
+
+        // helpers may start after the caller already finished every range, they only touch the shared state then
+        auto run = [state, ranges, grain, inCount, &inFunction]()
+        {
+            for (size_t range = state->NextRange++; range < ranges; range = state->NextRange++)
+            {
+                const size_t begin = range * grain;
+                inFunction(begin, std::min(begin + grain, inCount));
+
+                if (++state->DoneRanges == ranges)
+                {
+                    std::lock_guard<std::mutex> lock(state->Mutex);
+                    state->Done.notify_all();
+                }
+            }
+        };
+
+        const size_t helpers = std::min(threads - 1, ranges - 1);
+
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            g_Jobs.Submit(run);
+        }
+
+        run();
+
+        std::unique_lock<std::mutex> lock(state->Mutex);
+        state->Done.wait(lock, [&state, ranges]() { return state->DoneRanges.load() == ranges; });
+    }
+
+    /* Converters */
+
+    static constexpr GLenum BufferToGlBuffer(BufferType inBuffer)
+    {
+        switch (inBuffer)
+        {
+        case BufferType::Array: return GL_ARRAY_BUFFER;
+        case BufferType::Index: return GL_ELEMENT_ARRAY_BUFFER;
+        case BufferType::CopyRead: return GL_COPY_READ_BUFFER;
+        case BufferType::CopyWrite: return GL_COPY_WRITE_BUFFER;
+        case BufferType::PixelUnpack: return GL_PIXEL_UNPACK_BUFFER;
+        case BufferType::PixelPack: return GL_PIXEL_PACK_BUFFER;
+        //case PxBuffer::Query: return GL_QUERY_BUFFER;
+        case BufferType::Texture: return GL_TEXTURE_BUFFER;
+        case BufferType::TransformFeedback: return GL_TRANSFORM_FEEDBACK_BUFFER;
+        case BufferType::Uniform: return GL_UNIFORM_BUFFER;
+        case BufferType::DrawIndirect: return GL_DRAW_INDIRECT_BUFFER;
+        case BufferType::AtomicCounter: return GL_ATOMIC_COUNTER_BUFFER;
+        case BufferType::DispatchIndirect: return GL_DISPATCH_INDIRECT_BUFFER;
+        case BufferType::ShaderStorage: return GL_SHADER_STORAGE_BUFFER;
+        }
+        return GL_ARRAY_BUFFER;
+    }
+
+    static constexpr GLenum BufferUsageToGlBufferUsage(BufferUsage inUsage)
+    {
+        switch (inUsage)
+        {
+        case BufferUsage::DynamicCopy: return GL_DYNAMIC_COPY;
+        case BufferUsage::DynamicDraw: return GL_DYNAMIC_DRAW;
+        case BufferUsage::DynamicRead: return GL_DYNAMIC_READ;
+        case BufferUsage::StaticCopy: return GL_STATIC_COPY;
+        case BufferUsage::StaticDraw: return GL_STATIC_DRAW;
+        case BufferUsage::StaticRead: return GL_STATIC_READ;
+        case BufferUsage::StreamCopy: return GL_STREAM_COPY;
+        case BufferUsage::StreamDraw: return GL_STREAM_DRAW;
+        case BufferUsage::StreamRead: return GL_STREAM_READ;
+        }
+        return GL_STATIC_DRAW;
+    }
+
+    U32 PixelComponents(GLenum inFormat)
+    {
+        switch (inFormat)
+        {
+        case GL_RED: case GL_GREEN: case GL_BLUE: case GL_ALPHA:
+        case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX:
+            return 1;
+        case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL:
+            return 2;
+        case GL_RGB: case GL_BGR: case GL_RGB_INTEGER:
+            return 3;
+        case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER:
+            return 4;
+        }
+        return 4;
+    }
+
+    static inline U32 TypeSize(GLenum inType)
+    {
+        switch (inType)
+        {
+        case GL_BYTE: case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT:
+            return 2;
+        case GL_INT: case GL_UNSIGNED_INT: case GL_FLOAT: case GL_INT_2_10_10_10_REV:
+            return 4;
+        case GL_DOUBLE:
+            return 8;
+        }
+        return 1;
+    }
+
+    /* IO */
+
+    bool LoadFile(const std::string &inFileName, std::string &outData)
+    {
+        std::ifstream file(inFileName.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+
+        if (file.bad())
+        {
+            return false;
+        }
+
+        file.seekg(0, std::ios::end);
+        const auto fileSize = file.tellg();
+
+        if (fileSize > 0)
+        {
+            outData.resize( static_cast<size_t>(fileSize) );
+            file.seekg(0, std::ios::beg);
+            file.read(&outData.front(), fileSize);
+        }
+
+        file.close();
+        return true;
+    }
+
+    MappedFile::MappedFile(MappedFile &&outOther) noexcept
+    {
+        *this = std::move(outOther);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile &&outOther) noexcept
+    {
+        if (this != &outOther)
+        {
+            UnmapFile(*this);
+
+            Data = outOther.Data;
+            Size = outOther.Size;
+            IsMapped = outOther.IsMapped;
+
+        #ifdef _WIN32
+            FileHandle = outOther.FileHandle;
+            MappingHandle = outOther.MappingHandle;
+            outOther.FileHandle = nullptr;
+            outOther.MappingHandle = nullptr;
+        #endif
+
+            outOther.Data = nullptr;
+            outOther.Size = 0;
+            outOther.IsMapped = false;
+        }
+
+        return *this;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        UnmapFile(*this);
+    }
+
+    bool MapFile(const std::string &inFileName, MappedFile &outFile, MapHint inHint)
+    {
+        UnmapFile(outFile);
+
+    #ifdef _WIN32
+        const DWORD flags = inHint == MapHint::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN :
+                            inHint == MapHint::Random ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL;
+
+        HANDLE file = CreateFileA(inFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        outFile.FileHandle = file;
+        outFile.Size = static_cast<size_t>(fileSize.QuadPart);
+        outFile.IsMapped = true;
+
+        if (outFile.Size == 0)
+        {
+            // empty files can not be mapped, an empty view is still valid
+            return true;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+        if (!mapping)
+        {
+            UnmapFile(outFile);
+            return false;
+        }
+
+        outFile.MappingHandle = mapping;
+        outFile.Data = static_cast<const U8*>( MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) );
+
+        if (!outFile.Data)
+        {
+            UnmapFile(outFile);
+            return false;
+        }
+    #else
+        const int file = open(inFileName.c_str(), O_RDONLY);
+
+        if (file < 0)
+        {
+            return false;
+        }
+
+        struct stat fileInfo;
+        if (fstat(file, &fileInfo) != 0)
+        {
+            close(file);
+            return false;
+        }
+
+        outFile.Size = static_cast<size_t>(fileInfo.st_size);
+        outFile.IsMapped = true;
+
+        if (outFile.Size == 0)
+        {
+            // empty files can not be mapped, an empty view is still valid
+            close(file);
+            return true;
+        }
+
+        void *data = mmap(nullptr, outFile.Size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+
+        if (data == MAP_FAILED)
+        {
+            outFile.Size = 0;
+            outFile.IsMapped = false;
+            return false;
+        }
+
+        outFile.Data = static_cast<const U8*>(data);
+
+        switch (inHint)
+        {
+        case MapHint::Sequential: posix_madvise(data, outFile.Size, POSIX_MADV_SEQUENTIAL); break;
+        case MapHint::WillNeed: posix_madvise(data, outFile.Size, POSIX_MADV_WILLNEED); break;
+        case MapHint::Random: posix_madvise(data, outFile.Size, POSIX_MADV_RANDOM); break;
+        case MapHint::Normal: break;
+        }
+    #endif
+
+        return true;
+    }
+
+    void UnmapFile(MappedFile &outFile)
+    {
+    #ifdef _WIN32
+        if (outFile.Data)
+        {
+            UnmapViewOfFile(outFile.Data);
+        }
+
+        if (outFile.MappingHandle)
+        {
+            CloseHandle(outFile.MappingHandle);
+        }
+
+        if (outFile.FileHandle)
+        {
+            CloseHandle(outFile.FileHandle);
+        }
+
+        outFile.FileHandle = nullptr;
+        outFile.MappingHandle = nullptr;
+    #else
+        if (outFile.Data)
+        {
+            munmap(const_cast<U8*>(outFile.Data), outFile.Size);
+        }
+    #endif
+
+        outFile.Data = nullptr;
+        outFile.Size = 0;
+        outFile.IsMapped = false;
+    }
+
+    // Size and modification time used to tell whether a derived file is still up to date.
+    static bool SourceFileInfo(const std::string &inFileName, U64 &outSize, I64 &outTime)
+    {
+        std::error_code error;
+        const auto size = std::filesystem::file_size(inFileName, error);
+
+        if (error)
+        {
+            return false;
+        }
+
+        const auto time = std::filesystem::last_write_time(inFileName, error);
+
+        if (error)
+        {
+            return false;
+        }
+
+        outSize = static_cast<U64>(size);
+        outTime = static_cast<I64>(time.time_since_epoch().count());
+        return true;
+    }
+
+    // Sibling of inFileName that no other process or thread writes to, for write then rename.
+    static std::string TemporaryFileName(const std::string &inFileName)
+    {
+        static std::atomic<U32> counter(0);
+
+    #ifdef _WIN32
+        const U64 process = static_cast<U64>(GetCurrentProcessId());
+    #else
+        const U64 process = static_cast<U64>(getpid());
+    #endif
+
+        const size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+        return inFileName + "." + std::to_string(process) + "." + std::to_string(thread) + "." + std::to_string(counter++) + ".tmp";
+    }
+
+    // Chunked so the result does not depend on the worker count, chunks hash in parallel on g_Jobs.
+    static U64 HashFileContents(const U8 *inData, size_t inSize)
+    {
+        static constexpr size_t kChunkSize = 4 << 20;
+        static constexpr U64 kPrime1 = 0x9E3779B185EBCA87ull;
+        static constexpr U64 kPrime2 = 0xC2B2AE3D27D4EB4Full;
+
+        auto mix = [](U64 inHash, U64 inValue)
+        {
+            inHash ^= inValue * kPrime2;
+            inHash = (inHash << 31) | (inHash >> 33);
+            return inHash * kPrime1;
+        };
+
+        const size_t chunkCount = (inSize + kChunkSize - 1) / kChunkSize;
+        std::vector< U64 > chunkHashes(chunkCount);
+
+        ParallelFor(chunkCount, 1, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t c = inBegin; c < inEnd; ++c)
+            {
+                const U8 *data = inData + c * kChunkSize;
+                const size_t size = std::min(kChunkSize, inSize - c * kChunkSize);
+
+                // four independent lanes keep the multiplies in flight
+                U64 lanes[4] = { kPrime1, kPrime2, kPrime1 ^ kPrime2, c };
+                size_t offset = 0;
+
+                for (; offset + 32 <= size; offset += 32)
+                {
+                    U64 words[4];
+                    std::memcpy(words, data + offset, sizeof(words));
+
+                    lanes[0] = mix(lanes[0], words[0]);
+                    lanes[1] = mix(lanes[1], words[1]);
+                    lanes[2] = mix(lanes[2], words[2]);
+                    lanes[3] = mix(lanes[3], words[3]);
+                }
+
+                U64 hash = mix(mix(mix(lanes[0], lanes[1]), lanes[2]), lanes[3]);
+
+                for (; offset < size; ++offset)
+                {
+                    hash = mix(hash, data[offset]);
+                }
+
+                chunkHashes[c] = mix(hash, size);
+            }
+        });
+
+        U64 hash = mix(kPrime2, inSize);
+        for (U64 chunkHash : chunkHashes)
+        {
+            hash = mix(hash, chunkHash);
+        }
+
+        return hash;
+    }
+
+    // Read-only std::istream over memory, used to hand mapped files to stream based parsers.
+    struct MemoryStreamBuffer : std::streambuf
+    {
+        MemoryStreamBuffer(const char *inData, size_t inSize)
+        {
+            char *data = const_cast<char*>(inData);
+            setg(data, data, data + inSize);
+        }
+    };
+
+    /* Images */
+
+    // Row ranges big enough to be worth splitting across g_Jobs.
+    static constexpr size_t kImageParallelBytes = 1 << 20;
+
+    void FlipImageRows(Image &outImage)
+    {
+        if (!outImage.Data || outImage.Height < 2)
+        {
+            return;
+        }
+
+        const size_t rowSize = static_cast<size_t>(outImage.Width) * outImage.Components;
+        const size_t pairs = static_cast<size_t>(outImage.Height / 2);
+        const size_t grain = std::max<size_t>(1, kImageParallelBytes / std::max<size_t>(rowSize * 2, 1));
+
+        // swaps go through a small stack buffer in chunks, memcpy takes the vector path for each chunk
+        ParallelFor(pairs, grain, [&](size_t inBegin, size_t inEnd)
+        {
+            U8 chunk[4096];
+
+            for (size_t y = inBegin; y < inEnd; ++y)
+            {
+                U8 *top = outImage.Data + y * rowSize;
+                U8 *bottom = outImage.Data + (static_cast<size_t>(outImage.Height) - 1 - y) * rowSize;
+
+                for (size_t offset = 0; offset < rowSize; offset += sizeof(chunk))
+                {
+                    const size_t size = std::min(sizeof(chunk), rowSize - offset);
+                    std::memcpy(chunk, top + offset, size);
+                    std::memcpy(top + offset, bottom + offset, size);
+                    std::memcpy(bottom + offset, chunk, size);
+                }
+            }
+        });
+    }
+
+    bool ExpandImageToRGBA(Image &outImage)
+    {
+        if (!outImage.Data || outImage.Components != 3)
+        {
+            return outImage.Data != nullptr;
+        }
+
+        const size_t pixels = static_cast<size_t>(outImage.Width) * outImage.Height;
+
+        // stb_image is built with its default allocator, so FreeImage can release this buffer too
+        U8 *expanded = static_cast<U8*>(std::malloc(pixels * 4));
+        if (!expanded)
+        {
+            return false;
+        }
+
+        const U8 *source = outImage.Data;
+        const size_t grain = kImageParallelBytes / 4;
+
+        ParallelFor(pixels, grain, [source, expanded](size_t inBegin, size_t inEnd)
+        {
+            const U8 * __restrict in = source + inBegin * 3;
+            U8 * __restrict out = expanded + inBegin * 4;
+            const size_t count = inEnd - inBegin;
+
+            // plain strided copy, vectorized by the compiler as shuffles
+            for (size_t i = 0; i < count; ++i)
+            {
+                out[i * 4 + 0] = in[i * 3 + 0];
+                out[i * 4 + 1] = in[i * 3 + 1];
+                out[i * 4 + 2] = in[i * 3 + 2];
+                out[i * 4 + 3] = 255;
+            }
+        });
+
+        stbi_image_free(outImage.Data);
+
+        outImage.Data = expanded;
+        outImage.Components = 4;
+
+        return true;
+    }
+
+    bool LoadImage(const std::string &inFileName, Image &outImage, const ImageLoadOptions &inOptions)
+    {
+        I32 x = 0;
+        I32 y = 0;
+        I32 comp = 0;
+
+        MappedFile file;
+        if (!MapFile(inFileName, file, MapHint::Sequential))
+        {
+            std::cerr << "Error: failed to open image - " << inFileName << "\n";
+            return false;
+        }
+
+        // the stb flip flag is global, flipping here keeps decoding safe on several threads
+        outImage.Data = stbi_load_from_memory(file.Data, static_cast<int>(file.Size), &x, &y, &comp, 0);
+
+        if (!glm::isPowerOfTwo(x) || !glm::isPowerOfTwo(y))
+        {
+            std::cerr << "Warning: not vaid width or height - " << inFileName << "\n";
+        }
+
+        if (!outImage.Data)
+        {
+			std::cerr << "Error: failed to load image - " << inFileName << "\n";
+            return false;
+        }
+
+        outImage.Width = x;
+        outImage.Height = y;
+        outImage.Components = comp;
+
+        if (inOptions.FlipVertically)
+        {
+            FlipImageRows(outImage);
+        }
+
+        if (inOptions.ExpandRGB && !ExpandImageToRGBA(outImage))
+        {
+            std::cerr << "Error: failed to expand image - " << inFileName << "\n";
+            FreeImage(outImage);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LoadImages(const std::vector< std::string > &inFileNames, std::vector< Image > &outImages,
+                    const ImageLoadOptions &inOptions, ImageBatchStats *outStats)
+    {
+        Profile profile("LoadImages", Profile::CPU);
+
+        const F64 start = ProfilerManager::Now();
+
+        outImages.assign(inFileNames.size(), Image{ nullptr, 0, 0, 0 });
+
+        std::atomic< U32 > failed(0);
+        std::atomic< U64 > sourceBytes(0);
+        std::atomic< U64 > decodedBytes(0);
+
+        // one file per task, large images split their flip / expand again on the same pool
+        ParallelFor(inFileNames.size(), 1, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t i = inBegin; i < inEnd; ++i)
+            {
+                std::error_code error;
+                const auto size = std::filesystem::file_size(inFileNames[i], error);
+
+                if (!LoadImage(inFileNames[i], outImages[i], inOptions))
+                {
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                const Image &image = outImages[i];
+                sourceBytes.fetch_add(error ? 0 : static_cast<U64>(size), std::memory_order_relaxed);
+                decodedBytes.fetch_add(static_cast<U64>(image.Width) * image.Height * image.Components, std::memory_order_relaxed);
+            }
+        });
+
+        if (outStats)
+        {
+            outStats->Failed = failed.load();
+            outStats->Loaded = static_cast<U32>(inFileNames.size()) - outStats->Failed;
+            outStats->SourceBytes = sourceBytes.load();
+            outStats->DecodedBytes = decodedBytes.load();
+            outStats->Milliseconds = ProfilerManager::Now() - start;
+        }
+
+        return failed.load() == 0;
+    }
+
+    void DumpImageBatchStats(const ImageBatchStats &inStats)
+    {
+        std::cout << "Image decode - " << inStats.Loaded << " loaded, " << inStats.Failed << " failed, "
+                  << (inStats.SourceBytes >> 20) << " MB in, " << (inStats.DecodedBytes >> 20) << " MB out, "
+                  << std::fixed << std::setprecision(2) << inStats.Milliseconds << " ms, "
+                  << inStats.MegabytesPerSecond() << " MB/s\n" << std::defaultfloat;
+    }
+
+    void FreeImage(Image &outImage)
+    {
+        if (outImage.Data)
+        {
+            stbi_image_free(outImage.Data);
+
+            outImage.Data = nullptr;
+            outImage.Width = 0;
+            outImage.Height = 0;
+            outImage.Components = 0;
+        }
+    }
+
+    /* Load OBJ */
+
+    inline void FetchMaterials(const std::vector<tinyobj::material_t> &inMatreials, Geometry &outGeometry)
+    {
+        for (const auto &material : inMatreials) 
+        {
+            // TODO: Get parameters from material.ambient_texopt and other textures ...
+            const auto founded = outGeometry.Materials.find(material.name);
+
+            if (founded == std::end(outGeometry.Materials))
+            {
+                MaterialInfo materialInfo;
+
+                materialInfo.Name = material.name;
+                materialInfo.AmbientTextureName = material.ambient_texname;
+                materialInfo.DiffuseTextureName = material.diffuse_texname;
+                materialInfo.SpecularTextureName = material.specular_texname;
+                materialInfo.HighlightTextureName = material.specular_highlight_texname;
+                materialInfo.BumpTextureName = material.bump_texname;
+                materialInfo.DisplacementTextureName = material.displacement_texname;
+                materialInfo.AlphaTextureName = material.alpha_texname;
+                materialInfo.ReflectionTextureName = material.reflection_texname;
+
+                outGeometry.Materials.emplace( material.name, materialInfo );
+            }
+        }
+    }
+
+    // Parsing helpers work on [ioCursor, inEnd) and never read past inEnd, the mapped file is not zero terminated.
+
+    static inline bool IsOBJSpace(char inChar)
+    {
+        return inChar == ' ' || inChar == '\t' || inChar == '\r';
+    }
+
+    static inline void SkipOBJSpaces(const char *&ioCursor, const char *inEnd)
+    {
+        while (ioCursor < inEnd && IsOBJSpace(*ioCursor))
+        {
+            ++ioCursor;
+        }
+    }
+
+    static inline void SkipOBJLine(const char *&ioCursor, const char *inEnd)
+    {
+        const void *newline = std::memchr(ioCursor, '\n', static_cast<size_t>(inEnd - ioCursor));
+        ioCursor = newline ? static_cast<const char*>(newline) + 1 : inEnd;
+    }
+
+    // Locale independent decimal parser in the spirit of std::from_chars, which not every standard library ships for floats.
+    static bool ParseOBJFloat(const char *&ioCursor, const char *inEnd, F32 &outValue)
+    {
+        static const F64 kPowers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+        const char *cursor = ioCursor;
+        bool isNegative = false;
+
+        if (cursor < inEnd && (*cursor == '-' || *cursor == '+'))
+        {
+            isNegative = *cursor == '-';
+            ++cursor;
+        }
+
+        U64 mantissa = 0;
+        I32 exponent = 0;
+        I32 digits = 0;
+        bool hasDigits = false;
+
+        for (; cursor < inEnd && *cursor >= '0' && *cursor <= '9'; ++cursor)
+        {
+            hasDigits = true;
+
+            // digits past 19 do not fit the mantissa and only shift the exponent
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + static_cast<U64>(*cursor - '0');
+                digits += mantissa != 0;
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+
+        if (cursor < inEnd && *cursor == '.')
+        {
+            for (++cursor; cursor < inEnd && *cursor >= '0' && *cursor <= '9'; ++cursor)
+            {
+                hasDigits = true;
+
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + static_cast<U64>(*cursor - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+
+        if (!hasDigits)
+        {
+            return false;
+        }
+
+        if (cursor < inEnd && (*cursor == 'e' || *cursor == 'E'))
+        {
+            const char *exponentStart = cursor++;
+            bool isExponentNegative = false;
+            I32 value = 0;
+
+            if (cursor < inEnd && (*cursor == '-' || *cursor == '+'))
+            {
+                isExponentNegative = *cursor == '-';
+                ++cursor;
+            }
+
+            if (cursor < inEnd && *cursor >= '0' && *cursor <= '9')
+            {
+                for (; cursor < inEnd && *cursor >= '0' && *cursor <= '9'; ++cursor)
+                {
+                    value = std::min(value * 10 + (*cursor - '0'), 10000);
+                }
+
+                exponent += isExponentNegative ? -value : value;
+            }
+            else
+            {
+                cursor = exponentStart;
+            }
+        }
+
+        F64 result = static_cast<F64>(mantissa);
+
+        if (exponent < 0)
+        {
+            result = -exponent <= 22 ? result / kPowers[-exponent] : result * std::pow(10.0, exponent);
+        }
+        else if (exponent > 0)
+        {
+            result = exponent <= 22 ? result * kPowers[exponent] : result * std::pow(10.0, exponent);
+        }
+
+        outValue = static_cast<F32>(isNegative ? -result : result);
+        ioCursor = cursor;
+        return true;
+    }
+
+    static bool ParseOBJInt(const char *&ioCursor, const char *inEnd, I32 &outValue)
+    {
+        const char *cursor = ioCursor;
+        bool isNegative = false;
+
+        if (cursor < inEnd && (*cursor == '-' || *cursor == '+'))
+        {
+            isNegative = *cursor == '-';
+            ++cursor;
+        }
+
+        if (cursor >= inEnd || *cursor < '0' || *cursor > '9')
+        {
+            return false;
+        }
+
+        I64 value = 0;
+        for (; cursor < inEnd && *cursor >= '0' && *cursor <= '9'; ++cursor)
+        {
+            value = std::min<I64>(value * 10 + (*cursor - '0'), std::numeric_limits<I32>::max());
+        }
+
+        outValue = static_cast<I32>(isNegative ? -value : value);
+        ioCursor = cursor;
+        return true;
+    }
+
+    static std::string ParseOBJName(const char *&ioCursor, const char *inEnd)
+    {
+        SkipOBJSpaces(ioCursor, inEnd);
+
+        const char *begin = ioCursor;
+        while (ioCursor < inEnd && *ioCursor != '\n')
+        {
+            ++ioCursor;
+        }
+
+        const char *end = ioCursor;
+        while (end > begin && (IsOBJSpace(end[-1])))
+        {
+            --end;
+        }
+
+        return std::string(begin, end);
+    }
+
+    static constexpr I32 kOBJMissingIndex = std::numeric_limits<I32>::min();
+
+    // Face corner as 0-based indices. Negative OBJ indices count back from the chunk local element count
+    // and are marked relative until the element counts of earlier chunks are known.
+    struct OBJCorner
+    {
+        I32 Position = kOBJMissingIndex;
+        I32 TexCoord = kOBJMissingIndex;
+        I32 Normal = kOBJMissingIndex;
+        U8 Relative = 0;
+    };
+
+    struct OBJChunk
+    {
+        const char *Begin = nullptr;
+        const char *End = nullptr;
+
+        std::vector< glm::vec3 > Positions;
+        std::vector< glm::vec3 > Normals;
+        std::vector< glm::vec2 > TexCoords;
+        std::vector< OBJCorner > Corners;
+
+        // material switches as (first corner in this chunk, material name)
+        std::vector< std::pair< size_t, std::string > > MaterialSwitches;
+        std::vector< std::string > Libraries;
+
+        size_t PositionBase = 0;
+        size_t NormalBase = 0;
+        size_t TexCoordBase = 0;
+    };
+
+    static I32 ResolveOBJIndex(I32 inIndex, size_t inLocalCount, U8 inFlag, U8 &outRelative)
+    {
+        if (inIndex > 0)
+        {
+            return inIndex - 1;
+        }
+
+        if (inIndex < 0)
+        {
+            outRelative |= inFlag;
+            return static_cast<I32>(inLocalCount) + inIndex;
+        }
+
+        return kOBJMissingIndex;
+    }
+
+    static void ParseOBJChunk(OBJChunk &outChunk)
+    {
+        Profile profile("ParseOBJChunk", Profile::CPU);
+
+        const char *cursor = outChunk.Begin;
+        const char *end = outChunk.End;
+        std::vector< OBJCorner > polygon;
+
+        while (cursor < end)
+        {
+            SkipOBJSpaces(cursor, end);
+
+            if (cursor >= end)
+            {
+                break;
+            }
+
+            const char tag = *cursor;
+
+            const char kind = cursor + 1 < end ? cursor[1] : '\n';
+            const bool isAttribute = tag == 'v' && (IsOBJSpace(kind) || ((kind == 'n' || kind == 't') && cursor + 2 < end && IsOBJSpace(cursor[2])));
+
+            if (isAttribute)
+            {
+                cursor += IsOBJSpace(kind) ? 1 : 2;
+
+                if (IsOBJSpace(kind) || kind == 'n')
+                {
+                    glm::vec3 value(0.0f);
+                    SkipOBJSpaces(cursor, end);
+                    ParseOBJFloat(cursor, end, value.x);
+                    SkipOBJSpaces(cursor, end);
+                    ParseOBJFloat(cursor, end, value.y);
+                    SkipOBJSpaces(cursor, end);
+                    ParseOBJFloat(cursor, end, value.z);
+
+                    (kind == 'n' ? outChunk.Normals : outChunk.Positions).push_back(value);
+                }
+                else if (kind == 't')
+                {
+                    glm::vec2 value(0.0f);
+                    SkipOBJSpaces(cursor, end);
+                    ParseOBJFloat(cursor, end, value.x);
+                    SkipOBJSpaces(cursor, end);
+                    ParseOBJFloat(cursor, end, value.y);
+
+                    outChunk.TexCoords.push_back(value);
+                }
+            }
+            else if (tag == 'f' && IsOBJSpace(kind))
+            {
+                ++cursor;
+                polygon.clear();
+
+                for (;;)
+                {
+                    SkipOBJSpaces(cursor, end);
+
+                    I32 index = 0;
+                    if (!ParseOBJInt(cursor, end, index))
+                    {
+                        break;
+                    }
+
+                    OBJCorner corner;
+                    corner.Position = ResolveOBJIndex(index, outChunk.Positions.size(), 1, corner.Relative);
+
+                    if (cursor < end && *cursor == '/')
+                    {
+                        ++cursor;
+
+                        if (ParseOBJInt(cursor, end, index))
+                        {
+                            corner.TexCoord = ResolveOBJIndex(index, outChunk.TexCoords.size(), 2, corner.Relative);
+                        }
+
+                        if (cursor < end && *cursor == '/')
+                        {
+                            ++cursor;
+
+                            if (ParseOBJInt(cursor, end, index))
+                            {
+                                corner.Normal = ResolveOBJIndex(index, outChunk.Normals.size(), 4, corner.Relative);
+                            }
+                        }
+                    }
+
+                    polygon.push_back(corner);
+                }
+
+                // fan triangulation, the same as tinyobj did
+                for (size_t i = 2; i < polygon.size(); ++i)
+                {
+                    outChunk.Corners.push_back(polygon[0]);
+                    outChunk.Corners.push_back(polygon[i - 1]);
+                    outChunk.Corners.push_back(polygon[i]);
+                }
+            }
+            else if (tag == 'u' && static_cast<size_t>(end - cursor) > 7 && std::memcmp(cursor, "usemtl", 6) == 0 && IsOBJSpace(cursor[6]))
+            {
+                cursor += 6;
+                outChunk.MaterialSwitches.emplace_back(outChunk.Corners.size(), ParseOBJName(cursor, end));
+            }
+            else if (tag == 'm' && static_cast<size_t>(end - cursor) > 7 && std::memcmp(cursor, "mtllib", 6) == 0 && IsOBJSpace(cursor[6]))
+            {
+                cursor += 6;
+                outChunk.Libraries.push_back(ParseOBJName(cursor, end));
+            }
+
+            SkipOBJLine(cursor, end);
+        }
+    }
+
+    static void LoadOBJMaterials(const std::string &inFileName, const std::vector< OBJChunk > &inChunks, Geometry &outGeometry)
+    {
+        const std::filesystem::path directory = std::filesystem::path(inFileName).parent_path();
+
+        for (const auto &chunk : inChunks)
+        {
+            for (const auto &library : chunk.Libraries)
+            {
+                const std::string path = (directory / library).generic_string();
+
+                MappedFile file;
+                if (!MapFile(path, file, MapHint::Sequential))
+                {
+                    std::cerr << "Mesh loading - " << inFileName << " warning - material library not found " << path << ".\n";
+                    continue;
+                }
+
+                // MTL files are small, tinyobj stays in charge of them
+                MemoryStreamBuffer buffer(file.Chars(), file.Size);
+                std::istream stream(&buffer);
+
+                std::map<std::string, int> materialMap;
+                std::vector<tinyobj::material_t> materials;
+                std::string warnings;
+                std::string errs;
+
+                tinyobj::LoadMtl(&materialMap, &materials, &stream, &warnings, &errs);
+
+                if (!errs.empty())
+                {
+                    std::cerr << "Mesh loading - " << path << " - " << errs << std::endl;
+                }
+
+                FetchMaterials(materials, outGeometry);
+            }
+        }
+    }
+
+    // Chunk holding the attribute with global index inIndex, the last one whose base is not above it.
+    static const OBJChunk& FindOBJChunk(const std::vector< OBJChunk > &inChunks, size_t OBJChunk::*inBase, size_t inIndex)
+    {
+        size_t low = 0;
+        size_t high = inChunks.size();
+
+        while (high - low > 1)
+        {
+            const size_t middle = (low + high) / 2;
+
+            if (inChunks[middle].*inBase <= inIndex)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        return inChunks[low];
+    }
+
+    // Copies the attributes of every unique corner into vertices, corners with the same index triple share one vertex.
+    // Attributes are read from the chunks that parsed them, corner indices are global.
+    static void EmitOBJVertices(const std::vector< OBJChunk > &inChunks,
+                                const std::vector< VertexIndexKey > &inCorners,
+                                size_t inExpectedVertices,
+                                Geometry &outGeometry)
+    {
+        Profile profile("EmitOBJVertices", Profile::CPU);
+
+        // an index triple per position is the common case, seams add a few more
+        std::vector< U32 > firstCorners;
+        const U32 vertexCount = DeduplicateVertexKeys(inCorners, outGeometry.Indices, firstCorners, inExpectedVertices + inExpectedVertices / 8);
+
+        outGeometry.Vertices_1P1N1UV1T1BT.resize(vertexCount);
+
+        std::mutex boundsMutex;
+
+        ParallelFor(vertexCount, 1 << 14, [&](size_t inBegin, size_t inEnd)
+        {
+            AABB bounds;
+
+            for (size_t i = inBegin; i < inEnd; ++i)
+            {
+                const VertexIndexKey &corner = inCorners[firstCorners[i]];
+                Vertex1P1N1UV1T1BT vertex = {};
+
+                const OBJChunk &positionChunk = FindOBJChunk(inChunks, &OBJChunk::PositionBase, corner.Position);
+                vertex.Position = positionChunk.Positions[corner.Position - positionChunk.PositionBase];
+
+                // texcoords
+                vertex.TexCoord = { 1.0, 1.0 };
+
+                if (corner.TexCoord >= 0)
+                {
+                    const OBJChunk &texCoordChunk = FindOBJChunk(inChunks, &OBJChunk::TexCoordBase, corner.TexCoord);
+                    const glm::vec2 &texCoord = texCoordChunk.TexCoords[corner.TexCoord - texCoordChunk.TexCoordBase];
+                    vertex.TexCoord = { texCoord.x, 1.0f - texCoord.y };
+                }
+
+                // normals
+                vertex.Normal = { 1.0f, 1.0f, 1.0f };
+
+                if (corner.Normal >= 0)
+                {
+                    const OBJChunk &normalChunk = FindOBJChunk(inChunks, &OBJChunk::NormalBase, corner.Normal);
+                    vertex.Normal = normalChunk.Normals[corner.Normal - normalChunk.NormalBase];
+                }
+
+                outGeometry.Vertices_1P1N1UV1T1BT[i] = vertex;
+
+                bounds.Min = glm::min(bounds.Min, vertex.Position);
+                bounds.Max = glm::max(bounds.Max, vertex.Position);
+            }
+
+            std::lock_guard<std::mutex> lock(boundsMutex);
+            outGeometry.Bounds.Min = glm::min(outGeometry.Bounds.Min, bounds.Min);
+            outGeometry.Bounds.Max = glm::max(outGeometry.Bounds.Max, bounds.Max);
+        });
+    }
+
+    // Corners [Begin, End) in file order share a material and go to Target onward in the final corner order.
+    struct OBJMaterialRun
+    {
+        size_t Begin;
+        size_t End;
+        size_t Target;
+        U32 Material;
+    };
+
+    // Groups the triangles by material, in order of first use, and records one submesh per material.
+    // Only the destinations are planned here, every chunk then writes its corners straight to them.
+    static void PlanOBJMaterialRuns(const std::vector< OBJChunk > &inChunks, const std::vector< size_t > &inCornerBases,
+                                    size_t inCornerCount, std::vector< OBJMaterialRun > &outRuns, Geometry &outGeometry)
+    {
+        Profile profile("PlanOBJMaterialRuns", Profile::CPU);
+
+        std::vector< std::string > names;
+        std::unordered_map< std::string, U32 > materialIDs;
+        std::vector< OBJMaterialRun > &runs = outRuns;
+
+        runs.clear();
+
+        // a usemtl holds until the next one, across chunk boundaries too
+        auto addRun = [&](size_t inBegin, const std::string &inName)
+        {
+            auto inserted = materialIDs.emplace(inName, static_cast<U32>(names.size()));
+            if (inserted.second)
+            {
+                names.push_back(inName);
+            }
+
+            if (!runs.empty())
+            {
+                runs.back().End = inBegin;
+            }
+
+            runs.push_back(OBJMaterialRun{ inBegin, inCornerCount, inBegin, inserted.first->second });
+        };
+
+        for (size_t i = 0; i < inChunks.size(); ++i)
+        {
+            for (const auto &materialSwitch : inChunks[i].MaterialSwitches)
+            {
+                const size_t begin = inCornerBases[i] + materialSwitch.first;
+
+                if (runs.empty() && begin > 0)
+                {
+                    addRun(0, std::string());
+                }
+
+                addRun(begin, materialSwitch.second);
+            }
+        }
+
+        if (runs.empty())
+        {
+            addRun(0, std::string());
+        }
+
+        // destination of every run, materials keep their first use order and runs their file order
+        std::vector< size_t > materialBegins(names.size() + 1, 0);
+
+        for (const OBJMaterialRun &run : runs)
+        {
+            materialBegins[run.Material + 1] += run.End - run.Begin;
+        }
+
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            materialBegins[i + 1] += materialBegins[i];
+        }
+
+        outGeometry.SubMeshes.clear();
+
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            if (materialBegins[i + 1] == materialBegins[i])
+            {
+                continue;
+            }
+
+            SubMesh subMesh;
+            subMesh.FirstIndex = static_cast<U32>(materialBegins[i]);
+            subMesh.IndexCount = static_cast<U32>(materialBegins[i + 1] - materialBegins[i]);
+            subMesh.Material = names[i];
+            outGeometry.SubMeshes.push_back(subMesh);
+        }
+
+        // a single material keeps the file order, Target already is Begin
+        if (outGeometry.SubMeshes.size() < 2)
+        {
+            return;
+        }
+
+        std::vector< size_t > cursors(materialBegins.begin(), materialBegins.end() - 1);
+
+        for (OBJMaterialRun &run : runs)
+        {
+            run.Target = cursors[run.Material];
+            cursors[run.Material] += run.End - run.Begin;
+        }
+    }
+
+    bool LoadOBJ(const std::string &inFileName, Geometry &outGeometry, bool inUseCache)
+    {
+        Profile profile("LoadOBJ", Profile::CPU);
+
+        if (inUseCache)
+        {
+            MeshCache cache;
+
+            if (LoadValidMeshCache(inFileName, cache))
+            {
+                MeshCacheToGeometry(cache, outGeometry);
+                return true;
+            }
+        }
+
+        MappedFile file;
+        if (!MapFile(inFileName, file, MapHint::Sequential))
+        {
+            std::cerr << "Failed open mesh - " << inFileName << std::endl;
+            return false;
+        }
+
+        // split at line starts, several chunks per worker so uneven chunks still balance
+        const char *begin = file.Chars();
+        const char *end = begin + file.Size;
+        const size_t chunkTarget = std::max<size_t>(1, std::min<size_t>(g_Jobs.ThreadCount() * 4 + 1, file.Size >> 20));
+        const size_t chunkSize = file.Size / chunkTarget + 1;
+
+        std::vector< OBJChunk > chunks;
+        const char *chunkBegin = begin;
+
+        while (chunkBegin < end)
+        {
+            const char *chunkEnd = chunkBegin + std::min<size_t>(chunkSize, static_cast<size_t>(end - chunkBegin));
+
+            // move the cut behind the newline of the line it landed in
+            if (chunkEnd < end)
+            {
+                --chunkEnd;
+                SkipOBJLine(chunkEnd, end);
+            }
+
+            OBJChunk chunk;
+            chunk.Begin = chunkBegin;
+            chunk.End = chunkEnd;
+            chunks.push_back(std::move(chunk));
+
+            chunkBegin = chunkEnd;
+        }
+
+        ParallelFor(chunks.size(), 1, [&chunks](size_t inBegin, size_t inEnd)
+        {
+            for (size_t i = inBegin; i < inEnd; ++i)
+            {
+                ParseOBJChunk(chunks[i]);
+            }
+        });
+
+        // element bases of every chunk, attributes stay in their chunks and corners go straight to their final slot
+        size_t positionCount = 0;
+        size_t normalCount = 0;
+        size_t texCoordCount = 0;
+        size_t cornerCount = 0;
+        std::vector< size_t > cornerBases(chunks.size());
+
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            chunks[i].PositionBase = positionCount;
+            chunks[i].NormalBase = normalCount;
+            chunks[i].TexCoordBase = texCoordCount;
+            cornerBases[i] = cornerCount;
+
+            positionCount += chunks[i].Positions.size();
+            normalCount += chunks[i].Normals.size();
+            texCoordCount += chunks[i].TexCoords.size();
+            cornerCount += chunks[i].Corners.size();
+        }
+
+        if (positionCount == 0 || cornerCount == 0)
+        {
+            std::cerr << "Failed load mesh - " << inFileName << " - no faces" << std::endl;
+            return false;
+        }
+
+        LoadOBJMaterials(inFileName, chunks, outGeometry);
+
+        std::vector< OBJMaterialRun > runs;
+        PlanOBJMaterialRuns(chunks, cornerBases, cornerCount, runs, outGeometry);
+
+        std::vector< VertexIndexKey > corners(cornerCount);
+        std::atomic< bool > isValid(true);
+
+        ParallelFor(chunks.size(), 1, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t i = inBegin; i < inEnd; ++i)
+            {
+                OBJChunk &chunk = chunks[i];
+
+                // first run that can hold the first corner of the chunk, runs are in file order
+                size_t run = static_cast<size_t>(std::upper_bound(runs.begin(), runs.end(), cornerBases[i], [](size_t inCorner, const OBJMaterialRun &inRun)
+                {
+                    return inCorner < inRun.Begin;
+                }) - runs.begin()) - 1;
+
+                for (size_t c = 0; c < chunk.Corners.size(); ++c)
+                {
+                    const size_t fileCorner = cornerBases[i] + c;
+
+                    while (fileCorner >= runs[run].End)
+                    {
+                        ++run;
+                    }
+
+                    VertexIndexKey &target = corners[runs[run].Target + (fileCorner - runs[run].Begin)];
+                    OBJCorner corner = chunk.Corners[c];
+
+                    corner.Position += (corner.Relative & 1) ? static_cast<I32>(chunk.PositionBase) : 0;
+                    corner.TexCoord += (corner.Relative & 2) ? static_cast<I32>(chunk.TexCoordBase) : 0;
+                    corner.Normal += (corner.Relative & 4) ? static_cast<I32>(chunk.NormalBase) : 0;
+
+                    // a missing texcoord / normal index just falls back to the defaults
+                    if (corner.Position < 0 || static_cast<size_t>(corner.Position) >= positionCount)
+                    {
+                        isValid.store(false, std::memory_order_relaxed);
+                        corner.Position = 0;
+                    }
+
+                    if (corner.TexCoord != kOBJMissingIndex && (corner.TexCoord < 0 || static_cast<size_t>(corner.TexCoord) >= texCoordCount))
+                    {
+                        corner.TexCoord = kOBJMissingIndex;
+                    }
+
+                    if (corner.Normal != kOBJMissingIndex && (corner.Normal < 0 || static_cast<size_t>(corner.Normal) >= normalCount))
+                    {
+                        corner.Normal = kOBJMissingIndex;
+                    }
+
+                    target.Position = corner.Position;
+                    target.TexCoord = corner.TexCoord == kOBJMissingIndex ? -1 : corner.TexCoord;
+                    target.Normal = corner.Normal == kOBJMissingIndex ? -1 : corner.Normal;
+                }
+
+                chunk.Corners = std::vector< OBJCorner >();
+            }
+        });
+
+        if (!isValid.load())
+        {
+            std::cerr << "Failed load mesh - " << inFileName << " - face references a missing vertex" << std::endl;
+            return false;
+        }
+
+        EmitOBJVertices(chunks, corners, std::max(positionCount, std::max(normalCount, texCoordCount)), outGeometry);
+
+        // the attributes are in the vertices now
+        chunks = std::vector< OBJChunk >();
+        corners = std::vector< VertexIndexKey >();
+
+        UpdateSubMeshBounds(outGeometry);
+
+        GenerateTangents(outGeometry);
+
+        OptimizeGeometry(outGeometry);
+
+        outGeometry.VertexCount = static_cast<U32>(outGeometry.Vertices_1P1N1UV1T1BT.size());
+        outGeometry.IndexCount = static_cast<U32>(outGeometry.Indices.size());
+
+        outGeometry.Bounds.Dimensions = outGeometry.Bounds.Max - outGeometry.Bounds.Min;
+	    outGeometry.Bounds.Center = (outGeometry.Bounds.Max + outGeometry.Bounds.Min) / 2.0f;
+
+        U64 sourceSize = 0;
+        I64 sourceTime = 0;
+
+        if (inUseCache && SourceFileInfo(inFileName, sourceSize, sourceTime) &&
+            !SaveMeshCache(MeshCachePath(inFileName), outGeometry, sourceSize, sourceTime, HashFileContents(file.Data, file.Size)))
+        {
+            std::cerr << "Warning: failed to write mesh cache - " << MeshCachePath(inFileName) << "\n";
+        }
+
+        return true;
+    }
+
+    // Attribute layout of the bound VAO / VBO for a vertex stream. The quantized one keeps the slots but hands
+    // the shader a 2 component octahedral normal and a 4 component tangent with the handedness in w, no bitangent.
+    static void SetupVertexLayout(VertexFormat inFormat, PositionEncoding inEncoding = PositionEncoding::Unorm16)
+    {
+        U32 offset = 0;
+
+        if (inFormat == VertexFormat::P1N1UV1T1BT)
+        {
+            const U32 stride = sizeof(Vertex1P1N1UV1T1BT);
+            offset = ElementLayout<float>(0, 3, stride, offset); // position
+            offset = ElementLayout<float>(1, 3, stride, offset); // normal
+            offset = ElementLayout<float>(2, 2, stride, offset); // texcoord
+            offset = ElementLayout<float>(3, 3, stride, offset); // tangent
+            offset = ElementLayout<float>(4, 3, stride, offset); // bitangent
+        }
+        else if (inFormat == VertexFormat::P1N1UV)
+        {
+            const U32 stride = sizeof(Vertex1P1N1UV);
+            offset = ElementLayout<float>(0, 3, stride, offset); // position
+            offset = ElementLayout<float>(1, 3, stride, offset); // normal
+            offset = ElementLayout<float>(2, 2, stride, offset); // texcoord
+        }
+        else if (inFormat == VertexFormat::P1UV)
+        {
+            const U32 stride = sizeof(Vertex1P1UV);
+            offset = ElementLayout<float>(0, 3, stride, offset); // position
+            offset = ElementLayout<float>(1, 2, stride, offset); // texcoord
+        }
+        else
+        {
+            const U32 stride = sizeof(VertexQuantized);
+
+            if (inEncoding == PositionEncoding::Half)
+            {
+                offset = ElementLayout<Half>(0, 4, stride, offset); // position
+            }
+            else
+            {
+                offset = ElementLayout<U16>(0, 4, stride, offset, true); // position
+            }
+
+            offset = ElementLayout<I16>(1, 2, stride, offset, true); // normal
+            offset = ElementLayout<Half>(2, 2, stride, offset); // texcoord
+            offset = ElementLayout<PackedInt2101010>(3, 4, stride, offset, true); // tangent
+        }
+    }
+
+    static U32 VertexFormatStride(VertexFormat inFormat)
+    {
+        switch (inFormat)
+        {
+        case VertexFormat::P1N1UV1T1BT: return sizeof(Vertex1P1N1UV1T1BT);
+        case VertexFormat::P1N1UV: return sizeof(Vertex1P1N1UV);
+        case VertexFormat::P1UV: return sizeof(Vertex1P1UV);
+        case VertexFormat::Quantized: return sizeof(VertexQuantized);
+        }
+
+        return 0;
+    }
+
+    static bool UseShortIndices(size_t inVertexCount)
+    {
+        return inVertexCount < 65536;
+    }
+
+    // The richest non empty vertex stream of the geometry, the one that gets uploaded and cached.
+    static VertexFormat GeometryVertexFormat(const Geometry &inGeometry, const void *&outData, size_t &outStride, size_t &outCount)
+    {
+        if (!inGeometry.Vertices_1P1N1UV1T1BT.empty())
+        {
+            outData = inGeometry.Vertices_1P1N1UV1T1BT.data();
+            outStride = sizeof(Vertex1P1N1UV1T1BT);
+            outCount = inGeometry.Vertices_1P1N1UV1T1BT.size();
+            return VertexFormat::P1N1UV1T1BT;
+        }
+
+        if (!inGeometry.Vertices_1P1N1UV.empty())
+        {
+            outData = inGeometry.Vertices_1P1N1UV.data();
+            outStride = sizeof(Vertex1P1N1UV);
+            outCount = inGeometry.Vertices_1P1N1UV.size();
+            return VertexFormat::P1N1UV;
+        }
+
+        outData = inGeometry.Vertices_1P1UV.data();
+        outStride = sizeof(Vertex1P1UV);
+        outCount = inGeometry.Vertices_1P1UV.size();
+        return VertexFormat::P1UV;
+    }
+
+    // The stream that goes to the GPU and into the cache, the quantized one when it is filled.
+    static VertexFormat UploadVertexFormat(const Geometry &inGeometry, const void *&outData, size_t &outStride, size_t &outCount)
+    {
+        if (!inGeometry.Vertices_Quantized.empty())
+        {
+            outData = inGeometry.Vertices_Quantized.data();
+            outStride = sizeof(VertexQuantized);
+            outCount = inGeometry.Vertices_Quantized.size();
+            return VertexFormat::Quantized;
+        }
+
+        return GeometryVertexFormat(inGeometry, outData, outStride, outCount);
+    }
+
+    void UploadGeometry(Geometry &outGeometry)
+    {
+        const void *vertices = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        const VertexFormat format = UploadVertexFormat(outGeometry, vertices, stride, count);
+
+        outGeometry.VAO = GenerateVAO();
+
+        outGeometry.VBO = GenerateBuffer(BufferType::Array);
+        UploadDataImmutable(BufferType::Array, vertices, stride * count);
+        SetupVertexLayout(format, outGeometry.Quantization.Encoding);
+
+        outGeometry.IBO = GenerateBuffer(BufferType::Index);
+
+        if (UseShortIndices(count))
+        {
+            const std::vector< U16 > indices(outGeometry.Indices.begin(), outGeometry.Indices.end());
+            UploadDataImmutable(BufferType::Index, indices);
+            outGeometry.IndexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            UploadDataImmutable(BufferType::Index, outGeometry.Indices);
+            outGeometry.IndexType = GL_UNSIGNED_INT;
+        }
+
+        BindVAO(0);
+    }
+
+    void UpdateSubMeshBounds(Geometry &outGeometry)
+    {
+        const void *vertices = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        GeometryVertexFormat(outGeometry, vertices, stride, count);
+
+        if (count == 0)
+        {
+            return;
+        }
+
+        // every vertex format starts with the position
+        const U8 *positions = static_cast<const U8*>(vertices);
+        std::mutex boundsMutex;
+
+        for (SubMesh &subMesh : outGeometry.SubMeshes)
+        {
+            subMesh.Bounds = AABB();
+
+            ParallelFor(subMesh.IndexCount, 1 << 15, [&](size_t inBegin, size_t inEnd)
+            {
+                AABB bounds;
+
+                for (size_t i = subMesh.FirstIndex + inBegin; i < subMesh.FirstIndex + inEnd; ++i)
+                {
+                    glm::vec3 position;
+                    std::memcpy(&position, positions + stride * outGeometry.Indices[i], sizeof(position));
+
+                    bounds.Min = glm::min(bounds.Min, position);
+                    bounds.Max = glm::max(bounds.Max, position);
+                }
+
+                std::lock_guard<std::mutex> lock(boundsMutex);
+                subMesh.Bounds.Min = glm::min(subMesh.Bounds.Min, bounds.Min);
+                subMesh.Bounds.Max = glm::max(subMesh.Bounds.Max, bounds.Max);
+            });
+
+            subMesh.Bounds.Dimensions = subMesh.Bounds.Max - subMesh.Bounds.Min;
+            subMesh.Bounds.Center = (subMesh.Bounds.Max + subMesh.Bounds.Min) / 2.0f;
+        }
+    }
+
+    /* Vertex deduplication */
+
+    void VertexIndexMap::Reserve(size_t inCount)
+    {
+        // keep the load factor at or below one half
+        size_t capacity = 16;
+        while (capacity < inCount * 2)
+        {
+            capacity *= 2;
+        }
+
+        if (capacity <= Slots.size())
+        {
+            return;
+        }
+
+        std::vector< Slot > slots(capacity, Slot{ VertexIndexKey(), kEmpty });
+        slots.swap(Slots);
+
+        const size_t mask = Slots.size() - 1;
+
+        for (const Slot &slot : slots)
+        {
+            if (slot.Value == kEmpty)
+            {
+                continue;
+            }
+
+            size_t index = Hash(slot.Key) & mask;
+            while (Slots[index].Value != kEmpty)
+            {
+                index = (index + 1) & mask;
+            }
+
+            Slots[index] = slot;
+        }
+    }
+
+    void VertexIndexMap::Clear()
+    {
+        std::fill(Slots.begin(), Slots.end(), Slot{ VertexIndexKey(), kEmpty });
+        Size = 0;
+    }
+
+    U32 VertexIndexMap::Insert(const VertexIndexKey &inKey, U32 inValue)
+    {
+        if ((Size + 1) * 2 > Slots.size())
+        {
+            Reserve(std::max<size_t>(Size + 1, Slots.size()));
+        }
+
+        const size_t mask = Slots.size() - 1;
+        size_t index = Hash(inKey) & mask;
+
+        for (;;)
+        {
+            Slot &slot = Slots[index];
+
+            if (slot.Value == kEmpty)
+            {
+                slot.Key = inKey;
+                slot.Value = inValue;
+                ++Size;
+                return inValue;
+            }
+
+            if (slot.Key == inKey)
+            {
+                return slot.Value;
+            }
+
+            index = (index + 1) & mask;
+        }
+    }
+
+    U32 VertexIndexMap::Hash(const VertexIndexKey &inKey)
+    {
+        U32 hash = static_cast<U32>(inKey.Position) * 0x9E3779B1u;
+        hash ^= static_cast<U32>(inKey.TexCoord) * 0x85EBCA77u;
+        hash ^= static_cast<U32>(inKey.Normal) * 0xC2B2AE3Du;
+
+        // murmur3 finalizer, the table uses the low bits and the shards the high ones
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6Bu;
+        hash ^= hash >> 13;
+        hash *= 0xC2B2AE35u;
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    static U32 DeduplicateVertexKeysSerial(const std::vector< VertexIndexKey > &inKeys, std::vector< U32 > &outIndices, std::vector< U32 > &outFirstKeys, size_t inExpectedVertices)
+    {
+        VertexIndexMap map;
+        map.Reserve(inExpectedVertices);
+
+        outFirstKeys.reserve(inExpectedVertices);
+
+        for (size_t i = 0; i < inKeys.size(); ++i)
+        {
+            const U32 next = static_cast<U32>(outFirstKeys.size());
+            const U32 vertex = map.Insert(inKeys[i], next);
+
+            if (vertex == next)
+            {
+                outFirstKeys.push_back(static_cast<U32>(i));
+            }
+
+            outIndices[i] = vertex;
+        }
+
+        return static_cast<U32>(outFirstKeys.size());
+    }
+
+    U32 DeduplicateVertexKeys(const std::vector< VertexIndexKey > &inKeys, std::vector< U32 > &outIndices, std::vector< U32 > &outFirstKeys,
+                              size_t inExpectedVertices, bool inParallel)
+    {
+        Profile profile("DeduplicateVertexKeys", Profile::CPU);
+
+        const size_t count = inKeys.size();
+
+        outIndices.resize(count);
+        outFirstKeys.clear();
+
+        const size_t threads = inParallel ? static_cast<size_t>(g_Jobs.ThreadCount()) + 1 : 1;
+
+        if (threads == 1 || count < (1 << 16))
+        {
+            return DeduplicateVertexKeysSerial(inKeys, outIndices, outFirstKeys, inExpectedVertices);
+        }
+
+        // keys are split into shards by the high hash bits, equal keys always land in the same shard
+        const U32 shardBits = 6;
+        const size_t shardCount = size_t(1) << shardBits;
+        const size_t blockCount = threads * 4;
+        const size_t blockSize = (count + blockCount - 1) / blockCount;
+
+        std::vector< U8 > shards(count);
+        std::vector< size_t > offsets(blockCount * shardCount, 0);
+
+        ParallelFor(blockCount, 1, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t block = inBegin; block < inEnd; ++block)
+            {
+                size_t *blockCounts = offsets.data() + block * shardCount;
+                const size_t end = std::min(count, (block + 1) * blockSize);
+
+                for (size_t i = block * blockSize; i < end; ++i)
+                {
+                    const U8 shard = static_cast<U8>(VertexIndexMap::Hash(inKeys[i]) >> (32 - shardBits));
+                    shards[i] = shard;
+                    ++blockCounts[shard];
+                }
+            }
+        });
+
+        // shard major prefix sum so every shard list stays in key order
+        std::vector< size_t > shardBegins(shardCount + 1, 0);
+        size_t total = 0;
+
+        for (size_t shard = 0; shard < shardCount; ++shard)
+        {
+            shardBegins[shard] = total;
+
+            for (size_t block = 0; block < blockCount; ++block)
+            {
+                const size_t shardKeys = offsets[block * shardCount + shard];
+                offsets[block * shardCount + shard] = total;
+                total += shardKeys;
+            }
+        }
+
+        shardBegins[shardCount] = total;
+
+        std::vector< U32 > order(count);
+
+        ParallelFor(blockCount, 1, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t block = inBegin; block < inEnd; ++block)
+            {
+                size_t *blockOffsets = offsets.data() + block * shardCount;
+                const size_t end = std::min(count, (block + 1) * blockSize);
+
+                for (size_t i = block * blockSize; i < end; ++i)
+                {
+                    order[blockOffsets[shards[i]]++] = static_cast<U32>(i);
+                }
+            }
+        });
+
+        // first key of every key, found per shard without any sharing between threads
+        std::vector< U32 > &firstKeys = outIndices;
+
+        ParallelFor(shardCount, 1, [&](size_t inBegin, size_t inEnd)
+        {
+            VertexIndexMap map;
+
+            for (size_t shard = inBegin; shard < inEnd; ++shard)
+            {
+                map.Clear();
+                map.Reserve(inExpectedVertices / shardCount + inExpectedVertices / (shardCount * 4));
+
+                for (size_t i = shardBegins[shard]; i < shardBegins[shard + 1]; ++i)
+                {
+                    const U32 key = order[i];
+                    firstKeys[key] = map.Insert(inKeys[key], key);
+                }
+            }
+        });
+
+        // vertices are numbered in order of first appearance, the same as the serial path
+        std::vector< U32 > blockVertices(blockCount + 1, 0);
+
+        ParallelFor(blockCount, 1, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t block = inBegin; block < inEnd; ++block)
+            {
+                const size_t end = std::min(count, (block + 1) * blockSize);
+                U32 vertices = 0;
+
+                for (size_t i = block * blockSize; i < end; ++i)
+                {
+                    vertices += firstKeys[i] == i ? 1 : 0;
+                }
+
+                blockVertices[block + 1] = vertices;
+            }
+        });
+
+        for (size_t block = 0; block < blockCount; ++block)
+        {
+            blockVertices[block + 1] += blockVertices[block];
+        }
+
+        const U32 vertexCount = blockVertices[blockCount];
+        outFirstKeys.resize(vertexCount);
+
+        // order is free again, it keeps the vertex of every first key
+        std::vector< U32 > &keyVertices = order;
+
+        ParallelFor(blockCount, 1, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t block = inBegin; block < inEnd; ++block)
+            {
+                const size_t end = std::min(count, (block + 1) * blockSize);
+                U32 vertex = blockVertices[block];
+
+                for (size_t i = block * blockSize; i < end; ++i)
+                {
+                    if (firstKeys[i] == i)
+                    {
+                        keyVertices[i] = vertex;
+                        outFirstKeys[vertex] = static_cast<U32>(i);
+                        ++vertex;
+                    }
+                }
+            }
+        });
+
+        ParallelFor(count, 1 << 14, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t i = inBegin; i < inEnd; ++i)
+            {
+                outIndices[i] = keyVertices[firstKeys[i]];
+            }
+        });
+
+        return vertexCount;
+    }
+
+    /* Tangent space */
+
+    // Unit vector perpendicular to inNormal, for vertices whose UVs give no usable direction.
+    static glm::vec3 AnyTangent(const glm::vec3 &inNormal)
+    {
+        const glm::vec3 axis = std::abs(inNormal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::normalize(axis - inNormal * glm::dot(inNormal, axis));
+    }
+
+    static glm::vec3 SafeNormalize(const glm::vec3 &inVector, const glm::vec3 &inFallback)
+    {
+        const F32 length = glm::length(inVector);
+        return length > 1e-20f && std::isfinite(length) ? inVector / length : inFallback;
+    }
+
+    bool GenerateTangents(Geometry &outGeometry)
+    {
+        Profile profile("GenerateTangents", Profile::CPU);
+
+        auto &vertices = outGeometry.Vertices_1P1N1UV1T1BT;
+
+        if (vertices.empty() && !outGeometry.Vertices_1P1N1UV.empty())
+        {
+            vertices.resize(outGeometry.Vertices_1P1N1UV.size());
+
+            for (size_t i = 0; i < vertices.size(); ++i)
+            {
+                vertices[i] = {};
+                vertices[i].Position = outGeometry.Vertices_1P1N1UV[i].Position;
+                vertices[i].Normal = outGeometry.Vertices_1P1N1UV[i].Normal;
+                vertices[i].TexCoord = outGeometry.Vertices_1P1N1UV[i].TexCoord;
+            }
+
+            outGeometry.Vertices_1P1N1UV = std::vector< Vertex1P1N1UV >();
+        }
+
+        if (vertices.empty())
+        {
+            return false;
+        }
+
+        // unindexed geometry is a plain triangle list
+        std::vector< U32 > sequence;
+        const std::vector< U32 > *indices = &outGeometry.Indices;
+
+        if (indices->empty())
+        {
+            sequence.resize(vertices.size() - vertices.size() % 3);
+            for (size_t i = 0; i < sequence.size(); ++i)
+            {
+                sequence[i] = static_cast<U32>(i);
+            }
+
+            indices = &sequence;
+        }
+
+        const size_t cornerCount = indices->size() - indices->size() % 3;
+        const size_t triangleCount = cornerCount / 3;
+        const U32 *index = indices->data();
+
+        for (size_t i = 0; i < cornerCount; ++i)
+        {
+            if (index[i] >= vertices.size())
+            {
+                std::cerr << "GenerateTangents - index " << index[i] << " out of range" << std::endl;
+                return false;
+            }
+        }
+
+        // face frames left unnormalized by the UV area, only the direction matters. The corner angles weight
+        // every face at a vertex, the same as MikkTSpace, so a fan of thin triangles does not dominate.
+        struct FaceFrame
+        {
+            glm::vec3 Tangent;
+            glm::vec3 Bitangent;
+            F32 Angles[3];
+        };
+
+        std::vector< FaceFrame > faces(triangleCount);
+
+        ParallelFor(triangleCount, 1 << 12, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t t = inBegin; t < inEnd; ++t)
+            {
+                const Vertex1P1N1UV1T1BT &v0 = vertices[index[t * 3 + 0]];
+                const Vertex1P1N1UV1T1BT &v1 = vertices[index[t * 3 + 1]];
+                const Vertex1P1N1UV1T1BT &v2 = vertices[index[t * 3 + 2]];
+
+                const glm::vec3 edge1 = v1.Position - v0.Position;
+                const glm::vec3 edge2 = v2.Position - v0.Position;
+                const glm::vec2 deltaUV1 = v1.TexCoord - v0.TexCoord;
+                const glm::vec2 deltaUV2 = v2.TexCoord - v0.TexCoord;
+
+                const F32 determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+                const F32 orientation = determinant < 0.0f ? -1.0f : 1.0f;
+
+                FaceFrame &face = faces[t];
+
+                // degenerate UVs contribute nothing instead of dividing by zero
+                if (std::abs(determinant) > 1e-12f)
+                {
+                    face.Tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * orientation;
+                    face.Bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * orientation;
+                }
+                else
+                {
+                    face.Tangent = glm::vec3(0.0f);
+                    face.Bitangent = glm::vec3(0.0f);
+                }
+
+                const glm::vec3 *positions[3] = { &v0.Position, &v1.Position, &v2.Position };
+
+                for (I32 c = 0; c < 3; ++c)
+                {
+                    const glm::vec3 a = SafeNormalize(*positions[(c + 1) % 3] - *positions[c], glm::vec3(0.0f));
+                    const glm::vec3 b = SafeNormalize(*positions[(c + 2) % 3] - *positions[c], glm::vec3(0.0f));
+                    face.Angles[c] = std::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f));
+                }
+            }
+        });
+
+        // corners of every vertex, built serially so the sums below add up in a fixed order
+        std::vector< U32 > cornerBegins(vertices.size() + 1, 0);
+        std::vector< U32 > vertexCorners(cornerCount);
+
+        for (size_t i = 0; i < cornerCount; ++i)
+        {
+            ++cornerBegins[index[i] + 1];
+        }
+
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            cornerBegins[v + 1] += cornerBegins[v];
+        }
+
+        {
+            std::vector< U32 > cursors(cornerBegins.begin(), cornerBegins.end() - 1);
+
+            for (size_t i = 0; i < cornerCount; ++i)
+            {
+                vertexCorners[cursors[index[i]]++] = static_cast<U32>(i);
+            }
+        }
+
+        ParallelFor(vertices.size(), 1 << 12, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t v = inBegin; v < inEnd; ++v)
+            {
+                Vertex1P1N1UV1T1BT &vertex = vertices[v];
+                const glm::vec3 normal = SafeNormalize(vertex.Normal, glm::vec3(0.0f, 0.0f, 1.0f));
+
+                // mirrored UV islands meet at seams, faces of each handedness are summed apart
+                // and the heavier side decides the frame
+                glm::vec3 tangents[2] = { glm::vec3(0.0f), glm::vec3(0.0f) };
+                F32 weights[2] = { 0.0f, 0.0f };
+
+                for (U32 i = cornerBegins[v]; i < cornerBegins[v + 1]; ++i)
+                {
+                    const U32 corner = vertexCorners[i];
+                    const FaceFrame &face = faces[corner / 3];
+
+                    // project onto the tangent plane of this vertex before summing
+                    const glm::vec3 tangent = face.Tangent - normal * glm::dot(normal, face.Tangent);
+                    const glm::vec3 bitangent = face.Bitangent - normal * glm::dot(normal, face.Bitangent);
+                    const F32 tangentLength = glm::length(tangent);
+
+                    if (!(tangentLength > 1e-20f) || !std::isfinite(tangentLength))
+                    {
+                        continue;
+                    }
+
+                    const F32 weight = face.Angles[corner % 3];
+                    const I32 side = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? 1 : 0;
+
+                    tangents[side] += tangent * (weight / tangentLength);
+                    weights[side] += weight;
+                }
+
+                const I32 side = weights[1] > weights[0] ? 1 : 0;
+                const F32 handedness = side == 1 ? -1.0f : 1.0f;
+
+                // Gram-Schmidt against the normal, the bitangent follows from the handedness
+                glm::vec3 tangent = tangents[side] - normal * glm::dot(normal, tangents[side]);
+                tangent = SafeNormalize(tangent, AnyTangent(normal));
+
+                vertex.Tangent = tangent;
+                vertex.Bitangent = glm::cross(normal, tangent) * handedness;
+            }
+        });
+
+        return true;
+    }
+
+    /* Vertex quantization */
+
+    U16 FloatToHalf(F32 inValue)
+    {
+        U32 bits;
+        std::memcpy(&bits, &inValue, sizeof(bits));
+
+        const U32 sign = (bits >> 16) & 0x8000;
+        const U32 magnitude = bits & 0x7FFFFFFF;
+
+        // NaN stays NaN, 65520 and up round to infinity
+        if (magnitude > 0x7F800000)
+        {
+            return static_cast<U16>(sign | 0x7E00);
+        }
+
+        if (magnitude >= 0x477FF000)
+        {
+            return static_cast<U16>(sign | 0x7C00);
+        }
+
+        // below 2^-14 the result is subnormal, the mantissa is shifted into place and rounded to nearest even
+        if (magnitude < 0x38800000)
+        {
+            const U32 shift = 126 - (magnitude >> 23);
+
+            if (shift > 24)
+            {
+                return static_cast<U16>(sign);
+            }
+
+            const U32 mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+            const U32 remainder = mantissa & ((1u << shift) - 1);
+            const U32 halfway = 1u << (shift - 1);
+            U32 result = mantissa >> shift;
+
+            if (remainder > halfway || (remainder == halfway && (result & 1)))
+            {
+                ++result;
+            }
+
+            return static_cast<U16>(sign | result);
+        }
+
+        // rebias the exponent from 127 to 15, a mantissa carry moves into the exponent as it should
+        U32 result = (magnitude >> 13) - (112 << 10);
+        const U32 remainder = magnitude & 0x1FFF;
+
+        if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+        {
+            ++result;
+        }
+
+        return static_cast<U16>(sign | result);
+    }
+
+    F32 HalfToFloat(U16 inValue)
+    {
+        const U32 sign = static_cast<U32>(inValue & 0x8000) << 16;
+        const U32 exponent = (inValue >> 10) & 0x1F;
+        const U32 mantissa = inValue & 0x3FF;
+
+        if (exponent == 0)
+        {
+            const F32 value = std::ldexp(static_cast<F32>(mantissa), -24);
+            return sign ? -value : value;
+        }
+
+        const U32 bits = exponent == 0x1F ? (sign | 0x7F800000 | (mantissa << 13)) : (sign | ((exponent + 112) << 23) | (mantissa << 13));
+
+        F32 value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    static F32 SignNotZero(F32 inValue)
+    {
+        return inValue < 0.0f ? -1.0f : 1.0f;
+    }
+
+    glm::vec2 EncodeOctahedral(const glm::vec3 &inNormal)
+    {
+        const F32 sum = std::abs(inNormal.x) + std::abs(inNormal.y) + std::abs(inNormal.z);
+
+        if (!(sum > 0.0f))
+        {
+            return glm::vec2(0.0f);
+        }
+
+        const glm::vec2 projected = glm::vec2(inNormal.x, inNormal.y) / sum;
+
+        // the lower hemisphere folds over the diagonals
+        if (inNormal.z < 0.0f)
+        {
+            return glm::vec2((1.0f - std::abs(projected.y)) * SignNotZero(projected.x),
+                             (1.0f - std::abs(projected.x)) * SignNotZero(projected.y));
+        }
+
+        return projected;
+    }
+
+    glm::vec3 DecodeOctahedral(const glm::vec2 &inEncoded)
+    {
+        glm::vec3 normal(inEncoded.x, inEncoded.y, 1.0f - std::abs(inEncoded.x) - std::abs(inEncoded.y));
+
+        if (normal.z < 0.0f)
+        {
+            normal.x = (1.0f - std::abs(inEncoded.y)) * SignNotZero(inEncoded.x);
+            normal.y = (1.0f - std::abs(inEncoded.x)) * SignNotZero(inEncoded.y);
+        }
+
+        return glm::normalize(normal);
+    }
+
+    static I32 FloatToSnorm(F32 inValue, U32 inBits)
+    {
+        const F32 maximum = static_cast<F32>((1 << (inBits - 1)) - 1);
+        return static_cast<I32>(std::round(std::min(std::max(inValue, -1.0f), 1.0f) * maximum));
+    }
+
+    static F32 SnormToFloat(U32 inWord, U32 inShift, U32 inBits)
+    {
+        // sign extend the field through the top of the word
+        const I32 value = static_cast<I32>(inWord << (32 - inShift - inBits)) >> (32 - inBits);
+        return std::max(static_cast<F32>(value) / static_cast<F32>((1 << (inBits - 1)) - 1), -1.0f);
+    }
+
+    PackedInt2101010 PackSnorm2101010(const glm::vec4 &inValue)
+    {
+        PackedInt2101010 packed;
+        packed.Bits = (static_cast<U32>(FloatToSnorm(inValue.x, 10)) & 0x3FF) |
+                      (static_cast<U32>(FloatToSnorm(inValue.y, 10)) & 0x3FF) << 10 |
+                      (static_cast<U32>(FloatToSnorm(inValue.z, 10)) & 0x3FF) << 20 |
+                      (static_cast<U32>(FloatToSnorm(inValue.w, 2)) & 0x3) << 30;
+        return packed;
+    }
+
+    glm::vec4 UnpackSnorm2101010(PackedInt2101010 inValue)
+    {
+        return glm::vec4(SnormToFloat(inValue.Bits, 0, 10), SnormToFloat(inValue.Bits, 10, 10),
+                         SnormToFloat(inValue.Bits, 20, 10), SnormToFloat(inValue.Bits, 30, 2));
+    }
+
+    bool QuantizeGeometry(Geometry &outGeometry, PositionEncoding inEncoding)
+    {
+        Profile profile("QuantizeGeometry", Profile::CPU);
+
+        const void *vertices = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        const VertexFormat format = GeometryVertexFormat(outGeometry, vertices, stride, count);
+
+        if (count == 0)
+        {
+            return false;
+        }
+
+        const U8 *bytes = static_cast<const U8*>(vertices);
+
+        // bounds of this stream itself, every vertex format starts with the position
+        glm::vec3 minimum(std::numeric_limits<F32>::max());
+        glm::vec3 maximum(-std::numeric_limits<F32>::max());
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            glm::vec3 position;
+            std::memcpy(&position, bytes + stride * i, sizeof(position));
+
+            minimum = glm::min(minimum, position);
+            maximum = glm::max(maximum, position);
+        }
+
+        VertexQuantization quantization;
+        quantization.Encoding = inEncoding;
+
+        if (inEncoding == PositionEncoding::Unorm16)
+        {
+            quantization.Offset = minimum;
+
+            for (I32 c = 0; c < 3; ++c)
+            {
+                quantization.Scale[c] = maximum[c] > minimum[c] ? maximum[c] - minimum[c] : 1.0f;
+            }
+        }
+        else
+        {
+            quantization.Offset = (minimum + maximum) * 0.5f;
+        }
+
+        std::vector< VertexQuantized > quantized(count);
+
+        ParallelFor(count, 1 << 14, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t i = inBegin; i < inEnd; ++i)
+            {
+                const U8 *source = bytes + stride * i;
+                glm::vec3 position;
+                glm::vec3 normal(0.0f, 0.0f, 1.0f);
+                glm::vec2 texCoord(0.0f);
+                glm::vec3 tangent(0.0f);
+                F32 handedness = 1.0f;
+
+                if (format == VertexFormat::P1N1UV1T1BT)
+                {
+                    Vertex1P1N1UV1T1BT vertex;
+                    std::memcpy(&vertex, source, sizeof(vertex));
+
+                    position = vertex.Position;
+                    normal = SafeNormalize(vertex.Normal, normal);
+                    texCoord = vertex.TexCoord;
+                    tangent = vertex.Tangent;
+                    handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+                }
+                else if (format == VertexFormat::P1N1UV)
+                {
+                    Vertex1P1N1UV vertex;
+                    std::memcpy(&vertex, source, sizeof(vertex));
+
+                    position = vertex.Position;
+                    normal = SafeNormalize(vertex.Normal, normal);
+                    texCoord = vertex.TexCoord;
+                }
+                else
+                {
+                    Vertex1P1UV vertex;
+                    std::memcpy(&vertex, source, sizeof(vertex));
+
+                    position = vertex.Position;
+                    texCoord = vertex.TexCoord;
+                }
+
+                tangent = SafeNormalize(tangent, AnyTangent(normal));
+
+                VertexQuantized &target = quantized[i];
+                const glm::vec3 relative = (position - quantization.Offset) / quantization.Scale;
+
+                for (I32 c = 0; c < 3; ++c)
+                {
+                    target.Position[c] = inEncoding == PositionEncoding::Unorm16 ?
+                        static_cast<U16>(std::round(std::min(std::max(relative[c], 0.0f), 1.0f) * 65535.0f)) :
+                        FloatToHalf(relative[c]);
+                }
+
+                target.Position[3] = 0;
+
+                const glm::vec2 octahedral = EncodeOctahedral(normal);
+                target.Normal[0] = static_cast<I16>(FloatToSnorm(octahedral.x, 16));
+                target.Normal[1] = static_cast<I16>(FloatToSnorm(octahedral.y, 16));
+
+                target.TexCoord[0] = FloatToHalf(texCoord.x);
+                target.TexCoord[1] = FloatToHalf(texCoord.y);
+
+                target.Tangent = PackSnorm2101010(glm::vec4(tangent, handedness));
+            }
+        });
+
+        outGeometry.Vertices_Quantized.swap(quantized);
+        outGeometry.Quantization = quantization;
+        return true;
+    }
+
+    glm::vec3 DequantizePosition(const VertexQuantized &inVertex, const VertexQuantization &inQuantization)
+    {
+        glm::vec3 attribute;
+
+        for (I32 c = 0; c < 3; ++c)
+        {
+            attribute[c] = inQuantization.Encoding == PositionEncoding::Unorm16 ?
+                static_cast<F32>(inVertex.Position[c]) / 65535.0f :
+                HalfToFloat(inVertex.Position[c]);
+        }
+
+        return inQuantization.Offset + inQuantization.Scale * attribute;
+    }
+
+    /* Mesh optimization */
+
+    VertexCacheStats AnalyzeVertexCache(const U32 *inIndices, size_t inIndexCount, size_t inVertexCount, U32 inCacheSize)
+    {
+        VertexCacheStats stats;
+
+        // stamp = miss count when the vertex entered the FIFO, 0 = never
+        std::vector< U64 > stamps(inVertexCount, 0);
+        U64 misses = 0;
+
+        const size_t indexCount = inIndexCount - inIndexCount % 3;
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            const U32 vertex = inIndices[i];
+
+            if (stamps[vertex] == 0)
+            {
+                ++stats.Vertices;
+            }
+
+            if (stamps[vertex] == 0 || misses - stamps[vertex] >= inCacheSize)
+            {
+                stamps[vertex] = ++misses;
+            }
+        }
+
+        stats.Triangles = static_cast<U32>(indexCount / 3);
+        stats.Transformed = misses;
+        stats.ACMR = stats.Triangles ? static_cast<F32>(misses) / stats.Triangles : 0.0f;
+        stats.ATVR = stats.Vertices ? static_cast<F32>(misses) / stats.Vertices : 0.0f;
+        return stats;
+    }
+
+    // Tipsify from Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+    // Indices are local, [0, inVertexCount) and all referenced. outClusters gets the first triangle of every
+    // run that restarted from a dead end, those are the cut points the overdraw pass may reorder.
+    static void TipsifyIndices(const U32 *inIndices, size_t inIndexCount, U32 inVertexCount, U32 inCacheSize,
+                               U32 *outIndices, std::vector< U32 > &outClusters)
+    {
+        const size_t triangleCount = inIndexCount / 3;
+
+        std::vector< U32 > adjacencyBegins(inVertexCount + 1, 0);
+        std::vector< U32 > adjacency(inIndexCount);
+
+        for (size_t i = 0; i < inIndexCount; ++i)
+        {
+            ++adjacencyBegins[inIndices[i] + 1];
+        }
+
+        for (U32 v = 0; v < inVertexCount; ++v)
+        {
+            adjacencyBegins[v + 1] += adjacencyBegins[v];
+        }
+
+        std::vector< U32 > live(inVertexCount);
+
+        for (U32 v = 0; v < inVertexCount; ++v)
+        {
+            live[v] = adjacencyBegins[v + 1] - adjacencyBegins[v];
+        }
+
+        {
+            std::vector< U32 > cursors(adjacencyBegins.begin(), adjacencyBegins.end() - 1);
+
+            for (size_t i = 0; i < inIndexCount; ++i)
+            {
+                adjacency[cursors[inIndices[i]]++] = static_cast<U32>(i / 3);
+            }
+        }
+
+        std::vector< U32 > cacheTimes(inVertexCount, 0);
+        std::vector< U8 > isEmitted(triangleCount, 0);
+        std::vector< U32 > deadEnds;
+        std::vector< U32 > candidates;
+
+        deadEnds.reserve(inIndexCount);
+        candidates.reserve(64);
+
+        U32 time = inCacheSize + 1;
+        U32 scan = 0;
+        size_t written = 0;
+        I64 fanning = inIndexCount ? inIndices[0] : -1;
+
+        outClusters.clear();
+        outClusters.push_back(0);
+
+        while (fanning >= 0)
+        {
+            candidates.clear();
+
+            for (U32 a = adjacencyBegins[fanning]; a < adjacencyBegins[fanning + 1]; ++a)
+            {
+                const U32 triangle = adjacency[a];
+
+                if (isEmitted[triangle])
+                {
+                    continue;
+                }
+
+                for (U32 c = 0; c < 3; ++c)
+                {
+                    const U32 vertex = inIndices[triangle * 3 + c];
+
+                    outIndices[written++] = vertex;
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    --live[vertex];
+
+                    if (time - cacheTimes[vertex] > inCacheSize)
+                    {
+                        cacheTimes[vertex] = time++;
+                    }
+                }
+
+                isEmitted[triangle] = 1;
+            }
+
+            // the candidate that stays in the cache the longest while still having triangles left
+            I64 next = -1;
+            I64 best = -1;
+
+            for (const U32 vertex : candidates)
+            {
+                if (live[vertex] == 0)
+                {
+                    continue;
+                }
+
+                I64 priority = 0;
+
+                if (time - cacheTimes[vertex] + 2 * live[vertex] <= inCacheSize)
+                {
+                    priority = time - cacheTimes[vertex];
+                }
+
+                if (priority > best)
+                {
+                    best = priority;
+                    next = vertex;
+                }
+            }
+
+            if (next < 0)
+            {
+                while (!deadEnds.empty() && next < 0)
+                {
+                    const U32 vertex = deadEnds.back();
+                    deadEnds.pop_back();
+
+                    if (live[vertex] > 0)
+                    {
+                        next = vertex;
+                    }
+                }
+
+                while (next < 0 && scan < inVertexCount)
+                {
+                    if (live[scan] > 0)
+                    {
+                        next = scan;
+                    }
+
+                    ++scan;
+                }
+
+                if (next >= 0)
+                {
+                    outClusters.push_back(static_cast<U32>(written / 3));
+                }
+            }
+
+            fanning = next;
+        }
+    }
+
+    // Sorts the clusters of one index range so triangles facing away from the range centroid come first,
+    // those tend to occlude the rest (Sander et al. linear speed overdraw ordering).
+    static void SortClustersForOverdraw(U32 *ioIndices, size_t inIndexCount, const std::vector< U32 > &inClusters,
+                                        const U8 *inPositions, size_t inStride)
+    {
+        if (inClusters.size() < 2)
+        {
+            return;
+        }
+
+        auto position = [&](U32 inVertex)
+        {
+            glm::vec3 result;
+            std::memcpy(&result, inPositions + inStride * inVertex, sizeof(result));
+            return result;
+        };
+
+        const size_t triangleCount = inIndexCount / 3;
+
+        struct Cluster
+        {
+            U32 Begin;
+            U32 End;
+            glm::vec3 Centroid;
+            glm::vec3 Normal;
+            F32 Area;
+            F32 Sort;
+        };
+
+        std::vector< Cluster > clusters(inClusters.size());
+        glm::vec3 centroid(0.0f);
+        F32 area = 0.0f;
+
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            Cluster &cluster = clusters[c];
+            cluster.Begin = inClusters[c];
+            cluster.End = c + 1 < inClusters.size() ? inClusters[c + 1] : static_cast<U32>(triangleCount);
+            cluster.Centroid = glm::vec3(0.0f);
+            cluster.Normal = glm::vec3(0.0f);
+            cluster.Area = 0.0f;
+
+            for (U32 t = cluster.Begin; t < cluster.End; ++t)
+            {
+                const glm::vec3 p0 = position(ioIndices[t * 3 + 0]);
+                const glm::vec3 p1 = position(ioIndices[t * 3 + 1]);
+                const glm::vec3 p2 = position(ioIndices[t * 3 + 2]);
+
+                const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const F32 triangleArea = glm::length(normal);
+
+                cluster.Centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                cluster.Normal += normal;
+                cluster.Area += triangleArea;
+            }
+
+            centroid += cluster.Centroid;
+            area += cluster.Area;
+            cluster.Centroid = cluster.Area > 0.0f ? cluster.Centroid / cluster.Area : position(ioIndices[cluster.Begin * 3]);
+        }
+
+        centroid = area > 0.0f ? centroid / area : glm::vec3(0.0f);
+
+        for (Cluster &cluster : clusters)
+        {
+            const F32 length = glm::length(cluster.Normal);
+            cluster.Sort = length > 0.0f ? glm::dot(cluster.Centroid - centroid, cluster.Normal / length) : 0.0f;
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &inLhs, const Cluster &inRhs)
+        {
+            return inLhs.Sort > inRhs.Sort;
+        });
+
+        std::vector< U32 > sorted;
+        sorted.reserve(triangleCount * 3);
+
+        for (const Cluster &cluster : clusters)
+        {
+            sorted.insert(sorted.end(), ioIndices + cluster.Begin * 3, ioIndices + cluster.End * 3);
+        }
+
+        std::copy(sorted.begin(), sorted.end(), ioIndices);
+    }
+
+    template< typename Vertex >
+    static void RemapVertices(std::vector< Vertex > &ioVertices, const std::vector< U32 > &inRemap)
+    {
+        if (ioVertices.size() != inRemap.size())
+        {
+            return;
+        }
+
+        std::vector< Vertex > remapped(ioVertices.size());
+
+        for (size_t i = 0; i < ioVertices.size(); ++i)
+        {
+            remapped[inRemap[i]] = ioVertices[i];
+        }
+
+        ioVertices.swap(remapped);
+    }
+
+    bool OptimizeGeometry(Geometry &outGeometry, const MeshOptimizeOptions &inOptions, MeshOptimizeReport *outReport)
+    {
+        Profile profile("OptimizeGeometry", Profile::CPU);
+
+        const auto begin = std::chrono::steady_clock::now();
+
+        const void *vertices = nullptr;
+        size_t stride = 0;
+        size_t vertexCount = 0;
+        GeometryVertexFormat(outGeometry, vertices, stride, vertexCount);
+
+        std::vector< U32 > &indices = outGeometry.Indices;
+        const size_t indexCount = indices.size() - indices.size() % 3;
+
+        if (vertexCount == 0 || indexCount == 0 || inOptions.CacheSize < 3)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            if (indices[i] >= vertexCount)
+            {
+                std::cerr << "OptimizeGeometry - index " << indices[i] << " out of range" << std::endl;
+                return false;
+            }
+        }
+
+        MeshOptimizeReport report;
+        report.Before = AnalyzeVertexCache(indices.data(), indexCount, vertexCount, inOptions.CacheSize);
+
+        // their triangles are about to move, BuildMeshlets has to run again
+        outGeometry.Meshlets.clear();
+
+        // every submesh and LOD range on its own so the ranges stay valid, geometry without submeshes is one range
+        std::vector< std::pair< size_t, size_t > > ranges;
+
+        for (const SubMesh &subMesh : outGeometry.SubMeshes)
+        {
+            ranges.emplace_back(subMesh.FirstIndex, subMesh.FirstIndex + subMesh.IndexCount - subMesh.IndexCount % 3);
+        }
+
+        for (const GeometryLOD &lod : outGeometry.LODs)
+        {
+            for (const SubMesh &subMesh : lod.SubMeshes)
+            {
+                ranges.emplace_back(subMesh.FirstIndex, subMesh.FirstIndex + subMesh.IndexCount - subMesh.IndexCount % 3);
+            }
+        }
+
+        if (ranges.empty())
+        {
+            ranges.emplace_back(0, indexCount);
+        }
+
+        std::atomic< U32 > clusterCount(0);
+        const U8 *positions = static_cast<const U8*>(vertices);
+
+        ParallelFor(ranges.size(), 1, [&](size_t inBegin, size_t inEnd)
+        {
+            std::vector< U32 > localOf(vertexCount, VertexIndexMap::kEmpty);
+            std::vector< U32 > globalOf;
+            std::vector< U32 > localIndices;
+            std::vector< U32 > optimized;
+            std::vector< U32 > clusters;
+
+            for (size_t r = inBegin; r < inEnd; ++r)
+            {
+                const size_t first = ranges[r].first;
+                const size_t count = ranges[r].second - first;
+
+                globalOf.clear();
+                localIndices.resize(count);
+                optimized.resize(count);
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const U32 vertex = indices[first + i];
+
+                    if (localOf[vertex] == VertexIndexMap::kEmpty)
+                    {
+                        localOf[vertex] = static_cast<U32>(globalOf.size());
+                        globalOf.push_back(vertex);
+                    }
+
+                    localIndices[i] = localOf[vertex];
+                }
+
+                TipsifyIndices(localIndices.data(), count, static_cast<U32>(globalOf.size()), inOptions.CacheSize, optimized.data(), clusters);
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    indices[first + i] = globalOf[optimized[i]];
+                }
+
+                if (inOptions.OptimizeOverdraw)
+                {
+                    SortClustersForOverdraw(indices.data() + first, count, clusters, positions, stride);
+                }
+
+                clusterCount += static_cast<U32>(clusters.size());
+
+                for (const U32 vertex : globalOf)
+                {
+                    localOf[vertex] = VertexIndexMap::kEmpty;
+                }
+            }
+        });
+
+        if (inOptions.OptimizeVertexFetch)
+        {
+            // first use order, unreferenced vertices keep their order at the end
+            std::vector< U32 > remap(vertexCount, VertexIndexMap::kEmpty);
+            U32 next = 0;
+
+            for (U32 &index : indices)
+            {
+                if (remap[index] == VertexIndexMap::kEmpty)
+                {
+                    remap[index] = next++;
+                }
+
+                index = remap[index];
+            }
+
+            for (U32 &target : remap)
+            {
+                if (target == VertexIndexMap::kEmpty)
+                {
+                    target = next++;
+                }
+            }
+
+            RemapVertices(outGeometry.Vertices_1P1N1UV1T1BT, remap);
+            RemapVertices(outGeometry.Vertices_1P1N1UV, remap);
+            RemapVertices(outGeometry.Vertices_1P1UV, remap);
+            RemapVertices(outGeometry.Vertices_Quantized, remap);
+        }
+
+        report.After = AnalyzeVertexCache(indices.data(), indexCount, vertexCount, inOptions.CacheSize);
+        report.Clusters = clusterCount.load();
+        report.Milliseconds = std::chrono::duration<F64, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        if (outReport)
+        {
+            *outReport = report;
+        }
+
+        return true;
+    }
+
+    void DumpMeshOptimizeReport(const MeshOptimizeReport &inReport)
+    {
+        std::cout << "Mesh optimize - " << inReport.After.Triangles << " triangles, " << inReport.After.Vertices << " vertices, "
+                  << inReport.Clusters << " clusters, " << std::fixed << std::setprecision(3)
+                  << "ACMR " << inReport.Before.ACMR << " -> " << inReport.After.ACMR << ", "
+                  << "ATVR " << inReport.Before.ATVR << " -> " << inReport.After.ATVR << ", "
+                  << std::setprecision(2) << inReport.Milliseconds << " ms\n" << std::defaultfloat;
+    }
+
+    /* Mesh simplification */
+
+    // Symmetric 4x4 error quadric of summed planes, weighted by triangle area.
+    struct Quadric
+    {
+        F64 A00 = 0.0, A01 = 0.0, A02 = 0.0, A11 = 0.0, A12 = 0.0, A22 = 0.0;
+        F64 B0 = 0.0, B1 = 0.0, B2 = 0.0;
+        F64 C = 0.0;
+        F64 Weight = 0.0;
+
+        void AddPlane(const glm::vec3 &inNormal, F64 inDistance, F64 inWeight)
+        {
+            A00 += inWeight * inNormal.x * inNormal.x;
+            A01 += inWeight * inNormal.x * inNormal.y;
+            A02 += inWeight * inNormal.x * inNormal.z;
+            A11 += inWeight * inNormal.y * inNormal.y;
+            A12 += inWeight * inNormal.y * inNormal.z;
+            A22 += inWeight * inNormal.z * inNormal.z;
+            B0 += inWeight * inNormal.x * inDistance;
+            B1 += inWeight * inNormal.y * inDistance;
+            B2 += inWeight * inNormal.z * inDistance;
+            C += inWeight * inDistance * inDistance;
+            Weight += inWeight;
+        }
+
+        void Add(const Quadric &inOther)
+        {
+            A00 += inOther.A00; A01 += inOther.A01; A02 += inOther.A02;
+            A11 += inOther.A11; A12 += inOther.A12; A22 += inOther.A22;
+            B0 += inOther.B0; B1 += inOther.B1; B2 += inOther.B2;
+            C += inOther.C;
+            Weight += inOther.Weight;
+        }
+
+        // mean squared distance of inPoint to the planes
+        F64 Error(const glm::vec3 &inPoint) const
+        {
+            const F64 x = inPoint.x, y = inPoint.y, z = inPoint.z;
+
+            const F64 error = A00 * x * x + A11 * y * y + A22 * z * z +
+                              2.0 * (A01 * x * y + A02 * x * z + A12 * y * z) +
+                              2.0 * (B0 * x + B1 * y + B2 * z) + C;
+
+            return Weight > 0.0 ? std::max(error, 0.0) / Weight : 0.0;
+        }
+    };
+
+    // Position, and normal / texcoord when the format has them, of the richest vertex stream.
+    struct VertexStreamView
+    {
+        const U8 *Data = nullptr;
+        size_t Stride = 0;
+        size_t Count = 0;
+        I32 NormalOffset = -1;
+        I32 TexCoordOffset = -1;
+
+        glm::vec3 Position(U32 inVertex) const
+        {
+            glm::vec3 result;
+            std::memcpy(&result, Data + Stride * inVertex, sizeof(result));
+            return result;
+        }
+
+        glm::vec3 Normal(U32 inVertex) const
+        {
+            glm::vec3 result(0.0f);
+            if (NormalOffset >= 0)
+            {
+                std::memcpy(&result, Data + Stride * inVertex + NormalOffset, sizeof(result));
+            }
+            return result;
+        }
+
+        glm::vec2 TexCoord(U32 inVertex) const
+        {
+            glm::vec2 result(0.0f);
+            if (TexCoordOffset >= 0)
+            {
+                std::memcpy(&result, Data + Stride * inVertex + TexCoordOffset, sizeof(result));
+            }
+            return result;
+        }
+    };
+
+    static VertexStreamView GeometryVertexStream(const Geometry &inGeometry)
+    {
+        VertexStreamView view;
+        const void *data = nullptr;
+
+        switch (GeometryVertexFormat(inGeometry, data, view.Stride, view.Count))
+        {
+        case VertexFormat::P1N1UV1T1BT:
+            view.NormalOffset = static_cast<I32>(offsetof(Vertex1P1N1UV1T1BT, Normal));
+            view.TexCoordOffset = static_cast<I32>(offsetof(Vertex1P1N1UV1T1BT, TexCoord));
+            break;
+        case VertexFormat::P1N1UV:
+            view.NormalOffset = static_cast<I32>(offsetof(Vertex1P1N1UV, Normal));
+            view.TexCoordOffset = static_cast<I32>(offsetof(Vertex1P1N1UV, TexCoord));
+            break;
+        case VertexFormat::P1UV:
+            view.TexCoordOffset = static_cast<I32>(offsetof(Vertex1P1UV, TexCoord));
+            break;
+        case VertexFormat::Quantized:
+            // never returned, simplification works on the float streams only
+            break;
+        }
+
+        view.Data = static_cast<const U8*>(data);
+        return view;
+    }
+
+    // Bit pattern of a position, vertices with equal keys are wedges of one point.
+    struct PositionKey
+    {
+        U32 Bits[3];
+
+        bool operator==(const PositionKey &inOther) const
+        {
+            return Bits[0] == inOther.Bits[0] && Bits[1] == inOther.Bits[1] && Bits[2] == inOther.Bits[2];
+        }
+    };
+
+    static PositionKey MakePositionKey(const glm::vec3 &inPosition)
+    {
+        // +0 folds -0.0f onto 0.0f
+        const glm::vec3 position = inPosition + glm::vec3(0.0f);
+
+        PositionKey key;
+        std::memcpy(key.Bits, &position.x, sizeof(key.Bits));
+        return key;
+    }
+
+    static U32 HashPositionKey(const PositionKey &inKey)
+    {
+        U32 hash = inKey.Bits[0] * 0x9E3779B1u;
+        hash = (hash ^ (hash >> 15) ^ inKey.Bits[1]) * 0x85EBCA77u;
+        hash = (hash ^ (hash >> 13) ^ inKey.Bits[2]) * 0xC2B2AE3Du;
+        return hash ^ (hash >> 16);
+    }
+
+    // outWedgeOf[v] is the first vertex at the position of inKeys[v], linear probing over vertex numbers.
+    static void FindPositionWedges(const std::vector< PositionKey > &inKeys, std::vector< U32 > &outWedgeOf)
+    {
+        size_t capacity = 16;
+        while (capacity < inKeys.size() * 2)
+        {
+            capacity *= 2;
+        }
+
+        const size_t mask = capacity - 1;
+        std::vector< U32 > slots(capacity, VertexIndexMap::kEmpty);
+
+        outWedgeOf.resize(inKeys.size());
+
+        for (U32 v = 0; v < inKeys.size(); ++v)
+        {
+            size_t index = HashPositionKey(inKeys[v]) & mask;
+
+            while (slots[index] != VertexIndexMap::kEmpty && !(inKeys[slots[index]] == inKeys[v]))
+            {
+                index = (index + 1) & mask;
+            }
+
+            if (slots[index] == VertexIndexMap::kEmpty)
+            {
+                slots[index] = v;
+            }
+
+            outWedgeOf[v] = slots[index];
+        }
+    }
+
+    F32 SimplifyIndices(const Geometry &inGeometry, const U32 *inIndices, size_t inIndexCount, size_t inTargetIndexCount,
+                        std::vector< U32 > &outIndices, const SimplifyOptions &inOptions)
+    {
+        Profile profile("SimplifyIndices", Profile::CPU);
+
+        const VertexStreamView stream = GeometryVertexStream(inGeometry);
+        const size_t indexCount = inIndexCount - inIndexCount % 3;
+
+        outIndices.assign(inIndices, inIndices + indexCount);
+
+        if (indexCount <= inTargetIndexCount || stream.Count == 0)
+        {
+            return 0.0f;
+        }
+
+        // local numbering of the referenced vertices keeps the work proportional to the range
+        const auto limits = std::minmax_element(outIndices.begin(), outIndices.end());
+        const U32 lowest = *limits.first;
+        const size_t span = static_cast<size_t>(*limits.second) - lowest + 1;
+
+        if (*limits.second >= stream.Count)
+        {
+            std::cerr << "SimplifyIndices - index " << *limits.second << " out of range" << std::endl;
+            return 0.0f;
+        }
+
+        std::vector< U32 > globalOf;
+        std::vector< U32 > indices(indexCount);
+
+        if (span <= indexCount * 4)
+        {
+            std::vector< U32 > localOf(span, 0);
+
+            for (const U32 index : outIndices)
+            {
+                localOf[index - lowest] = 1;
+            }
+
+            for (size_t i = 0; i < span; ++i)
+            {
+                if (localOf[i])
+                {
+                    localOf[i] = static_cast<U32>(globalOf.size());
+                    globalOf.push_back(static_cast<U32>(lowest + i));
+                }
+            }
+
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                indices[i] = localOf[outIndices[i] - lowest];
+            }
+        }
+        else
+        {
+            globalOf = outIndices;
+            std::sort(globalOf.begin(), globalOf.end());
+            globalOf.erase(std::unique(globalOf.begin(), globalOf.end()), globalOf.end());
+
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                indices[i] = static_cast<U32>(std::lower_bound(globalOf.begin(), globalOf.end(), outIndices[i]) - globalOf.begin());
+            }
+        }
+
+        const U32 vertexCount = static_cast<U32>(globalOf.size());
+
+        // positions relative to the bounding box diagonal, so errors do not depend on the model scale
+        std::vector< glm::vec3 > positions(vertexCount);
+        glm::vec3 minimum(std::numeric_limits<F32>::max());
+        glm::vec3 maximum(-std::numeric_limits<F32>::max());
+
+        for (U32 v = 0; v < vertexCount; ++v)
+        {
+            positions[v] = stream.Position(globalOf[v]);
+            minimum = glm::min(minimum, positions[v]);
+            maximum = glm::max(maximum, positions[v]);
+        }
+
+        const F32 diagonal = glm::length(maximum - minimum);
+        const F32 scale = diagonal > 0.0f ? 1.0f / diagonal : 1.0f;
+
+        for (glm::vec3 &position : positions)
+        {
+            position = (position - minimum) * scale;
+        }
+
+        // vertices at one position are wedges of a UV / normal seam, those never move
+        std::vector< U8 > isLocked(vertexCount, 0);
+        std::vector< U32 > wedgeOf;
+        {
+            std::vector< PositionKey > keys(vertexCount);
+
+            for (U32 v = 0; v < vertexCount; ++v)
+            {
+                keys[v] = MakePositionKey(stream.Position(globalOf[v]));
+            }
+
+            FindPositionWedges(keys, wedgeOf);
+
+            for (U32 v = 0; v < vertexCount; ++v)
+            {
+                if (wedgeOf[v] != v)
+                {
+                    isLocked[v] = 1;
+                    isLocked[wedgeOf[v]] = 1;
+                }
+            }
+        }
+
+        // edges without a twin are borders, edges used more than once per direction are non manifold
+        {
+            std::vector< U32 > edgeBegins(vertexCount + 1, 0);
+            std::vector< U32 > edgeEnds(indexCount);
+
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                ++edgeBegins[wedgeOf[indices[i]] + 1];
+            }
+
+            for (U32 v = 0; v < vertexCount; ++v)
+            {
+                edgeBegins[v + 1] += edgeBegins[v];
+            }
+
+            std::vector< U32 > cursors(edgeBegins.begin(), edgeBegins.end() - 1);
+
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                edgeEnds[cursors[wedgeOf[indices[i]]]++] = wedgeOf[indices[i - i % 3 + (i + 1) % 3]];
+            }
+
+            auto countEdge = [&](U32 inFrom, U32 inTo)
+            {
+                U32 count = 0;
+                for (U32 e = edgeBegins[inFrom]; e < edgeBegins[inFrom + 1]; ++e)
+                {
+                    count += edgeEnds[e] == inTo ? 1 : 0;
+                }
+                return count;
+            };
+
+            for (U32 a = 0; a < vertexCount; ++a)
+            {
+                for (U32 e = edgeBegins[a]; e < edgeBegins[a + 1]; ++e)
+                {
+                    const U32 b = edgeEnds[e];
+                    const U32 twins = countEdge(b, a);
+
+                    const bool isBorder = twins == 0;
+                    const bool isComplex = twins > 1 || countEdge(a, b) > 1;
+
+                    if ((isBorder && inOptions.LockBorders) || isComplex)
+                    {
+                        isLocked[a] = 1;
+                        isLocked[b] = 1;
+                    }
+                }
+            }
+        }
+
+        // wedges share one lock state
+        for (U32 v = 0; v < vertexCount; ++v)
+        {
+            isLocked[v] = isLocked[v] | isLocked[wedgeOf[v]];
+        }
+
+        std::vector< Quadric > quadrics(vertexCount);
+
+        for (size_t t = 0; t < indexCount; t += 3)
+        {
+            const glm::vec3 &p0 = positions[indices[t + 0]];
+            const glm::vec3 &p1 = positions[indices[t + 1]];
+            const glm::vec3 &p2 = positions[indices[t + 2]];
+
+            const glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+            const F32 length = glm::length(cross);
+
+            if (!(length > 0.0f))
+            {
+                continue;
+            }
+
+            const glm::vec3 normal = cross / length;
+            const F64 distance = -static_cast<F64>(glm::dot(normal, p0));
+
+            for (I32 c = 0; c < 3; ++c)
+            {
+                quadrics[indices[t + c]].AddPlane(normal, distance, length * 0.5);
+            }
+        }
+
+        struct Collapse
+        {
+            U32 From;
+            U32 To;
+            F32 Cost;       // positional error plus weighted attribute change
+            F32 Error;      // positional error alone
+        };
+
+        const F32 maxCost = inOptions.MaxError * inOptions.MaxError;
+        const size_t targetIndexCount = inTargetIndexCount - inTargetIndexCount % 3;
+
+        std::vector< Collapse > collapses;
+        std::vector< U32 > adjacencyBegins(vertexCount + 1);
+        std::vector< U32 > adjacency;
+        std::vector< U32 > remap(vertexCount);
+        std::vector< U8 > isTouched(vertexCount);
+        F32 error = 0.0f;
+
+        auto attributeCost = [&](U32 inFrom, U32 inTo)
+        {
+            if (inOptions.AttributeWeight <= 0.0f)
+            {
+                return 0.0f;
+            }
+
+            const glm::vec3 normal = stream.Normal(globalOf[inFrom]) - stream.Normal(globalOf[inTo]);
+            const glm::vec2 texCoord = stream.TexCoord(globalOf[inFrom]) - stream.TexCoord(globalOf[inTo]);
+            return inOptions.AttributeWeight * (glm::dot(normal, normal) * 0.25f + glm::dot(texCoord, texCoord));
+        };
+
+        // moving inFrom onto inTo must not fold any remaining triangle over
+        auto flips = [&](U32 inFrom, U32 inTo)
+        {
+            for (U32 a = adjacencyBegins[inFrom]; a < adjacencyBegins[inFrom + 1]; ++a)
+            {
+                const U32 *triangle = &indices[adjacency[a] * 3];
+
+                if (triangle[0] == inTo || triangle[1] == inTo || triangle[2] == inTo)
+                {
+                    continue;
+                }
+
+                glm::vec3 before[3];
+                glm::vec3 after[3];
+
+                for (I32 c = 0; c < 3; ++c)
+                {
+                    before[c] = positions[triangle[c]];
+                    after[c] = triangle[c] == inFrom ? positions[inTo] : before[c];
+                }
+
+                const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+                if (glm::dot(normalBefore, normalAfter) <= 0.25f * glm::length(normalBefore) * glm::length(normalAfter))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        // passes of independent collapses, cheapest first, until the target or the error bound
+        while (indices.size() > targetIndexCount)
+        {
+            const size_t triangleCount = indices.size() / 3;
+
+            std::fill(adjacencyBegins.begin(), adjacencyBegins.end(), 0);
+            adjacency.resize(indices.size());
+
+            for (const U32 index : indices)
+            {
+                ++adjacencyBegins[index + 1];
+            }
+
+            for (U32 v = 0; v < vertexCount; ++v)
+            {
+                adjacencyBegins[v + 1] += adjacencyBegins[v];
+            }
+
+            {
+                std::vector< U32 > cursors(adjacencyBegins.begin(), adjacencyBegins.end() - 1);
+
+                for (size_t i = 0; i < indices.size(); ++i)
+                {
+                    adjacency[cursors[indices[i]]++] = static_cast<U32>(i / 3);
+                }
+            }
+
+            collapses.clear();
+
+            for (size_t i = 0; i < indices.size(); ++i)
+            {
+                const U32 a = indices[i];
+                const U32 b = indices[i - i % 3 + (i + 1) % 3];
+
+                // the twin triangle holds b -> a, so interior edges get both directions
+                if (!isLocked[a])
+                {
+                    const F32 collapseError = static_cast<F32>(quadrics[a].Error(positions[b]));
+                    const F32 collapseCost = collapseError + attributeCost(a, b);
+
+                    if (collapseCost <= maxCost)
+                    {
+                        collapses.push_back(Collapse{ a, b, collapseCost, collapseError });
+                    }
+                }
+            }
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &inLhs, const Collapse &inRhs)
+            {
+                return inLhs.Cost < inRhs.Cost || (inLhs.Cost == inRhs.Cost && (inLhs.From < inRhs.From || (inLhs.From == inRhs.From && inLhs.To < inRhs.To)));
+            });
+
+            for (U32 v = 0; v < vertexCount; ++v)
+            {
+                remap[v] = v;
+            }
+
+            std::fill(isTouched.begin(), isTouched.end(), 0);
+
+            // each collapse removes about two triangles
+            const size_t wanted = (triangleCount - targetIndexCount / 3) / 2 + 1;
+            size_t applied = 0;
+
+            for (const Collapse &collapse : collapses)
+            {
+                if (applied >= wanted)
+                {
+                    break;
+                }
+
+                if (isTouched[collapse.From] || isTouched[collapse.To] || flips(collapse.From, collapse.To))
+                {
+                    continue;
+                }
+
+                remap[collapse.From] = collapse.To;
+                quadrics[collapse.To].Add(quadrics[collapse.From]);
+                error = std::max(error, collapse.Error);
+                ++applied;
+
+                // the one ring is checked against the old positions, keep it still for this pass
+                for (U32 a = adjacencyBegins[collapse.From]; a < adjacencyBegins[collapse.From + 1]; ++a)
+                {
+                    const U32 *triangle = &indices[adjacency[a] * 3];
+                    isTouched[triangle[0]] = 1;
+                    isTouched[triangle[1]] = 1;
+                    isTouched[triangle[2]] = 1;
+                }
+
+                isTouched[collapse.To] = 1;
+            }
+
+            if (applied == 0)
+            {
+                break;
+            }
+
+            size_t written = 0;
+
+            for (size_t t = 0; t < indices.size(); t += 3)
+            {
+                const U32 a = remap[indices[t + 0]];
+                const U32 b = remap[indices[t + 1]];
+                const U32 c = remap[indices[t + 2]];
+
+                if (a != b && b != c && a != c)
+                {
+                    indices[written++] = a;
+                    indices[written++] = b;
+                    indices[written++] = c;
+                }
+            }
+
+            indices.resize(written);
+        }
+
+        outIndices.resize(indices.size());
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            outIndices[i] = globalOf[indices[i]];
+        }
+
+        return std::sqrt(error);
+    }
+
+    // End of the full detail ranges, LOD ranges follow it.
+    static size_t DetailIndexEnd(const Geometry &inGeometry)
+    {
+        if (inGeometry.LODs.empty())
+        {
+            return inGeometry.Indices.size();
+        }
+
+        size_t end = 0;
+
+        for (const SubMesh &subMesh : inGeometry.SubMeshes)
+        {
+            end = std::max<size_t>(end, static_cast<size_t>(subMesh.FirstIndex) + subMesh.IndexCount);
+        }
+
+        return end;
+    }
+
+    bool GenerateLODs(Geometry &outGeometry, const LODOptions &inOptions)
+    {
+        Profile profile("GenerateLODs", Profile::CPU);
+
+        // checked before the old chain is cut off, a failed call leaves the geometry as it was
+        const size_t detailEnd = DetailIndexEnd(outGeometry);
+
+        if (detailEnd < 3 || inOptions.LevelCount == 0 || !(inOptions.Reduction > 0.0f && inOptions.Reduction < 1.0f))
+        {
+            return false;
+        }
+
+        outGeometry.Indices.resize(detailEnd);
+        outGeometry.IndexCount = static_cast<U32>(outGeometry.Indices.size());
+        outGeometry.LODs.clear();
+
+        // the chain is described per submesh, so single range geometry gets one
+        if (outGeometry.SubMeshes.empty())
+        {
+            SubMesh subMesh;
+            subMesh.IndexCount = static_cast<U32>(outGeometry.Indices.size());
+            outGeometry.SubMeshes.push_back(subMesh);
+
+            UpdateSubMeshBounds(outGeometry);
+        }
+
+        const std::vector< SubMesh > &detail = outGeometry.SubMeshes;
+        std::vector< std::vector< U32 > > levels(detail.size());
+
+        AABB bounds;
+        for (const SubMesh &subMesh : detail)
+        {
+            bounds.Min = glm::min(bounds.Min, subMesh.Bounds.Min);
+            bounds.Max = glm::max(bounds.Max, subMesh.Bounds.Max);
+        }
+
+        const F32 diagonal = glm::length(bounds.Max - bounds.Min);
+        const F32 diagonalScale = diagonal > 0.0f ? 1.0f / diagonal : 0.0f;
+        std::vector< F32 > errors(detail.size());
+        F32 error = 0.0f;
+
+        for (U32 level = 0; level < inOptions.LevelCount; ++level)
+        {
+            const std::vector< SubMesh > &previous = level == 0 ? detail : outGeometry.LODs.back().SubMeshes;
+
+            ParallelFor(previous.size(), 1, [&](size_t inBegin, size_t inEnd)
+            {
+                for (size_t s = inBegin; s < inEnd; ++s)
+                {
+                    const size_t target = static_cast<size_t>(previous[s].IndexCount / 3 * inOptions.Reduction) * 3;
+                    const U32 *source = outGeometry.Indices.data() + previous[s].FirstIndex;
+
+                    errors[s] = SimplifyIndices(outGeometry, source, previous[s].IndexCount, target, levels[s], inOptions.Simplify);
+                }
+            });
+
+            size_t previousCount = 0;
+            size_t count = 0;
+
+            for (size_t s = 0; s < previous.size(); ++s)
+            {
+                previousCount += previous[s].IndexCount;
+                count += levels[s].size();
+            }
+
+            // a level that barely shrinks is not worth its memory
+            if (count == 0 || count > previousCount * 0.95)
+            {
+                break;
+            }
+
+            // errors are relative to each submesh, consecutive simplifications add up at most
+            F32 levelError = 0.0f;
+
+            for (size_t s = 0; s < detail.size(); ++s)
+            {
+                levelError = std::max(levelError, errors[s] * glm::length(detail[s].Bounds.Dimensions) * diagonalScale);
+            }
+
+            error += levelError;
+
+            GeometryLOD lod;
+            lod.Error = error;
+
+            for (size_t s = 0; s < previous.size(); ++s)
+            {
+                SubMesh subMesh = detail[s];
+                subMesh.FirstIndex = static_cast<U32>(outGeometry.Indices.size());
+                subMesh.IndexCount = static_cast<U32>(levels[s].size());
+
+                outGeometry.Indices.insert(outGeometry.Indices.end(), levels[s].begin(), levels[s].end());
+                lod.SubMeshes.push_back(subMesh);
+            }
+
+            outGeometry.LODs.push_back(std::move(lod));
+        }
+
+        return !outGeometry.LODs.empty();
+    }
+
+    /* Meshlets */
+
+    // Positions of the vertices the indices refer to, from the richest float stream or else the quantized one.
+    static bool GatherPositions(const Geometry &inGeometry, std::vector< glm::vec3 > &outPositions)
+    {
+        const void *vertices = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        GeometryVertexFormat(inGeometry, vertices, stride, count);
+
+        if (count > 0)
+        {
+            const U8 *bytes = static_cast<const U8*>(vertices);
+            outPositions.resize(count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                std::memcpy(&outPositions[i], bytes + stride * i, sizeof(glm::vec3));
+            }
+
+            return true;
+        }
+
+        outPositions.resize(inGeometry.Vertices_Quantized.size());
+
+        for (size_t i = 0; i < outPositions.size(); ++i)
+        {
+            outPositions[i] = DequantizePosition(inGeometry.Vertices_Quantized[i], inGeometry.Quantization);
+        }
+
+        return !outPositions.empty();
+    }
+
+    static void ComputeMeshletBounds(const std::vector< glm::vec3 > &inPositions, const U32 *inIndices, Meshlet &outMeshlet)
+    {
+        const U32 *indices = inIndices + outMeshlet.FirstIndex;
+
+        glm::vec3 minimum(std::numeric_limits<F32>::max());
+        glm::vec3 maximum(-std::numeric_limits<F32>::max());
+
+        for (U32 i = 0; i < outMeshlet.IndexCount; ++i)
+        {
+            minimum = glm::min(minimum, inPositions[indices[i]]);
+            maximum = glm::max(maximum, inPositions[indices[i]]);
+        }
+
+        const glm::vec3 center = (minimum + maximum) * 0.5f;
+        F32 radius = 0.0f;
+
+        for (U32 i = 0; i < outMeshlet.IndexCount; ++i)
+        {
+            radius = std::max(radius, glm::length(inPositions[indices[i]] - center));
+        }
+
+        outMeshlet.Center = center;
+        outMeshlet.Radius = radius;
+        outMeshlet.BoundsMin = minimum;
+        outMeshlet.BoundsMax = maximum;
+
+        // the cone axis is the mean of the unit face normals, its angle the widest normal from it
+        auto faceNormal = [&](U32 inTriangle)
+        {
+            const glm::vec3 &p0 = inPositions[indices[inTriangle * 3 + 0]];
+            const glm::vec3 &p1 = inPositions[indices[inTriangle * 3 + 1]];
+            const glm::vec3 &p2 = inPositions[indices[inTriangle * 3 + 2]];
+
+            return SafeNormalize(glm::cross(p1 - p0, p2 - p0), glm::vec3(0.0f));
+        };
+
+        const U32 triangleCount = outMeshlet.IndexCount / 3;
+        glm::vec3 axis(0.0f);
+
+        for (U32 t = 0; t < triangleCount; ++t)
+        {
+            axis += faceNormal(t);
+        }
+
+        outMeshlet.ConeApex = center;
+        outMeshlet.ConeCutoff = 2.0f;
+        outMeshlet.ConeAxis = SafeNormalize(axis, glm::vec3(0.0f, 0.0f, 1.0f));
+
+        if (glm::length(axis) <= 0.0f)
+        {
+            return;
+        }
+
+        F32 minimumDot = 1.0f;
+
+        for (U32 t = 0; t < triangleCount; ++t)
+        {
+            const glm::vec3 normal = faceNormal(t);
+
+            if (glm::dot(normal, normal) > 0.0f)
+            {
+                minimumDot = std::min(minimumDot, glm::dot(normal, outMeshlet.ConeAxis));
+            }
+        }
+
+        // normals more than about 84 degrees off the axis leave a cone that would hardly ever cull
+        if (minimumDot <= 0.1f)
+        {
+            return;
+        }
+
+        // the apex moves back along the axis until it is behind every triangle plane, dot(apex - p0, n) <= 0,
+        // and any eye outside the cone sees only their back faces
+        F32 maximumT = 0.0f;
+
+        for (U32 t = 0; t < triangleCount; ++t)
+        {
+            const glm::vec3 normal = faceNormal(t);
+
+            if (glm::dot(normal, normal) > 0.0f)
+            {
+                const glm::vec3 offset = center - inPositions[indices[t * 3]];
+                maximumT = std::max(maximumT, glm::dot(offset, normal) / glm::dot(normal, outMeshlet.ConeAxis));
+            }
+        }
+
+        // sine of the widest angle from the cross products, sqrt(1 - dot^2) rounds to 0 for nearly flat meshlets
+        F32 maximumSine = 0.0f;
+
+        for (U32 t = 0; t < triangleCount; ++t)
+        {
+            maximumSine = std::max(maximumSine, glm::length(glm::cross(faceNormal(t), outMeshlet.ConeAxis)));
+        }
+
+        outMeshlet.ConeApex = center - outMeshlet.ConeAxis * maximumT;
+        // the margin keeps rounding in the apex and eye direction from culling triangles seen exactly edge on
+        outMeshlet.ConeCutoff = maximumSine + 1e-3f;
+    }
+
+    bool BuildMeshlets(Geometry &outGeometry, const MeshletOptions &inOptions)
+    {
+        Profile profile("BuildMeshlets", Profile::CPU);
+
+        outGeometry.Meshlets.clear();
+
+        std::vector< glm::vec3 > positions;
+        const size_t detailEnd = DetailIndexEnd(outGeometry);
+
+        if (detailEnd < 3 || !GatherPositions(outGeometry, positions))
+        {
+            return false;
+        }
+
+        if (outGeometry.SubMeshes.empty())
+        {
+            SubMesh subMesh;
+            subMesh.IndexCount = static_cast<U32>(detailEnd);
+            outGeometry.SubMeshes.push_back(subMesh);
+
+            UpdateSubMeshBounds(outGeometry);
+        }
+
+        for (const SubMesh &subMesh : outGeometry.SubMeshes)
+        {
+            if (subMesh.FirstIndex % 3 != 0)
+            {
+                std::cerr << "Failed to build meshlets - submesh " << subMesh.Material << " does not start on a triangle" << std::endl;
+                return false;
+            }
+        }
+
+        const U32 maxVertices = std::max<U32>(inOptions.MaxVertices, 3);
+        const U32 maxTriangles = std::max<U32>(inOptions.MaxTriangles, 1);
+
+        std::vector< U32 > &indices = outGeometry.Indices;
+        const size_t triangleCount = detailEnd / 3;
+        const size_t vertexCount = positions.size();
+
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            if (indices[i] >= vertexCount)
+            {
+                std::cerr << "Failed to build meshlets - index " << indices[i] << " out of range" << std::endl;
+                return false;
+            }
+        }
+
+        // triangles around every vertex, CSR
+        std::vector< U32 > offsets(vertexCount + 1, 0);
+
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            ++offsets[indices[i] + 1];
+        }
+
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+
+        std::vector< U32 > adjacency(triangleCount * 3);
+        std::vector< U32 > cursors(offsets.begin(), offsets.end() - 1);
+
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            adjacency[cursors[indices[i]]++] = static_cast<U32>(i / 3);
+        }
+
+        std::vector< glm::vec3 > centroids(triangleCount);
+
+        ParallelFor(triangleCount, 1 << 15, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t t = inBegin; t < inEnd; ++t)
+            {
+                centroids[t] = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+            }
+        });
+
+        std::vector< U8 > isUsed(triangleCount, 0);
+        std::vector< U32 > vertexMeshlet(vertexCount, VertexIndexMap::kEmpty);  // last meshlet that took the vertex
+        std::vector< U32 > candidateMeshlet(triangleCount, VertexIndexMap::kEmpty);  // last meshlet that listed the triangle
+        std::vector< U32 > candidates;
+        std::vector< U32 > reordered;
+
+        for (U32 s = 0; s < outGeometry.SubMeshes.size(); ++s)
+        {
+            const SubMesh &subMesh = outGeometry.SubMeshes[s];
+            const U32 firstTriangle = subMesh.FirstIndex / 3;
+            const U32 endTriangle = firstTriangle + subMesh.IndexCount / 3;
+            U32 scan = firstTriangle;
+
+            reordered.clear();
+
+            while (true)
+            {
+                while (scan < endTriangle && isUsed[scan])
+                {
+                    ++scan;
+                }
+
+                if (scan == endTriangle)
+                {
+                    break;
+                }
+
+                Meshlet meshlet;
+                meshlet.FirstIndex = subMesh.FirstIndex + static_cast<U32>(reordered.size());
+                meshlet.SubMeshIndex = s;
+
+                const U32 id = static_cast<U32>(outGeometry.Meshlets.size());
+                U32 meshletVertices = 0;
+                U32 meshletTriangles = 0;
+                glm::vec3 centroidSum(0.0f);
+                glm::vec3 minimum(std::numeric_limits<F32>::max());
+                glm::vec3 maximum(-std::numeric_limits<F32>::max());
+
+                candidates.clear();
+
+                auto newVertices = [&](U32 inTriangle)
+                {
+                    const U32 a = indices[inTriangle * 3 + 0];
+                    const U32 b = indices[inTriangle * 3 + 1];
+                    const U32 c = indices[inTriangle * 3 + 2];
+
+                    return static_cast<U32>(vertexMeshlet[a] != id) +
+                           static_cast<U32>(vertexMeshlet[b] != id && b != a) +
+                           static_cast<U32>(vertexMeshlet[c] != id && c != a && c != b);
+                };
+
+                auto add = [&](U32 inTriangle)
+                {
+                    isUsed[inTriangle] = 1;
+
+                    for (U32 k = 0; k < 3; ++k)
+                    {
+                        const U32 vertex = indices[inTriangle * 3 + k];
+                        reordered.push_back(vertex);
+
+                        if (vertexMeshlet[vertex] == id)
+                        {
+                            continue;
+                        }
+
+                        vertexMeshlet[vertex] = id;
+                        ++meshletVertices;
+
+                        for (U32 a = offsets[vertex]; a < offsets[vertex + 1]; ++a)
+                        {
+                            const U32 neighbour = adjacency[a];
+
+                            if (neighbour >= firstTriangle && neighbour < endTriangle && !isUsed[neighbour] && candidateMeshlet[neighbour] != id)
+                            {
+                                candidateMeshlet[neighbour] = id;
+                                candidates.push_back(neighbour);
+                            }
+                        }
+                    }
+
+                    ++meshletTriangles;
+                    centroidSum += centroids[inTriangle];
+                    minimum = glm::min(minimum, centroids[inTriangle]);
+                    maximum = glm::max(maximum, centroids[inTriangle]);
+                };
+
+                add(scan);
+
+                while (meshletTriangles < maxTriangles)
+                {
+                    // fewest new vertices first, then closest to the meshlet so it stays round
+                    const glm::vec3 center = centroidSum / static_cast<F32>(meshletTriangles);
+                    U32 best = VertexIndexMap::kEmpty;
+                    U32 bestAdded = 4;
+                    F32 bestDistance = std::numeric_limits<F32>::max();
+                    size_t live = 0;
+
+                    for (size_t i = 0; i < candidates.size(); ++i)
+                    {
+                        const U32 candidate = candidates[i];
+
+                        if (isUsed[candidate])
+                        {
+                            continue;
+                        }
+
+                        candidates[live++] = candidate;
+
+                        const U32 added = newVertices(candidate);
+
+                        if (meshletVertices + added > maxVertices)
+                        {
+                            continue;
+                        }
+
+                        const glm::vec3 delta = centroids[candidate] - center;
+                        const F32 distance = glm::dot(delta, delta);
+
+                        if (added < bestAdded || (added == bestAdded && distance < bestDistance))
+                        {
+                            best = candidate;
+                            bestAdded = added;
+                            bestDistance = distance;
+                        }
+                    }
+
+                    candidates.resize(live);
+
+                    if (best == VertexIndexMap::kEmpty)
+                    {
+                        // nothing connected fits, the next triangle in index order may join when it lies within the meshlet
+                        while (scan < endTriangle && isUsed[scan])
+                        {
+                            ++scan;
+                        }
+
+                        const F32 radius = glm::length(maximum - minimum) * 0.5f;
+
+                        if (scan == endTriangle || meshletVertices + newVertices(scan) > maxVertices ||
+                            glm::length(centroids[scan] - center) > radius)
+                        {
+                            break;
+                        }
+
+                        best = scan;
+                    }
+
+                    add(best);
+                }
+
+                meshlet.IndexCount = meshletTriangles * 3;
+                outGeometry.Meshlets.push_back(meshlet);
+            }
+
+            std::copy(reordered.begin(), reordered.end(), indices.begin() + subMesh.FirstIndex);
+        }
+
+        ParallelFor(outGeometry.Meshlets.size(), 256, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t i = inBegin; i < inEnd; ++i)
+            {
+                ComputeMeshletBounds(positions, indices.data(), outGeometry.Meshlets[i]);
+            }
+        });
+
+        return true;
+    }
+
+    /* Mesh cache */
+
+    static constexpr U32 kMeshCacheMagic = 0x4D465047; // "GPFM"
+    static constexpr U32 kMeshCacheVersion = 8;
+
+    struct MeshCacheHeader
+    {
+        U32 Magic;
+        U32 Version;
+        U64 SourceSize;
+        I64 SourceTime;
+        U64 SourceHash;
+        U32 Format;
+        U32 VertexStride;
+        U32 VertexCount;
+        U32 IndexCount;
+        U32 DetailIndexCount;
+        U32 IndexSize;          // 2 below 65536 vertices, else 4
+        U32 PositionEncoding;   // quantization of VertexFormat::Quantized
+        F32 PositionOffset[3];
+        F32 PositionScale[3];
+        F32 BoundsMin[3];
+        F32 BoundsMax[3];
+        U64 VertexOffset;
+        U64 IndexOffset;
+        U64 MetadataOffset; // materials, submeshes, LODs, then meshlets
+        U64 MetadataSize;
+    };
+
+    template< typename T >
+    static void WriteCacheValue(std::vector< U8 > &outData, const T &inValue)
+    {
+        const U8 *bytes = reinterpret_cast<const U8*>(&inValue);
+        outData.insert(outData.end(), bytes, bytes + sizeof(T));
+    }
+
+    template< typename T >
+    static bool ReadCacheValue(const U8 *&ioCursor, const U8 *inEnd, T &outValue)
+    {
+        if (static_cast<size_t>(inEnd - ioCursor) < sizeof(T))
+        {
+            return false;
+        }
+
+        std::memcpy(&outValue, ioCursor, sizeof(T));
+        ioCursor += sizeof(T);
+        return true;
+    }
+
+    static void WriteCacheString(std::vector< U8 > &outData, const std::string &inValue)
+    {
+        WriteCacheValue(outData, static_cast<U32>(inValue.size()));
+        outData.insert(outData.end(), inValue.begin(), inValue.end());
+    }
+
+    static bool ReadCacheString(const U8 *&ioCursor, const U8 *inEnd, std::string &outValue)
+    {
+        U32 size = 0;
+
+        if (!ReadCacheValue(ioCursor, inEnd, size) || static_cast<size_t>(inEnd - ioCursor) < size)
+        {
+            return false;
+        }
+
+        outValue.assign(reinterpret_cast<const char*>(ioCursor), size);
+        ioCursor += size;
+        return true;
+    }
+
+    static void WriteCacheSubMeshes(std::vector< U8 > &outData, const std::vector< SubMesh > &inSubMeshes)
+    {
+        WriteCacheValue(outData, static_cast<U32>(inSubMeshes.size()));
+
+        for (const SubMesh &subMesh : inSubMeshes)
+        {
+            WriteCacheValue(outData, subMesh.FirstIndex);
+            WriteCacheValue(outData, subMesh.IndexCount);
+            WriteCacheString(outData, subMesh.Material);
+            WriteCacheValue(outData, subMesh.Bounds.Min);
+            WriteCacheValue(outData, subMesh.Bounds.Max);
+        }
+    }
+
+    static bool ReadCacheSubMeshes(const U8 *&ioCursor, const U8 *inEnd, U32 inIndexCount, std::vector< SubMesh > &outSubMeshes)
+    {
+        U32 subMeshCount = 0;
+
+        if (!ReadCacheValue(ioCursor, inEnd, subMeshCount))
+        {
+            return false;
+        }
+
+        for (U32 i = 0; i < subMeshCount; ++i)
+        {
+            SubMesh subMesh;
+
+            const bool isRead = ReadCacheValue(ioCursor, inEnd, subMesh.FirstIndex) &&
+                                ReadCacheValue(ioCursor, inEnd, subMesh.IndexCount) &&
+                                ReadCacheString(ioCursor, inEnd, subMesh.Material) &&
+                                ReadCacheValue(ioCursor, inEnd, subMesh.Bounds.Min) &&
+                                ReadCacheValue(ioCursor, inEnd, subMesh.Bounds.Max);
+
+            if (!isRead || static_cast<U64>(subMesh.FirstIndex) + subMesh.IndexCount > inIndexCount)
+            {
+                return false;
+            }
+
+            subMesh.Bounds.Dimensions = subMesh.Bounds.Max - subMesh.Bounds.Min;
+            subMesh.Bounds.Center = (subMesh.Bounds.Max + subMesh.Bounds.Min) / 2.0f;
+            outSubMeshes.push_back(subMesh);
+        }
+
+        return true;
+    }
+
+    std::string MeshCachePath(const std::string &inSourceFile)
+    {
+        return inSourceFile + ".gpfmesh";
+    }
+
+    bool SaveMeshCache(const std::string &inFileName, const Geometry &inGeometry, U64 inSourceSize, I64 inSourceTime, U64 inSourceHash)
+    {
+        Profile profile("SaveMeshCache", Profile::CPU);
+
+        const void *vertices = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        const VertexFormat format = UploadVertexFormat(inGeometry, vertices, stride, count);
+
+        std::vector< U8 > metadata;
+        WriteCacheValue(metadata, static_cast<U32>(inGeometry.Materials.size()));
+
+        for (const auto &entry : inGeometry.Materials)
+        {
+            const MaterialInfo &material = entry.second;
+
+            WriteCacheString(metadata, material.Name);
+            WriteCacheString(metadata, material.AmbientTextureName);
+            WriteCacheString(metadata, material.DiffuseTextureName);
+            WriteCacheString(metadata, material.SpecularTextureName);
+            WriteCacheString(metadata, material.HighlightTextureName);
+            WriteCacheString(metadata, material.BumpTextureName);
+            WriteCacheString(metadata, material.DisplacementTextureName);
+            WriteCacheString(metadata, material.AlphaTextureName);
+            WriteCacheString(metadata, material.ReflectionTextureName);
+        }
+
+        WriteCacheSubMeshes(metadata, inGeometry.SubMeshes);
+        WriteCacheValue(metadata, static_cast<U32>(inGeometry.LODs.size()));
+
+        for (const GeometryLOD &lod : inGeometry.LODs)
+        {
+            WriteCacheValue(metadata, lod.Error);
+            WriteCacheSubMeshes(metadata, lod.SubMeshes);
+        }
+
+        WriteCacheValue(metadata, static_cast<U32>(inGeometry.Meshlets.size()));
+
+        for (const Meshlet &meshlet : inGeometry.Meshlets)
+        {
+            WriteCacheValue(metadata, meshlet);
+        }
+
+        auto align = [](U64 inOffset)
+        {
+            return (inOffset + 15) & ~static_cast<U64>(15);
+        };
+
+        MeshCacheHeader header = {};
+        header.Magic = kMeshCacheMagic;
+        header.Version = kMeshCacheVersion;
+        header.SourceSize = inSourceSize;
+        header.SourceTime = inSourceTime;
+        header.SourceHash = inSourceHash;
+        header.Format = static_cast<U32>(format);
+        header.VertexStride = static_cast<U32>(stride);
+        header.VertexCount = static_cast<U32>(count);
+        header.IndexCount = static_cast<U32>(inGeometry.Indices.size());
+        header.DetailIndexCount = static_cast<U32>(DetailIndexEnd(inGeometry));
+        header.IndexSize = UseShortIndices(count) ? sizeof(U16) : sizeof(U32);
+        header.PositionEncoding = static_cast<U32>(inGeometry.Quantization.Encoding);
+
+        for (I32 i = 0; i < 3; ++i)
+        {
+            header.PositionOffset[i] = inGeometry.Quantization.Offset[i];
+            header.PositionScale[i] = inGeometry.Quantization.Scale[i];
+            header.BoundsMin[i] = inGeometry.Bounds.Min[i];
+            header.BoundsMax[i] = inGeometry.Bounds.Max[i];
+        }
+
+        std::vector< U16 > shortIndices;
+
+        if (header.IndexSize == sizeof(U16))
+        {
+            shortIndices.assign(inGeometry.Indices.begin(), inGeometry.Indices.end());
+        }
+
+        const void *indices = shortIndices.empty() ? static_cast<const void*>(inGeometry.Indices.data()) : shortIndices.data();
+        const size_t indexBytes = static_cast<size_t>(header.IndexSize) * inGeometry.Indices.size();
+
+        header.VertexOffset = align(sizeof(header));
+        header.IndexOffset = align(header.VertexOffset + stride * count);
+        header.MetadataOffset = align(header.IndexOffset + indexBytes);
+        header.MetadataSize = metadata.size();
+
+        const std::string temporary = TemporaryFileName(inFileName);
+        std::ofstream file(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        const char padding[16] = {};
+        U64 written = 0;
+
+        auto write = [&](U64 inOffset, const void *inData, size_t inSize)
+        {
+            file.write(padding, static_cast<std::streamsize>(inOffset - written));
+            file.write(static_cast<const char*>(inData), static_cast<std::streamsize>(inSize));
+            written = inOffset + inSize;
+        };
+
+        write(0, &header, sizeof(header));
+        write(header.VertexOffset, vertices, stride * count);
+        write(header.IndexOffset, indices, indexBytes);
+        write(header.MetadataOffset, metadata.data(), metadata.size());
+
+        file.close();
+
+        // a short write must never replace a good cache
+        std::error_code error;
+
+        if (file.fail())
+        {
+            std::cerr << "Warning: failed to write mesh cache - " << inFileName << "\n";
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+
+        std::filesystem::rename(temporary, inFileName, error);
+
+        if (error)
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LoadMeshCache(const std::string &inFileName, MeshCache &outCache)
+    {
+        MappedFile file;
+        if (!MapFile(inFileName, file, MapHint::WillNeed))
+        {
+            return false;
+        }
+
+        MeshCacheHeader header;
+
+        if (file.Size < sizeof(header))
+        {
+            return false;
+        }
+
+        std::memcpy(&header, file.Data, sizeof(header));
+
+        if (header.Magic != kMeshCacheMagic || header.Version != kMeshCacheVersion || header.Format > static_cast<U32>(VertexFormat::Quantized) ||
+            (header.IndexSize != sizeof(U16) && header.IndexSize != sizeof(U32)) || header.PositionEncoding > static_cast<U32>(PositionEncoding::Half))
+        {
+            return false;
+        }
+
+        // MeshCacheToGeometry copies VertexCount structs of Format, any other stride would run past them
+        if (header.VertexStride != VertexFormatStride(static_cast<VertexFormat>(header.Format)))
+        {
+            std::cerr << "Warning: vertex stride does not match the format of mesh cache - " << inFileName << "\n";
+            return false;
+        }
+
+        // offsets first, so the sums below can not wrap
+        if (header.VertexOffset > file.Size || header.IndexOffset > file.Size || header.MetadataOffset > file.Size ||
+            static_cast<U64>(header.VertexStride) * header.VertexCount > file.Size - header.VertexOffset ||
+            static_cast<U64>(header.IndexSize) * header.IndexCount > file.Size - header.IndexOffset ||
+            header.MetadataSize > file.Size - header.MetadataOffset)
+        {
+            std::cerr << "Warning: truncated mesh cache - " << inFileName << "\n";
+            return false;
+        }
+
+        outCache = MeshCache();
+
+        // metadata is the only part that is actually read
+        const U8 *cursor = file.Data + header.MetadataOffset;
+        const U8 *end = cursor + header.MetadataSize;
+        U32 materialCount = 0;
+
+        if (!ReadCacheValue(cursor, end, materialCount))
+        {
+            return false;
+        }
+
+        for (U32 i = 0; i < materialCount; ++i)
+        {
+            MaterialInfo material;
+
+            const bool isRead = ReadCacheString(cursor, end, material.Name) &&
+                                ReadCacheString(cursor, end, material.AmbientTextureName) &&
+                                ReadCacheString(cursor, end, material.DiffuseTextureName) &&
+                                ReadCacheString(cursor, end, material.SpecularTextureName) &&
+                                ReadCacheString(cursor, end, material.HighlightTextureName) &&
+                                ReadCacheString(cursor, end, material.BumpTextureName) &&
+                                ReadCacheString(cursor, end, material.DisplacementTextureName) &&
+                                ReadCacheString(cursor, end, material.AlphaTextureName) &&
+                                ReadCacheString(cursor, end, material.ReflectionTextureName);
+
+            if (!isRead)
+            {
+                return false;
+            }
+
+            outCache.Materials.emplace(material.Name, material);
+        }
+
+        U32 lodCount = 0;
+
+        if (!ReadCacheSubMeshes(cursor, end, header.IndexCount, outCache.SubMeshes) || !ReadCacheValue(cursor, end, lodCount))
+        {
+            return false;
+        }
+
+        for (U32 i = 0; i < lodCount; ++i)
+        {
+            GeometryLOD lod;
+
+            if (!ReadCacheValue(cursor, end, lod.Error) || !ReadCacheSubMeshes(cursor, end, header.IndexCount, lod.SubMeshes))
+            {
+                return false;
+            }
+
+            outCache.LODs.push_back(std::move(lod));
+        }
+
+        U32 meshletCount = 0;
+
+        if (!ReadCacheValue(cursor, end, meshletCount) || meshletCount > static_cast<U64>(end - cursor) / sizeof(Meshlet))
+        {
+            return false;
+        }
+
+        outCache.Meshlets.resize(meshletCount);
+
+        for (Meshlet &meshlet : outCache.Meshlets)
+        {
+            ReadCacheValue(cursor, end, meshlet);
+
+            if (static_cast<U64>(meshlet.FirstIndex) + meshlet.IndexCount > header.IndexCount || meshlet.SubMeshIndex >= outCache.SubMeshes.size())
+            {
+                return false;
+            }
+        }
+
+        outCache.Format = static_cast<VertexFormat>(header.Format);
+        outCache.Vertices = file.Data + header.VertexOffset;
+        outCache.VertexStride = header.VertexStride;
+        outCache.VertexCount = header.VertexCount;
+        outCache.Indices = file.Data + header.IndexOffset;
+        outCache.IndexCount = header.IndexCount;
+        outCache.IndexType = header.IndexSize == sizeof(U16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        outCache.Quantization.Encoding = static_cast<PositionEncoding>(header.PositionEncoding);
+        outCache.Quantization.Offset = glm::vec3(header.PositionOffset[0], header.PositionOffset[1], header.PositionOffset[2]);
+        outCache.Quantization.Scale = glm::vec3(header.PositionScale[0], header.PositionScale[1], header.PositionScale[2]);
+        outCache.DetailIndexCount = std::min(header.DetailIndexCount, header.IndexCount);
+        outCache.SourceSize = header.SourceSize;
+        outCache.SourceTime = header.SourceTime;
+        outCache.SourceHash = header.SourceHash;
+
+        outCache.Bounds.Min = glm::vec3(header.BoundsMin[0], header.BoundsMin[1], header.BoundsMin[2]);
+        outCache.Bounds.Max = glm::vec3(header.BoundsMax[0], header.BoundsMax[1], header.BoundsMax[2]);
+        outCache.Bounds.Dimensions = outCache.Bounds.Max - outCache.Bounds.Min;
+        outCache.Bounds.Center = (outCache.Bounds.Max + outCache.Bounds.Min) / 2.0f;
+
+        outCache.Mapping = std::move(file);
+        return true;
+    }
+
+    bool LoadValidMeshCache(const std::string &inSourceFile, MeshCache &outCache)
+    {
+        U64 sourceSize = 0;
+        I64 sourceTime = 0;
+        const std::string cachePath = MeshCachePath(inSourceFile);
+
+        if (!LoadMeshCache(cachePath, outCache))
+        {
+            return false;
+        }
+
+        // a cache shipped without its source is used as is
+        if (!SourceFileInfo(inSourceFile, sourceSize, sourceTime))
+        {
+            return true;
+        }
+
+        if (outCache.SourceSize != sourceSize)
+        {
+            return false;
+        }
+
+        if (outCache.SourceTime == sourceTime)
+        {
+            return true;
+        }
+
+        // touched but maybe not changed, only now is the source read in full
+        MappedFile source;
+        if (!MapFile(inSourceFile, source, MapHint::Sequential) || HashFileContents(source.Data, source.Size) != outCache.SourceHash)
+        {
+            return false;
+        }
+
+        // remember the new time so the next load skips the hash
+        std::fstream file(cachePath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+
+        if (file.is_open())
+        {
+            file.seekp(offsetof(MeshCacheHeader, SourceTime));
+            file.write(reinterpret_cast<const char*>(&sourceTime), sizeof(sourceTime));
+        }
+
+        outCache.SourceTime = sourceTime;
+        return true;
+    }
+
+    void MeshCacheToGeometry(const MeshCache &inCache, Geometry &outGeometry)
+    {
+        const size_t vertexBytes = static_cast<size_t>(inCache.VertexStride) * inCache.VertexCount;
+
+        switch (inCache.Format)
+        {
+        case VertexFormat::P1N1UV1T1BT:
+            outGeometry.Vertices_1P1N1UV1T1BT.resize(inCache.VertexCount);
+            std::memcpy(outGeometry.Vertices_1P1N1UV1T1BT.data(), inCache.Vertices, vertexBytes);
+            break;
+        case VertexFormat::P1N1UV:
+            outGeometry.Vertices_1P1N1UV.resize(inCache.VertexCount);
+            std::memcpy(outGeometry.Vertices_1P1N1UV.data(), inCache.Vertices, vertexBytes);
+            break;
+        case VertexFormat::P1UV:
+            outGeometry.Vertices_1P1UV.resize(inCache.VertexCount);
+            std::memcpy(outGeometry.Vertices_1P1UV.data(), inCache.Vertices, vertexBytes);
+            break;
+        case VertexFormat::Quantized:
+            outGeometry.Vertices_Quantized.resize(inCache.VertexCount);
+            std::memcpy(outGeometry.Vertices_Quantized.data(), inCache.Vertices, vertexBytes);
+            break;
+        }
+
+        if (inCache.IndexType == GL_UNSIGNED_SHORT)
+        {
+            const U16 *indices = static_cast<const U16*>(inCache.Indices);
+            outGeometry.Indices.assign(indices, indices + inCache.IndexCount);
+        }
+        else
+        {
+            const U32 *indices = static_cast<const U32*>(inCache.Indices);
+            outGeometry.Indices.assign(indices, indices + inCache.IndexCount);
+        }
+
+        outGeometry.Quantization = inCache.Quantization;
+        outGeometry.Materials = inCache.Materials;
+        outGeometry.SubMeshes = inCache.SubMeshes;
+        outGeometry.LODs = inCache.LODs;
+        outGeometry.Meshlets = inCache.Meshlets;
+        outGeometry.Bounds = inCache.Bounds;
+        outGeometry.VertexCount = inCache.VertexCount;
+        outGeometry.IndexCount = inCache.DetailIndexCount;
+    }
+
+    void UploadMeshCache(const MeshCache &inCache, Geometry &outGeometry)
+    {
+        outGeometry.Materials = inCache.Materials;
+        outGeometry.SubMeshes = inCache.SubMeshes;
+        outGeometry.LODs = inCache.LODs;
+        outGeometry.Meshlets = inCache.Meshlets;
+        outGeometry.Bounds = inCache.Bounds;
+        outGeometry.VertexCount = inCache.VertexCount;
+        outGeometry.IndexCount = inCache.DetailIndexCount;
+        outGeometry.IndexType = inCache.IndexType;
+        outGeometry.Quantization = inCache.Quantization;
+
+        outGeometry.VAO = GenerateVAO();
+
+        outGeometry.VBO = GenerateBuffer(BufferType::Array);
+        UploadDataImmutable(BufferType::Array, inCache.Vertices, static_cast<size_t>(inCache.VertexStride) * inCache.VertexCount);
+        SetupVertexLayout(inCache.Format, inCache.Quantization.Encoding);
+
+        outGeometry.IBO = GenerateBuffer(BufferType::Index);
+        UploadDataImmutable(BufferType::Index, inCache.Indices, static_cast<size_t>(TypeSize(inCache.IndexType)) * inCache.IndexCount);
+
+        BindVAO(0);
+    }
+
+    bool LoadOBJToGPU(const std::string &inFileName, Geometry &outGeometry)
+    {
+        MeshCache cache;
+
+        if (LoadValidMeshCache(inFileName, cache))
+        {
+            UploadMeshCache(cache, outGeometry);
+            return true;
+        }
+
+        if (!LoadOBJ(inFileName, outGeometry))
+        {
+            return false;
+        }
+
+        UploadGeometry(outGeometry);
+        return true;
+    }
+
+    /* Primitives */
+
+    Geometry Primitive_Plane()
+    {
+        Geometry result;
+
+		Vertex1P1N1UV vertex;
+        vertex.Position = glm::vec3(-1.0f, 0.0f, 0.f);
+        vertex.TexCoord = glm::vec2(0.0f, 0.0f);
+        result.Vertices_1P1N1UV.push_back( vertex );
+
+        vertex.Position = glm::vec3(1.0f, 1.0f, 0.f);
+        vertex.TexCoord = glm::vec2(1.0f, 0.0f);
+        result.Vertices_1P1N1UV.push_back( vertex );
+
+        vertex.Position = glm::vec3(1.0f,-1.0f, 0.f);
+        vertex.TexCoord = glm::vec2(1.0f, 1.0f);
+        result.Vertices_1P1N1UV.push_back( vertex );
+
+        vertex.Position = glm::vec3(-1.0f,-1.0f, 0.f);
+        vertex.TexCoord = glm::vec2(0.0f, 1.0f);
+        result.Vertices_1P1N1UV.push_back( vertex );
+
+        result.Indices = {
+			0, 1, 2,
+			2, 3, 0
+		};
+
+        result.IndexCount = static_cast<U32>(result.Indices.size());
+        result.VertexCount = static_cast<U32>(result.Vertices_1P1N1UV.size());
+
+        return result;
+    }
+
+    Geometry Primitive_ScreenQuad()
+    {
+        Geometry result;
+
+		Vertex1P1N1UV topLeft;
+        topLeft.Position = glm::vec3(-1.0f, -1.0f, 0.0f);
+        topLeft.TexCoord = glm::vec2(0.0f, 0.0f);
+
+		Vertex1P1N1UV topRight;
+        topRight.Position = glm::vec3(1.0f, -1.0f, 0.0f);
+        topRight.TexCoord = glm::vec2(1.0f, 0.0f);
+
+		Vertex1P1N1UV bottomRight;
+        bottomRight.Position = glm::vec3(1.0f, 1.0f, 0.0f);
+        bottomRight.TexCoord = glm::vec2(1.0f, 1.0f);
+
+		Vertex1P1N1UV bottomLeft;
+        bottomLeft.Position = glm::vec3(-1.0f, 1.0f, 0.0f);
+        bottomLeft.TexCoord = glm::vec2(0.0f, 1.0f);
+
+        result.Vertices_1P1N1UV = {
+            topLeft, topRight, bottomRight, bottomLeft
+        };
+
+        result.Indices = {
+            0, 1, 2,
+            2, 3, 0
+		};
+
+        result.IndexCount = static_cast<U32>(result.Indices.size());
+        result.VertexCount = static_cast<U32>(result.Vertices_1P1N1UV.size());
+
+        return result;
+    }
+
+     /* Camera */
+
+    glm::mat4 GetProjectionMatrix(const Camera &inCamera)
+    {
+        return glm::perspective( glm::radians(inCamera.Fov) , inCamera.Aspect, inCamera.Near, inCamera.Far );
+    }
+
+    glm::mat4 GetViewMatrix(Camera &outCamera)
+    {
+        glm::vec3 front;
+        front.x = glm::cos(glm::radians(outCamera.Yaw)) * glm::cos(glm::radians(outCamera.Pitch));
+        front.y = glm::sin(glm::radians(outCamera.Pitch));
+        front.z = glm::sin(glm::radians(outCamera.Yaw)) * glm::cos(glm::radians(outCamera.Pitch));
+        outCamera.Front = glm::normalize(front);
+
+        outCamera.Right = glm::normalize(glm::cross(outCamera.Front, outCamera.WorldUp));
+        outCamera.Up = glm::normalize(glm::cross(outCamera.Right, outCamera.Front));
+
+        return glm::lookAt( outCamera.Position, 
+                            outCamera.Position + outCamera.Front, 
+                            outCamera.Up );
+    }
+
+    void MoveForward(Camera &outCamera, F64 inDt)
+    {
+	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
+	    outCamera.Position += outCamera.Front * velocity;
+    }
+
+    void MoveBackward(Camera &outCamera, F64 inDt)
+    {
+	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
+	    outCamera.Position -= outCamera.Front * velocity;
+    }
+
+    void MoveLeft(Camera &outCamera, F64 inDt)
+    {
+	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
+	    outCamera.Position -= outCamera.Right * velocity;
+    }
+
+    void MoveRight(Camera &outCamera, F64 inDt)
+    {
+	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
+	    outCamera.Position += outCamera.Right * velocity;
+    }
+
+    void Rotate(Camera &outCamera, F64 inDeltaVertical, F64 inDeltaHorizontal)
+    {
+        F32 fX = static_cast<F32>(inDeltaVertical);
+        F32 fY = static_cast<F32>(inDeltaHorizontal);
+
+        F32 xOffset = fX - outCamera.LastX;
+        F32 yOffset = outCamera.LastY - fY;
+
+        outCamera.LastX = fX;
+        outCamera.LastY = fY;
+
+        xOffset *= outCamera.MouseSpeed;
+        yOffset *= outCamera.MouseSpeed;
+
+        outCamera.Yaw += xOffset;
+        outCamera.Pitch += yOffset;
+        outCamera.Pitch = glm::clamp(outCamera.Pitch, -89.0f, 89.0f);
+    }
+
+    F32 ProjectedScreenSize(const AABB &inBounds, const glm::mat4 &inModel, const Camera &inCamera, F32 inViewportHeight)
+    {
+        const glm::vec3 center = glm::vec3(inModel * glm::vec4(inBounds.Center, 1.0f));
+
+        const F32 scale = std::max(glm::length(glm::vec3(inModel[0])), std::max(glm::length(glm::vec3(inModel[1])), glm::length(glm::vec3(inModel[2]))));
+        const F32 radius = glm::length(inBounds.Dimensions) * 0.5f * scale;
+        const F32 distance = glm::length(center - inCamera.Position);
+
+        if (distance <= radius)
+        {
+            return std::numeric_limits<F32>::max();
+        }
+
+        // tangent of the sphere's half angle against the vertical half field of view
+        const F32 halfAngle = radius / std::sqrt(distance * distance - radius * radius);
+        return inViewportHeight * halfAngle / std::tan(glm::radians(inCamera.Fov) * 0.5f);
+    }
+
+    U32 SelectLOD(const Geometry &inGeometry, const glm::mat4 &inModel, const Camera &inCamera, F32 inViewportHeight, F32 inPixelError)
+    {
+        // the bounding sphere spans about one diagonal on screen, LOD errors are fractions of it
+        const F32 screenSize = ProjectedScreenSize(inGeometry.Bounds, inModel, inCamera, inViewportHeight);
+        U32 lod = 0;
+
+        while (lod < inGeometry.LODs.size() && inGeometry.LODs[lod].Error * screenSize <= inPixelError)
+        {
+            ++lod;
+        }
+
+        return lod;
+    }
+
+    Frustum ExtractFrustum(const glm::mat4 &inMatrix)
+    {
+        const glm::vec4 rowX(inMatrix[0][0], inMatrix[1][0], inMatrix[2][0], inMatrix[3][0]);
+        const glm::vec4 rowY(inMatrix[0][1], inMatrix[1][1], inMatrix[2][1], inMatrix[3][1]);
+        const glm::vec4 rowZ(inMatrix[0][2], inMatrix[1][2], inMatrix[2][2], inMatrix[3][2]);
+        const glm::vec4 rowW(inMatrix[0][3], inMatrix[1][3], inMatrix[2][3], inMatrix[3][3]);
+
+        Frustum frustum;
+        frustum.Planes[0] = rowW + rowX;
+        frustum.Planes[1] = rowW - rowX;
+        frustum.Planes[2] = rowW + rowY;
+        frustum.Planes[3] = rowW - rowY;
+        frustum.Planes[4] = rowW + rowZ;
+        frustum.Planes[5] = rowW - rowZ;
+
+        for (glm::vec4 &plane : frustum.Planes)
+        {
+            const F32 length = glm::length(glm::vec3(plane));
+            plane = length > 0.0f ? plane / length : plane;
+        }
+
+        return frustum;
+    }
+
+    bool IsMeshletVisible(const Meshlet &inMeshlet, const Frustum &inFrustum, const glm::vec3 &inEye)
+    {
+        for (const glm::vec4 &plane : inFrustum.Planes)
+        {
+            if (glm::dot(glm::vec3(plane), inMeshlet.Center) + plane.w < -inMeshlet.Radius)
+            {
+                return false;
+            }
+        }
+
+        // a cutoff above 1 never passes, an eye on the apex gives NaN and passes neither
+        return !(glm::dot(glm::normalize(inMeshlet.ConeApex - inEye), inMeshlet.ConeAxis) >= inMeshlet.ConeCutoff);
+    }
+
+    U32 CullMeshlets(const Geometry &inGeometry, const glm::mat4 &inModel, const glm::mat4 &inViewProjection, const glm::vec3 &inEye,
+                     std::vector< U32 > &outVisible)
+    {
+        Profile profile("CullMeshlets", Profile::CPU);
+
+        // planes and eye go to model space instead of every meshlet to world space, which also holds under non uniform scale
+        const Frustum frustum = ExtractFrustum(inViewProjection * inModel);
+        const glm::vec3 eye = glm::vec3(glm::inverse(inModel) * glm::vec4(inEye, 1.0f));
+
+        outVisible.clear();
+
+        for (U32 i = 0; i < inGeometry.Meshlets.size(); ++i)
+        {
+            if (IsMeshletVisible(inGeometry.Meshlets[i], frustum, eye))
+            {
+                outVisible.push_back(i);
+            }
+        }
+
+        return static_cast<U32>(outVisible.size());
+    }
+
+    /* Vertex Array Object */
+
+    U32 GenerateVAO()
+    {
+        U32 vao = 0;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        GPF_GL_STAT(VAOBinds, 1);
+        return vao;
+    }
+
+    void BindVAO(U32 inID)
+    {
+        glBindVertexArray(inID);
+        GPF_GL_STAT(VAOBinds, 1);
+    }
+
+    void DeleteVAO(U32& outVAO)
+    {
+        if (outVAO)
+        {
+            glDeleteVertexArrays(1, &outVAO);
+            outVAO = 0;
+        }
+    }
+
+    /* Buffer Object */
+
+    U32 GenerateBuffer(BufferType inType)
+    {
+        U32 bufferID = 0;
+        glGenBuffers(1, &bufferID);
+        glBindBuffer(BufferToGlBuffer(inType), bufferID);
+        GPF_GL_STAT(BufferBinds, 1);
+        return bufferID;
+    }
+
+    void BindBuffer(BufferType inType, U32 inID)
+    {
+        glBindBuffer(BufferToGlBuffer(inType), inID);
+        GPF_GL_STAT(BufferBinds, 1);
+    }
+
+    void UploadData(BufferType inType, BufferUsage inUsage, const void* inData, size_t inSize)
+    {
+        const auto target = BufferToGlBuffer(inType);
+        const auto usage = BufferUsageToGlBufferUsage(inUsage);
+        const auto size = static_cast<GLsizeiptr>( inSize );
+
+        glBufferData(target, size, inData, usage);
+
+        GPF_GL_STAT(BufferUploads, 1);
+        GPF_GL_STAT(BufferBytesUploaded, inSize);
+    }
+
+    void UploadDataImmutable(BufferType inType, const void* inData, size_t inSize)
+    {
+        #ifdef __APPLE__
+            // no ARB_buffer_storage on a 4.1 context
+            UploadData(inType, BufferUsage::StaticDraw, inData, inSize);
+        #else
+            const auto target = BufferToGlBuffer(inType);
+            const auto size = static_cast<GLsizeiptr>( inSize );
+
+            const auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+            glBufferStorage(target, size, NULL, flags);
+
+            void* gpu = glMapBuffer(target, GL_WRITE_ONLY);
+            memcpy(gpu, inData, size);
+            glUnmapBuffer(target);
+
+            GPF_GL_STAT(BufferUploads, 1);
+            GPF_GL_STAT(BufferBytesUploaded, inSize);
+        #endif
+    }
+
+    void InvalidateBuffer(U32 inBufferID)
+    {
+        glInvalidateBufferData(inBufferID);
+    }
+
+    void DeleteBuffer(U32& outBuffer)
+    {
+        if (outBuffer)
+        {
+            glDeleteBuffers(1, &outBuffer);
+            outBuffer = 0;
+        }
+	}
+
+    /* Textures */
+
+    // Sets GL_UNPACK_ALIGNMENT for the scope, the caller's value is put back on exit.
+    struct ScopedUnpackAlignment
+    {
+        GLint Previous = 4;
+
+        explicit ScopedUnpackAlignment(GLint inAlignment)
+        {
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &Previous);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, inAlignment);
+        }
+
+        ~ScopedUnpackAlignment()
+        {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, Previous);
+        }
+    };
+
+    bool HasDirectStateAccess()
+    {
+        #ifdef __APPLE__
+            return false;
+        #else
+            // glewInit has to have run, the answer does not change for the context
+            static const bool hasDSA = GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access;
+            return hasDSA;
+        #endif
+    }
+
+    U32 GenerateTexture(GLenum inTarget)
+    {
+        U32 textureID = 0;
+
+        #ifndef __APPLE__
+            if (HasDirectStateAccess())
+            {
+                glCreateTextures(inTarget, 1, &textureID);
+                return textureID;
+            }
+        #endif
+
+        (void)inTarget;
+        glGenTextures(1, &textureID);
+        return textureID;
+    }
+
+    GLenum ComponentsToFormat(I32 inComponents)
+    {
+        switch (inComponents)
+        {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 3: return GL_RGB;
+        }
+        return GL_RGBA;
+    }
+
+    GLenum SizedInternalFormat(I32 inComponents, bool inSRGB)
+    {
+        switch (inComponents)
+        {
+        case 1: return GL_R8;
+        case 2: return GL_RG8;
+        case 3: return inSRGB ? GL_SRGB8 : GL_RGB8;
+        }
+        return inSRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+
+    GLenum SizedInternalFormat(GLenum inInternalFormat, GLenum inType)
+    {
+        const bool isHalf = inType == GL_HALF_FLOAT;
+        const bool isFloat = inType == GL_FLOAT;
+
+        switch (inInternalFormat)
+        {
+        case GL_RED: return isFloat ? GL_R32F : (isHalf ? GL_R16F : GL_R8);
+        case GL_RG: return isFloat ? GL_RG32F : (isHalf ? GL_RG16F : GL_RG8);
+        case GL_RGB: return isFloat ? GL_RGB32F : (isHalf ? GL_RGB16F : GL_RGB8);
+        case GL_RGBA: return isFloat ? GL_RGBA32F : (isHalf ? GL_RGBA16F : GL_RGBA8);
+        case GL_DEPTH_COMPONENT: return isFloat ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24;
+        case GL_DEPTH_STENCIL: return isFloat ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+        }
+
+        return inInternalFormat;
+    }
+
+    // Format / type pair accepted for a null upload of a sized internal format.
+    static void StorageFormat(GLenum inInternalFormat, GLenum &outFormat, GLenum &outType)
+    {
+        outType = GL_UNSIGNED_BYTE;
+
+        switch (inInternalFormat)
+        {
+        case GL_R8: case GL_R16F: case GL_R32F: outFormat = GL_RED; break;
+        case GL_RG8: case GL_RG16F: case GL_RG32F: outFormat = GL_RG; break;
+        case GL_RGB8: case GL_SRGB8: case GL_RGB16F: case GL_RGB32F: outFormat = GL_RGB; break;
+        case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: outFormat = GL_DEPTH_COMPONENT; outType = GL_FLOAT; break;
+        case GL_DEPTH24_STENCIL8: outFormat = GL_DEPTH_STENCIL; outType = GL_UNSIGNED_INT_24_8; break;
+        case GL_DEPTH32F_STENCIL8: outFormat = GL_DEPTH_STENCIL; outType = GL_FLOAT_32_UNSIGNED_INT_24_8_REV; break;
+        default: outFormat = GL_RGBA; break;
+        }
+    }
+
+    void AllocateTextureStorage(U32 inTextureID, U32 inWidth, U32 inHeight, U32 inLevels, GLenum inInternalFormat)
+    {
+        #ifndef __APPLE__
+            if (HasDirectStateAccess())
+            {
+                glTextureStorage2D(inTextureID, static_cast<GLsizei>(inLevels), inInternalFormat, static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight));
+                return;
+            }
+        #endif
+
+        // no glTexStorage2D before 4.2, allocate every level mutable instead
+        GLenum format = GL_RGBA;
+        GLenum type = GL_UNSIGNED_BYTE;
+        StorageFormat(inInternalFormat, format, type);
+
+        glBindTexture(GL_TEXTURE_2D, inTextureID);
+
+        for (U32 i = 0; i < inLevels; ++i)
+        {
+            const GLsizei width = static_cast<GLsizei>(std::max(inWidth >> i, 1u));
+            const GLsizei height = static_cast<GLsizei>(std::max(inHeight >> i, 1u));
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), static_cast<GLint>(inInternalFormat), width, height, 0, format, type, nullptr);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(inLevels) - 1);
+        GPF_GL_STAT(TextureBinds, 1);
+    }
+
+    #ifndef __APPLE__
+    // Whether the immutable storage of a DSA texture already is inWidth x inHeight, inLevels levels of inInternalFormat.
+    static bool HasTextureStorage(U32 inTextureID, U32 inWidth, U32 inHeight, U32 inLevels, GLenum inInternalFormat)
+    {
+        GLint isImmutable = GL_FALSE;
+        GLint levels = 0;
+        GLint width = 0;
+        GLint height = 0;
+        GLint internalFormat = 0;
+
+        glGetTextureParameteriv(inTextureID, GL_TEXTURE_IMMUTABLE_FORMAT, &isImmutable);
+        glGetTextureParameteriv(inTextureID, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+        glGetTextureLevelParameteriv(inTextureID, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTextureLevelParameteriv(inTextureID, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTextureLevelParameteriv(inTextureID, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+
+        return isImmutable == GL_TRUE && static_cast<U32>(levels) == inLevels && static_cast<U32>(width) == inWidth &&
+               static_cast<U32>(height) == inHeight && static_cast<GLenum>(internalFormat) == inInternalFormat;
+    }
+    #endif
+
+    // Immutable storage is allocated once per texture object. An upload into a texture that already has storage of
+    // the same shape reuses it, any other shape replaces outTextureID with a new texture, as glTexImage2D used to.
+    static void EnsureTextureStorage(U32 &outTextureID, U32 inWidth, U32 inHeight, U32 inLevels, GLenum inInternalFormat)
+    {
+        if (outTextureID == 0)
+        {
+            outTextureID = GenerateTexture(GL_TEXTURE_2D);
+        }
+
+        #ifndef __APPLE__
+            if (HasDirectStateAccess())
+            {
+                // a glGenTextures name has no object until it is first bound
+                if (glIsTexture(outTextureID) == GL_FALSE)
+                {
+                    glBindTexture(GL_TEXTURE_2D, outTextureID);
+                    GPF_GL_STAT(TextureBinds, 1);
+                }
+
+                GLint isImmutable = GL_FALSE;
+                glGetTextureParameteriv(outTextureID, GL_TEXTURE_IMMUTABLE_FORMAT, &isImmutable);
+
+                if (isImmutable == GL_TRUE)
+                {
+                    if (HasTextureStorage(outTextureID, inWidth, inHeight, inLevels, inInternalFormat))
+                    {
+                        return;
+                    }
+
+                    glDeleteTextures(1, &outTextureID);
+                    outTextureID = GenerateTexture(GL_TEXTURE_2D);
+                }
+            }
+        #endif
+
+        // mutable fallback storage can simply be specified again
+        AllocateTextureStorage(outTextureID, inWidth, inHeight, inLevels, inInternalFormat);
+    }
+
+    void UpdateTextureData(U32 inTextureID, U32 inLevel, I32 inX, I32 inY, U32 inWidth, U32 inHeight, GLenum inFormat, GLenum inType, const void *inData)
+    {
+        #ifndef __APPLE__
+        if (HasDirectStateAccess())
+        {
+            glTextureSubImage2D(inTextureID, static_cast<GLint>(inLevel), inX, inY, static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight), inFormat, inType, inData);
+        }
+        else
+        #endif
+        {
+            glBindTexture(GL_TEXTURE_2D, inTextureID);
+            glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(inLevel), inX, inY, static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight), inFormat, inType, inData);
+            GPF_GL_STAT(TextureBinds, 1);
+        }
+
+        GPF_GL_STAT(TextureUploads, 1);
+        GPF_GL_STAT(TextureBytesUploaded, static_cast<U64>(inWidth) * inHeight * PixelComponents(inFormat) * TypeSize(inType));
+    }
+
+    void UpdateCompressedTextureData(U32 inTextureID, U32 inLevel, U32 inWidth, U32 inHeight, GLenum inInternalFormat, const void *inData, size_t inSize)
+    {
+        #ifndef __APPLE__
+        if (HasDirectStateAccess())
+        {
+            glCompressedTextureSubImage2D(inTextureID, static_cast<GLint>(inLevel), 0, 0, static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight),
+                                          inInternalFormat, static_cast<GLsizei>(inSize), inData);
+        }
+        else
+        #endif
+        {
+            glBindTexture(GL_TEXTURE_2D, inTextureID);
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(inLevel), 0, 0, static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight),
+                                      inInternalFormat, static_cast<GLsizei>(inSize), inData);
+            GPF_GL_STAT(TextureBinds, 1);
+        }
+
+        GPF_GL_STAT(TextureUploads, 1);
+        GPF_GL_STAT(TextureBytesUploaded, inSize);
+    }
+
+    void AllocateTextureArrayStorage(U32 inTextureID, U32 inWidth, U32 inHeight, U32 inLayers, U32 inLevels, GLenum inInternalFormat)
+    {
+        #ifndef __APPLE__
+            if (HasDirectStateAccess())
+            {
+                glTextureStorage3D(inTextureID, static_cast<GLsizei>(inLevels), inInternalFormat, static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight), static_cast<GLsizei>(inLayers));
+                return;
+            }
+        #endif
+
+        GLenum format = GL_RGBA;
+        GLenum type = GL_UNSIGNED_BYTE;
+        StorageFormat(inInternalFormat, format, type);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, inTextureID);
+
+        for (U32 i = 0; i < inLevels; ++i)
+        {
+            const GLsizei width = static_cast<GLsizei>(std::max(inWidth >> i, 1u));
+            const GLsizei height = static_cast<GLsizei>(std::max(inHeight >> i, 1u));
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(i), static_cast<GLint>(inInternalFormat), width, height, static_cast<GLsizei>(inLayers), 0, format, type, nullptr);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(inLevels) - 1);
+        GPF_GL_STAT(TextureBinds, 1);
+    }
+
+    void UpdateTextureArrayData(U32 inTextureID, U32 inLevel, U32 inLayer, I32 inX, I32 inY, U32 inWidth, U32 inHeight, GLenum inFormat, GLenum inType, const void *inData)
+    {
+        #ifndef __APPLE__
+        if (HasDirectStateAccess())
+        {
+            glTextureSubImage3D(inTextureID, static_cast<GLint>(inLevel), inX, inY, static_cast<GLint>(inLayer),
+                                static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight), 1, inFormat, inType, inData);
+        }
+        else
+        #endif
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, inTextureID);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(inLevel), inX, inY, static_cast<GLint>(inLayer),
+                            static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight), 1, inFormat, inType, inData);
+            GPF_GL_STAT(TextureBinds, 1);
+        }
+
+        GPF_GL_STAT(TextureUploads, 1);
+        GPF_GL_STAT(TextureBytesUploaded, static_cast<U64>(inWidth) * inHeight * PixelComponents(inFormat) * TypeSize(inType));
+    }
+
+    void UploadTextureData( const Image &inImage, U32 &outTextureID, bool inGenerateMipMaps, bool inSRGB )
+    {
+        const GLenum format = ComponentsToFormat(inImage.Components);
+        const GLenum internalFormat = SizedInternalFormat(inImage.Components, inSRGB);
+
+        if (!inGenerateMipMaps)
+        {
+            if (!inImage.Data || inImage.Width <= 0 || inImage.Height <= 0)
+            {
+                return;
+            }
+
+            // a single level goes up straight from the image, no chain to copy it into
+            EnsureTextureStorage(outTextureID, inImage.Width, inImage.Height, 1, internalFormat);
+
+            ScopedUnpackAlignment unpackAlignment(1);
+            UpdateTextureData(outTextureID, 0, 0, 0, inImage.Width, inImage.Height, format, GL_UNSIGNED_BYTE, inImage.Data);
+            return;
+        }
+
+        // filtered on the CPU instead of glGenerateMipmap, see GenerateMipChain
+        MipChain chain;
+        MipOptions options;
+        options.SRGB = inSRGB;
+
+        if (!GenerateMipChain(inImage, options, chain))
+        {
+            return;
+        }
+
+        EnsureTextureStorage(outTextureID, inImage.Width, inImage.Height, static_cast<U32>(chain.Levels.size()), internalFormat);
+
+        ScopedUnpackAlignment unpackAlignment(1);
+
+        for (U32 i = 0; i < chain.Levels.size(); ++i)
+        {
+            const TextureLevel &level = chain.Levels[i];
+            UpdateTextureData(outTextureID, i, 0, 0, level.Width, level.Height, format, GL_UNSIGNED_BYTE, chain.Storage.data() + level.Offset);
+        }
+    }
+
+    void UploadTextureData( const void * inData,
+                            U32 inWidth, 
+                            U32 inHeight, 
+                            U32 &outTextureID, 
+                            GLenum inType,
+                            GLenum inInternalFormat, 
+                            GLenum inFormat )
+    {
+        EnsureTextureStorage(outTextureID, inWidth, inHeight, 1, SizedInternalFormat(inInternalFormat, inType));
+
+        if (inData)
+        {
+            UpdateTextureData(outTextureID, 0, 0, 0, inWidth, inHeight, inFormat, inType, inData);
+        }
+    }
+
+    void BindTexture(U32 inTextureID, U32 inTextureUnit, GLenum inTarget)
+    {
+        glActiveTexture(GL_TEXTURE0 + inTextureUnit);
+        glBindTexture(inTarget, inTextureID);
+
+        GPF_GL_STAT(TextureBinds, 1);
+    }
+
+    void DeleteTexture(U32 &outID)
+    {
+        if (outID)
+        {
+            glDeleteTextures(1, &outID);
+            outID = 0;
+        }
+    }
+
+    /* Samplers */
+
+    U32 GenerateSampler()
+    {
+        U32 samplerID = 0;
+        glGenSamplers(1, &samplerID);
+        return samplerID;
+    }
+
+    void SetupSamplerParameters(const SamplerParameters &inParameters, U32 inSamplerID)
+    {
+        glSamplerParameteri(inSamplerID, GL_TEXTURE_WRAP_S, inParameters.WrapS);
+        glSamplerParameteri(inSamplerID, GL_TEXTURE_WRAP_T, inParameters.WrapT);
+        glSamplerParameteri(inSamplerID, GL_TEXTURE_MAG_FILTER, inParameters.MagFilter);
+        glSamplerParameteri(inSamplerID, GL_TEXTURE_MIN_FILTER, inParameters.MinFilter);
+        glSamplerParameterf(inSamplerID, GL_TEXTURE_MAX_ANISOTROPY_EXT, inParameters.MaxAnisotropy);
+    }
+
+    void BindSampler( U32 inSamplerID, U32 inTextureUnit )
+    {
+        glBindSampler(inTextureUnit, inSamplerID);
+        GPF_GL_STAT(SamplerBinds, 1);
+    }
+
+    void UnbindSampler( U32 inTextureUnit )
+    {
+        glBindSampler(inTextureUnit, 0);
+        GPF_GL_STAT(SamplerBinds, 1);
+    }
+
+    void DeleteSampler(U32 &outSampler)
+    {
+        if (outSampler != 0)
+        {
+            glDeleteSamplers(1, &outSampler);
+            outSampler = 0;
+        }
+    }
+
+    /* Texture compression */
+
+    TextureCompression ChooseCompression(TextureUsage inUsage, bool inHighQuality)
+    {
+        switch (inUsage)
+        {
+        case TextureUsage::Albedo: return inHighQuality ? TextureCompression::BC7 : TextureCompression::BC1;
+        case TextureUsage::AlbedoAlpha: return inHighQuality ? TextureCompression::BC7 : TextureCompression::BC3;
+        case TextureUsage::Normal: return TextureCompression::BC5;
+        case TextureUsage::Mask: return TextureCompression::BC4;
+        }
+        return TextureCompression::BC1;
+    }
+
+    GLenum CompressionToGL(TextureCompression inFormat, bool inSRGB)
+    {
+        switch (inFormat)
+        {
+        case TextureCompression::BC1: return inSRGB ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TextureCompression::BC3: return inSRGB ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TextureCompression::BC4: return GL_COMPRESSED_RED_RGTC1;
+        case TextureCompression::BC5: return GL_COMPRESSED_RG_RGTC2;
+        case TextureCompression::BC7: return inSRGB ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case TextureCompression::None: break;
+        }
+        return GL_NONE;
+    }
+
+    size_t CompressedBlockSize(TextureCompression inFormat)
+    {
+        switch (inFormat)
+        {
+        case TextureCompression::BC1:
+        case TextureCompression::BC4:
+            return 8;
+        case TextureCompression::BC3:
+        case TextureCompression::BC5:
+        case TextureCompression::BC7:
+            return 16;
+        case TextureCompression::None:
+            break;
+        }
+        return 0;
+    }
+
+    size_t CompressedImageSize(TextureCompression inFormat, I32 inWidth, I32 inHeight)
+    {
+        const size_t blocksX = static_cast<size_t>( (std::max(inWidth, 1) + 3) / 4 );
+        const size_t blocksY = static_cast<size_t>( (std::max(inHeight, 1) + 3) / 4 );
+        return blocksX * blocksY * CompressedBlockSize(inFormat);
+    }
+
+    // The block encoders below work on fixed 16 texel arrays in straight loops, which the
+    // compiler vectorizes, throughput comes from running block rows in parallel.
+
+    static inline void FetchBlock(const U8 *inData, I32 inWidth, I32 inHeight, I32 inComponents, I32 inBlockX, I32 inBlockY, U8 outBlock[16][4])
+    {
+        for (I32 y = 0; y < 4; ++y)
+        {
+            const I32 sy = std::min(inBlockY * 4 + y, inHeight - 1);
+
+            for (I32 x = 0; x < 4; ++x)
+            {
+                const I32 sx = std::min(inBlockX * 4 + x, inWidth - 1);
+                const U8 *texel = inData + (static_cast<size_t>(sy) * inWidth + sx) * inComponents;
+                U8 *out = outBlock[y * 4 + x];
+
+                switch (inComponents)
+                {
+                case 1: out[0] = out[1] = out[2] = texel[0]; out[3] = 255; break;
+                case 2: out[0] = out[1] = out[2] = texel[0]; out[3] = texel[1]; break;
+                case 3: out[0] = texel[0]; out[1] = texel[1]; out[2] = texel[2]; out[3] = 255; break;
+                default: out[0] = texel[0]; out[1] = texel[1]; out[2] = texel[2]; out[3] = texel[3]; break;
+                }
+            }
+        }
+    }
+
+    // Principal axis of the block colors through power iteration, returns false for flat blocks.
+    template<I32 N>
+    static inline bool PrincipalAxis(const F32 inTexels[16][4], F32 outMean[N], F32 outAxis[N])
+    {
+        for (I32 c = 0; c < N; ++c)
+        {
+            outMean[c] = 0.0f;
+
+            for (I32 i = 0; i < 16; ++i)
+            {
+                outMean[c] += inTexels[i][c];
+            }
+
+            outMean[c] /= 16.0f;
+        }
+
+        F32 covariance[N][N] = {};
+
+        for (I32 i = 0; i < 16; ++i)
+        {
+            F32 d[N];
+            for (I32 c = 0; c < N; ++c)
+            {
+                d[c] = inTexels[i][c] - outMean[c];
+            }
+
+            for (I32 r = 0; r < N; ++r)
+            {
+                for (I32 c = 0; c < N; ++c)
+                {
+                    covariance[r][c] += d[r] * d[c];
+                }
+            }
+        }
+
+        // start from the channel with the largest variance
+        I32 largest = 0;
+        for (I32 c = 1; c < N; ++c)
+        {
+            if (covariance[c][c] > covariance[largest][largest])
+            {
+                largest = c;
+            }
+        }
+
+        if (covariance[largest][largest] < 1e-4f)
+        {
+            return false;
+        }
+
+        for (I32 c = 0; c < N; ++c)
+        {
+            outAxis[c] = covariance[largest][c];
+        }
+
+        for (I32 iteration = 0; iteration < 8; ++iteration)
+        {
+            F32 next[N] = {};
+            F32 scale = 0.0f;
+
+            for (I32 r = 0; r < N; ++r)
+            {
+                for (I32 c = 0; c < N; ++c)
+                {
+                    next[r] += covariance[r][c] * outAxis[c];
+                }
+
+                scale = std::max(scale, std::fabs(next[r]));
+            }
+
+            if (scale < 1e-8f)
+            {
+                return false;
+            }
+
+            for (I32 c = 0; c < N; ++c)
+            {
+                outAxis[c] = next[c] / scale;
+            }
+        }
+
+        return true;
+    }
+
+    template<I32 N>
+    static inline void AxisEndpoints(const F32 inTexels[16][4], F32 outStart[N], F32 outEnd[N])
+    {
+        F32 mean[N];
+        F32 axis[N];
+
+        if (!PrincipalAxis<N>(inTexels, mean, axis))
+        {
+            for (I32 c = 0; c < N; ++c)
+            {
+                outStart[c] = outEnd[c] = mean[c];
+            }
+            return;
+        }
+
+        F32 axisLength = 0.0f;
+        for (I32 c = 0; c < N; ++c)
+        {
+            axisLength += axis[c] * axis[c];
+        }
+
+        F32 minT = std::numeric_limits<F32>::max();
+        F32 maxT = -std::numeric_limits<F32>::max();
+
+        for (I32 i = 0; i < 16; ++i)
+        {
+            F32 t = 0.0f;
+            for (I32 c = 0; c < N; ++c)
+            {
+                t += (inTexels[i][c] - mean[c]) * axis[c];
+            }
+
+            t /= axisLength;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (I32 c = 0; c < N; ++c)
+        {
+            outStart[c] = glm::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+            outEnd[c] = glm::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+        }
+    }
+
+    // Least squares endpoints for fixed per texel weights of the start endpoint.
+    template<I32 N>
+    static inline bool FitEndpoints(const F32 inTexels[16][4], const F32 inWeights[16], F32 outStart[N], F32 outEnd[N])
+    {
+        F32 aa = 0.0f;
+        F32 ab = 0.0f;
+        F32 bb = 0.0f;
+        F32 ax[N] = {};
+        F32 bx[N] = {};
+
+        for (I32 i = 0; i < 16; ++i)
+        {
+            const F32 a = inWeights[i];
+            const F32 b = 1.0f - a;
+
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+
+            for (I32 c = 0; c < N; ++c)
+            {
+                ax[c] += a * inTexels[i][c];
+                bx[c] += b * inTexels[i][c];
+            }
+        }
+
+        const F32 determinant = aa * bb - ab * ab;
+
+        if (std::fabs(determinant) < 1e-6f)
+        {
+            return false;
+        }
+
+        for (I32 c = 0; c < N; ++c)
+        {
+            outStart[c] = glm::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+            outEnd[c] = glm::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+        }
+
+        return true;
+    }
+
+    static inline U16 PackRGB565(const F32 inColor[3])
+    {
+        const U32 r = static_cast<U32>(inColor[0] * (31.0f / 255.0f) + 0.5f);
+        const U32 g = static_cast<U32>(inColor[1] * (63.0f / 255.0f) + 0.5f);
+        const U32 b = static_cast<U32>(inColor[2] * (31.0f / 255.0f) + 0.5f);
+        return static_cast<U16>((r << 11) | (g << 5) | b);
+    }
+
+    static inline void UnpackRGB565(U16 inColor, I32 outColor[3])
+    {
+        const I32 r = (inColor >> 11) & 31;
+        const I32 g = (inColor >> 5) & 63;
+        const I32 b = inColor & 31;
+
+        outColor[0] = (r << 3) | (r >> 2);
+        outColor[1] = (g << 2) | (g >> 4);
+        outColor[2] = (b << 3) | (b >> 2);
+    }
+
+    // Picks the closest of the four BC1 colors per texel, returns the squared error.
+    static inline U32 SelectColorIndices(const F32 inTexels[16][4], U16 inColor0, U16 inColor1, U8 outIndices[16])
+    {
+        I32 palette[4][3];
+        UnpackRGB565(inColor0, palette[0]);
+        UnpackRGB565(inColor1, palette[1]);
+
+        for (I32 c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        U32 totalError = 0;
+
+        for (I32 i = 0; i < 16; ++i)
+        {
+            U32 bestError = std::numeric_limits<U32>::max();
+
+            for (U8 p = 0; p < 4; ++p)
+            {
+                U32 error = 0;
+                for (I32 c = 0; c < 3; ++c)
+                {
+                    const I32 d = static_cast<I32>(inTexels[i][c]) - palette[p][c];
+                    error += static_cast<U32>(d * d);
+                }
+
+                if (error < bestError)
+                {
+                    bestError = error;
+                    outIndices[i] = p;
+                }
+            }
+
+            totalError += bestError;
+        }
+
+        return totalError;
+    }
+
+    static void EncodeColorBlock(const U8 inBlock[16][4], U8 *outBlock)
+    {
+        static const F32 kWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+        F32 texels[16][4];
+        for (I32 i = 0; i < 16; ++i)
+        {
+            for (I32 c = 0; c < 4; ++c)
+            {
+                texels[i][c] = inBlock[i][c];
+            }
+        }
+
+        F32 start[3];
+        F32 end[3];
+        AxisEndpoints<3>(texels, start, end);
+
+        U16 color0 = PackRGB565(start);
+        U16 color1 = PackRGB565(end);
+        U8 indices[16];
+        U32 error = SelectColorIndices(texels, color0, color1, indices);
+
+        // one least squares refinement, kept only when it helps
+        F32 weights[16];
+        for (I32 i = 0; i < 16; ++i)
+        {
+            weights[i] = kWeights[indices[i]];
+        }
+
+        if (error > 0 && FitEndpoints<3>(texels, weights, start, end))
+        {
+            const U16 refined0 = PackRGB565(start);
+            const U16 refined1 = PackRGB565(end);
+            U8 refinedIndices[16];
+            const U32 refinedError = SelectColorIndices(texels, refined0, refined1, refinedIndices);
+
+            if (refinedError < error)
+            {
+                color0 = refined0;
+                color1 = refined1;
+                std::memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        // four color mode needs color0 > color1
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+
+            for (I32 i = 0; i < 16; ++i)
+            {
+                indices[i] ^= 1;
+            }
+        }
+        else if (color0 == color1)
+        {
+            std::memset(indices, 0, sizeof(indices));
+        }
+
+        U32 packedIndices = 0;
+        for (I32 i = 0; i < 16; ++i)
+        {
+            packedIndices |= static_cast<U32>(indices[i]) << (i * 2);
+        }
+
+        outBlock[0] = static_cast<U8>(color0 & 0xFF);
+        outBlock[1] = static_cast<U8>(color0 >> 8);
+        outBlock[2] = static_cast<U8>(color1 & 0xFF);
+        outBlock[3] = static_cast<U8>(color1 >> 8);
+        outBlock[4] = static_cast<U8>(packedIndices & 0xFF);
+        outBlock[5] = static_cast<U8>((packedIndices >> 8) & 0xFF);
+        outBlock[6] = static_cast<U8>((packedIndices >> 16) & 0xFF);
+        outBlock[7] = static_cast<U8>(packedIndices >> 24);
+    }
+
+    static void EncodeChannelBlock(const U8 inBlock[16][4], I32 inChannel, U8 *outBlock)
+    {
+        U8 minValue = 255;
+        U8 maxValue = 0;
+
+        for (I32 i = 0; i < 16; ++i)
+        {
+            minValue = std::min(minValue, inBlock[i][inChannel]);
+            maxValue = std::max(maxValue, inBlock[i][inChannel]);
+        }
+
+        // eight value mode, index 0 = max, 1 = min, 2..7 interpolate from max to min
+        outBlock[0] = maxValue;
+        outBlock[1] = minValue;
+
+        U64 packedIndices = 0;
+
+        if (maxValue > minValue)
+        {
+            const F32 scale = 7.0f / static_cast<F32>(maxValue - minValue);
+
+            for (I32 i = 0; i < 16; ++i)
+            {
+                const I32 step = static_cast<I32>((inBlock[i][inChannel] - minValue) * scale + 0.5f);
+                const U64 index = step == 7 ? 0 : (step == 0 ? 1 : static_cast<U64>(8 - step));
+                packedIndices |= index << (i * 3);
+            }
+        }
+
+        for (I32 i = 0; i < 6; ++i)
+        {
+            outBlock[2 + i] = static_cast<U8>((packedIndices >> (i * 8)) & 0xFF);
+        }
+    }
+
+    struct BlockBitWriter
+    {
+        U64 Bits[2] = {};
+        U32 Position = 0;
+
+        void Write(U32 inValue, U32 inCount)
+        {
+            for (U32 i = 0; i < inCount; ++i, ++Position)
+            {
+                Bits[Position >> 6] |= static_cast<U64>((inValue >> i) & 1) << (Position & 63);
+            }
+        }
+    };
+
+    static const I32 kBC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // Endpoint as 7 bits per channel plus a shared p-bit, picks the p-bit with the lower error.
+    static inline void QuantizeBC7Endpoint(const F32 inEndpoint[4], U32 outQuantized[4], U32 &outPBit)
+    {
+        F32 bestError = std::numeric_limits<F32>::max();
+
+        for (U32 p = 0; p < 2; ++p)
+        {
+            U32 quantized[4];
+            F32 error = 0.0f;
+
+            for (I32 c = 0; c < 4; ++c)
+            {
+                const I32 q = glm::clamp(static_cast<I32>((inEndpoint[c] - p) * 0.5f + 0.5f), 0, 127);
+                const F32 d = static_cast<F32>((q << 1) | p) - inEndpoint[c];
+
+                quantized[c] = static_cast<U32>(q);
+                error += d * d;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                outPBit = p;
+                std::memcpy(outQuantized, quantized, sizeof(quantized));
+            }
+        }
+    }
+
+    static inline U32 SelectBC7Indices(const F32 inTexels[16][4], const U32 inE0[4], U32 inP0, const U32 inE1[4], U32 inP1, U8 outIndices[16])
+    {
+        I32 palette[16][4];
+
+        for (I32 c = 0; c < 4; ++c)
+        {
+            const I32 e0 = static_cast<I32>((inE0[c] << 1) | inP0);
+            const I32 e1 = static_cast<I32>((inE1[c] << 1) | inP1);
+
+            for (I32 i = 0; i < 16; ++i)
+            {
+                palette[i][c] = ((64 - kBC7Weights4[i]) * e0 + kBC7Weights4[i] * e1 + 32) >> 6;
+            }
+        }
+
+        U32 totalError = 0;
+
+        for (I32 t = 0; t < 16; ++t)
+        {
+            U32 bestError = std::numeric_limits<U32>::max();
+
+            for (U8 i = 0; i < 16; ++i)
+            {
+                U32 error = 0;
+                for (I32 c = 0; c < 4; ++c)
+                {
+                    const I32 d = static_cast<I32>(inTexels[t][c]) - palette[i][c];
+                    error += static_cast<U32>(d * d);
+                }
+
+                if (error < bestError)
+                {
+                    bestError = error;
+                    outIndices[t] = i;
+                }
+            }
+
+            totalError += bestError;
+        }
+
+        return totalError;
+    }
+
+    // BC7 mode 6: one subset, RGBA endpoints, 4 bit indices.
+    static void EncodeBC7Block(const U8 inBlock[16][4], U8 *outBlock)
+    {
+        F32 texels[16][4];
+        for (I32 i = 0; i < 16; ++i)
+        {
+            for (I32 c = 0; c < 4; ++c)
+            {
+                texels[i][c] = inBlock[i][c];
+            }
+        }
+
+        F32 start[4];
+        F32 end[4];
+        AxisEndpoints<4>(texels, start, end);
+
+        U32 e0[4], e1[4], p0 = 0, p1 = 0;
+        QuantizeBC7Endpoint(start, e0, p0);
+        QuantizeBC7Endpoint(end, e1, p1);
+
+        U8 indices[16];
+        U32 error = SelectBC7Indices(texels, e0, p0, e1, p1, indices);
+
+        F32 weights[16];
+        for (I32 i = 0; i < 16; ++i)
+        {
+            weights[i] = 1.0f - kBC7Weights4[indices[i]] / 64.0f;
+        }
+
+        if (error > 0 && FitEndpoints<4>(texels, weights, start, end))
+        {
+            U32 r0[4], r1[4], rp0 = 0, rp1 = 0;
+            QuantizeBC7Endpoint(start, r0, rp0);
+            QuantizeBC7Endpoint(end, r1, rp1);
+
+            U8 refinedIndices[16];
+            const U32 refinedError = SelectBC7Indices(texels, r0, rp0, r1, rp1, refinedIndices);
+
+            if (refinedError < error)
+            {
+                std::memcpy(e0, r0, sizeof(e0));
+                std::memcpy(e1, r1, sizeof(e1));
+                p0 = rp0;
+                p1 = rp1;
+                std::memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        // the anchor index has an implicit zero top bit
+        if (indices[0] & 8)
+        {
+            for (I32 c = 0; c < 4; ++c)
+            {
+                std::swap(e0[c], e1[c]);
+            }
+
+            std::swap(p0, p1);
+
+            for (I32 i = 0; i < 16; ++i)
+            {
+                indices[i] = static_cast<U8>(15 - indices[i]);
+            }
+        }
+
+        BlockBitWriter writer;
+        writer.Write(1 << 6, 7);
+
+        for (I32 c = 0; c < 4; ++c)
+        {
+            writer.Write(e0[c], 7);
+            writer.Write(e1[c], 7);
+        }
+
+        writer.Write(p0, 1);
+        writer.Write(p1, 1);
+
+        for (I32 i = 0; i < 16; ++i)
+        {
+            writer.Write(indices[i], i == 0 ? 3 : 4);
+        }
+
+        for (I32 i = 0; i < 16; ++i)
+        {
+            outBlock[i] = static_cast<U8>((writer.Bits[i >> 3] >> ((i & 7) * 8)) & 0xFF);
+        }
+    }
+
+    void CompressImage(const U8 *inData, I32 inWidth, I32 inHeight, I32 inComponents, TextureCompression inFormat, U8 *outData)
+    {
+        const I32 blocksX = (inWidth + 3) / 4;
+        const I32 blocksY = (inHeight + 3) / 4;
+        const size_t blockSize = CompressedBlockSize(inFormat);
+
+        ParallelFor(static_cast<size_t>(blocksY), 4, [&](size_t inBegin, size_t inEnd)
+        {
+            U8 block[16][4];
+
+            for (size_t by = inBegin; by < inEnd; ++by)
+            {
+                U8 *out = outData + by * blocksX * blockSize;
+
+                for (I32 bx = 0; bx < blocksX; ++bx, out += blockSize)
+                {
+                    FetchBlock(inData, inWidth, inHeight, inComponents, bx, static_cast<I32>(by), block);
+
+                    switch (inFormat)
+                    {
+                    case TextureCompression::BC1:
+                        EncodeColorBlock(block, out);
+                        break;
+                    case TextureCompression::BC3:
+                        EncodeChannelBlock(block, 3, out);
+                        EncodeColorBlock(block, out + 8);
+                        break;
+                    case TextureCompression::BC4:
+                        EncodeChannelBlock(block, 0, out);
+                        break;
+                    case TextureCompression::BC5:
+                        EncodeChannelBlock(block, 0, out);
+                        EncodeChannelBlock(block, 1, out + 8);
+                        break;
+                    case TextureCompression::BC7:
+                        EncodeBC7Block(block, out);
+                        break;
+                    case TextureCompression::None:
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    bool CompressImage(const Image &inImage, TextureCompression inFormat, CompressedImage &outImage)
+    {
+        if (!inImage.Data || inImage.Width <= 0 || inImage.Height <= 0 || inFormat == TextureCompression::None)
+        {
+            return false;
+        }
+
+        Profile profile("CompressImage", Profile::CPU);
+
+        outImage.Width = inImage.Width;
+        outImage.Height = inImage.Height;
+        outImage.Format = inFormat;
+        outImage.Data.resize(CompressedImageSize(inFormat, inImage.Width, inImage.Height));
+
+        CompressImage(inImage.Data, inImage.Width, inImage.Height, inImage.Components, inFormat, outImage.Data.data());
+        return true;
+    }
+
+    void UploadCompressedTextureData(const CompressedImage &inImage, U32 &outTextureID, U32 inLevel, bool inSRGB)
+    {
+        const GLenum internalFormat = CompressionToGL(inImage.Format, inSRGB);
+
+        if (outTextureID == 0)
+        {
+            outTextureID = GenerateTexture(GL_TEXTURE_2D);
+        }
+
+        #ifndef __APPLE__
+        if (HasDirectStateAccess())
+        {
+            // level 0 allocates the whole chain so lower levels can follow, GL_TEXTURE_MAX_LEVEL tracks what is filled
+            if (inLevel == 0)
+            {
+                EnsureTextureStorage(outTextureID, inImage.Width, inImage.Height, MipLevelCount(inImage.Width, inImage.Height), internalFormat);
+            }
+            else
+            {
+                GLint levels = 0;
+                GLint width = 0;
+                GLint height = 0;
+                glGetTextureParameteriv(outTextureID, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+                glGetTextureLevelParameteriv(outTextureID, static_cast<GLint>(inLevel), GL_TEXTURE_WIDTH, &width);
+                glGetTextureLevelParameteriv(outTextureID, static_cast<GLint>(inLevel), GL_TEXTURE_HEIGHT, &height);
+
+                if (static_cast<U32>(levels) <= inLevel || width != inImage.Width || height != inImage.Height)
+                {
+                    std::cerr << "Error: compressed level " << inLevel << " does not fit the storage of texture " << outTextureID << "\n";
+                    return;
+                }
+            }
+
+            UpdateCompressedTextureData(outTextureID, inLevel, inImage.Width, inImage.Height, internalFormat, inImage.Data.data(), inImage.Data.size());
+
+            GLint maxLevel = 0;
+            glGetTextureParameteriv(outTextureID, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+            glTextureParameteri(outTextureID, GL_TEXTURE_MAX_LEVEL, inLevel == 0 ? 0 : std::max(maxLevel, static_cast<GLint>(inLevel)));
+            return;
+        }
+        #endif
+
+        // mutable levels are specified one by one, as before immutable storage
+        glBindTexture(GL_TEXTURE_2D, outTextureID);
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(inLevel), internalFormat, inImage.Width, inImage.Height, 0,
+                               static_cast<GLsizei>(inImage.Data.size()), inImage.Data.data());
+
+        GPF_GL_STAT(TextureBinds, 1);
+        GPF_GL_STAT(TextureUploads, 1);
+        GPF_GL_STAT(TextureBytesUploaded, inImage.Data.size());
+    }
+
+    /* Mip generation */
+
+    U32 MipLevelCount(I32 inWidth, I32 inHeight)
+    {
+        U32 levels = 1;
+        I32 size = std::max(inWidth, inHeight);
+
+        while (size > 1)
+        {
+            size >>= 1;
+            levels++;
+        }
+
+        return levels;
+    }
+
+    static const F32* SRGBToLinearTable()
+    {
+        static const std::vector< F32 > table = []()
+        {
+            std::vector< F32 > values(256);
+            for (I32 i = 0; i < 256; ++i)
+            {
+                const F32 c = static_cast<F32>(i) / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+
+        return table.data();
+    }
+
+    static constexpr I32 kLinearToSRGBSize = 4096;
+
+    // Maps linear [0, 1] quantized to 12 bits straight to the 8 bit sRGB value.
+    static const U8* LinearToSRGBTable()
+    {
+        static const std::vector< U8 > table = []()
+        {
+            std::vector< U8 > values(kLinearToSRGBSize);
+            for (I32 i = 0; i < kLinearToSRGBSize; ++i)
+            {
+                const F32 c = static_cast<F32>(i) / static_cast<F32>(kLinearToSRGBSize - 1);
+                const F32 srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                values[i] = static_cast<U8>(glm::clamp(srgb, 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+
+        return table.data();
+    }
+
+    static inline F32 BesselI0(F32 inX)
+    {
+        // power series, converges quickly for the alpha range used here
+        F32 sum = 1.0f;
+        F32 term = 1.0f;
+        const F32 halfX = inX * 0.5f;
+
+        for (I32 k = 1; k < 16; ++k)
+        {
+            term *= (halfX / static_cast<F32>(k)) * (halfX / static_cast<F32>(k));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    // Taps of a 2:1 reduction, destination texel x reads source texels 2x + First .. 2x + First + Weights.size() - 1.
+    struct MipKernel
+    {
+        I32 First = 0;
+        std::vector< F32 > Weights;
+    };
+
+    static MipKernel BuildMipKernel(MipFilter inFilter)
+    {
+        MipKernel kernel;
+
+        if (inFilter == MipFilter::Box)
+        {
+            kernel.First = 0;
+            kernel.Weights = { 0.5f, 0.5f };
+            return kernel;
+        }
+
+        // Kaiser windowed sinc, width 3 and alpha 4 in destination texels
+        const F32 width = 3.0f;
+        const F32 alpha = 4.0f;
+        const F32 pi = 3.14159265358979f;
+        const F32 norm = BesselI0(alpha);
+        F32 total = 0.0f;
+
+        kernel.First = -5;
+
+        for (I32 k = -5; k <= 6; ++k)
+        {
+            // distance from the destination texel center in destination units
+            const F32 x = (static_cast<F32>(k) - 0.5f) * 0.5f;
+            const F32 sinc = std::fabs(x) < 1e-6f ? 1.0f : std::sin(pi * x) / (pi * x);
+            const F32 t = x / width;
+            const F32 window = t * t < 1.0f ? BesselI0(alpha * std::sqrt(1.0f - t * t)) / norm : 0.0f;
+            const F32 weight = sinc * window;
+
+            kernel.Weights.push_back(weight);
+            total += weight;
+        }
+
+        for (auto &weight : kernel.Weights)
+        {
+            weight /= total;
+        }
+
+        return kernel;
+    }
+
+    // Decodes 8 bit texels to the space filtering happens in.
+    static void DecodeMipSource(const Image &inImage, const MipOptions &inOptions, std::vector< F32 > &outData)
+    {
+        const I32 components = inImage.Components;
+        const bool isSRGB = inOptions.SRGB && components >= 3;
+        const bool isNormal = inOptions.NormalMap && components >= 3;
+        const F32 *srgb = SRGBToLinearTable();
+
+        outData.resize(static_cast<size_t>(inImage.Width) * inImage.Height * components);
+
+        ParallelFor(static_cast<size_t>(inImage.Height), 16, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t y = inBegin; y < inEnd; ++y)
+            {
+                const size_t rowSize = static_cast<size_t>(inImage.Width) * components;
+                const U8 *source = inImage.Data + y * rowSize;
+                F32 *target = outData.data() + y * rowSize;
+
+                for (size_t i = 0; i < rowSize; ++i)
+                {
+                    target[i] = static_cast<F32>(source[i]) * (1.0f / 255.0f);
+                }
+
+                if (isSRGB || isNormal)
+                {
+                    for (size_t i = 0; i < rowSize; i += components)
+                    {
+                        for (I32 c = 0; c < 3; ++c)
+                        {
+                            target[i + c] = isNormal ? target[i + c] * 2.0f - 1.0f : srgb[source[i + c]];
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    template< I32 Components >
+    static void DownsampleMipRow(const F32 *inSource, I32 inWidth, I32 inTargetWidth, const MipKernel &inKernel, F32 *outTarget)
+    {
+        const I32 taps = static_cast<I32>(inKernel.Weights.size());
+        const F32 *weights = inKernel.Weights.data();
+
+        for (I32 x = 0; x < inTargetWidth; ++x)
+        {
+            F32 texel[Components] = {};
+            const I32 first = x * 2 + inKernel.First;
+
+            if (first >= 0 && first + taps <= inWidth)
+            {
+                // interior texels need no clamping
+                const F32 *sample = inSource + static_cast<size_t>(first) * Components;
+
+                for (I32 k = 0; k < taps; ++k)
+                {
+                    for (I32 c = 0; c < Components; ++c)
+                    {
+                        texel[c] += sample[k * Components + c] * weights[k];
+                    }
+                }
+            }
+            else
+            {
+                for (I32 k = 0; k < taps; ++k)
+                {
+                    const F32 *sample = inSource + static_cast<size_t>(glm::clamp(first + k, 0, inWidth - 1)) * Components;
+
+                    for (I32 c = 0; c < Components; ++c)
+                    {
+                        texel[c] += sample[c] * weights[k];
+                    }
+                }
+            }
+
+            for (I32 c = 0; c < Components; ++c)
+            {
+                outTarget[static_cast<size_t>(x) * Components + c] = texel[c];
+            }
+        }
+    }
+
+    // Separable 2:1 reduction, the vertical pass runs first so both inner loops walk contiguous rows.
+    static void DownsampleMip(const std::vector< F32 > &inSource, I32 inWidth, I32 inHeight, I32 inComponents,
+                              const MipKernel &inKernel, std::vector< F32 > &outScratch, std::vector< F32 > &outTarget)
+    {
+        const I32 width = std::max(inWidth >> 1, 1);
+        const I32 height = std::max(inHeight >> 1, 1);
+        const I32 taps = static_cast<I32>(inKernel.Weights.size());
+        const size_t sourceRow = static_cast<size_t>(inWidth) * inComponents;
+        const size_t targetRow = static_cast<size_t>(width) * inComponents;
+
+        outScratch.assign(sourceRow * height, 0.0f);
+        outTarget.resize(targetRow * height);
+
+        // a 1 texel dimension passes through unfiltered
+        const bool filterY = inHeight > 1;
+        const bool filterX = inWidth > 1;
+
+        ParallelFor(static_cast<size_t>(height), 8, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t y = inBegin; y < inEnd; ++y)
+            {
+                F32 *row = outScratch.data() + y * sourceRow;
+
+                if (!filterY)
+                {
+                    std::memcpy(row, inSource.data() + y * sourceRow, sourceRow * sizeof(F32));
+                    continue;
+                }
+
+                for (I32 k = 0; k < taps; ++k)
+                {
+                    const I32 sy = glm::clamp(static_cast<I32>(y) * 2 + inKernel.First + k, 0, inHeight - 1);
+                    const F32 *source = inSource.data() + static_cast<size_t>(sy) * sourceRow;
+                    const F32 weight = inKernel.Weights[k];
+
+                    for (size_t i = 0; i < sourceRow; ++i)
+                    {
+                        row[i] += source[i] * weight;
+                    }
+                }
+            }
+        });
+
+        ParallelFor(static_cast<size_t>(height), 8, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t y = inBegin; y < inEnd; ++y)
+            {
+                const F32 *source = outScratch.data() + y * sourceRow;
+                F32 *target = outTarget.data() + y * targetRow;
+
+                if (!filterX)
+                {
+                    std::memcpy(target, source, targetRow * sizeof(F32));
+                    continue;
+                }
+
+                // fixed component counts let the compiler unroll and vectorize the texel loop
+                switch (inComponents)
+                {
+                case 1: DownsampleMipRow<1>(source, inWidth, width, inKernel, target); break;
+                case 2: DownsampleMipRow<2>(source, inWidth, width, inKernel, target); break;
+                case 3: DownsampleMipRow<3>(source, inWidth, width, inKernel, target); break;
+                default: DownsampleMipRow<4>(source, inWidth, width, inKernel, target); break;
+                }
+            }
+        });
+    }
+
+    // Stores a filtered level back to 8 bit, re-encoding sRGB and renormalizing normals.
+    static void EncodeMipLevel(const std::vector< F32 > &inSource, I32 inWidth, I32 inHeight, I32 inComponents,
+                               const MipOptions &inOptions, U8 *outData)
+    {
+        const bool isSRGB = inOptions.SRGB && inComponents >= 3;
+        const bool isNormal = inOptions.NormalMap && inComponents >= 3;
+        const size_t rowSize = static_cast<size_t>(inWidth) * inComponents;
+        const U8 *srgb = LinearToSRGBTable();
+
+        ParallelFor(static_cast<size_t>(inHeight), 16, [&](size_t inBegin, size_t inEnd)
+        {
+            for (size_t y = inBegin; y < inEnd; ++y)
+            {
+                const F32 *source = inSource.data() + y * rowSize;
+                U8 *target = outData + y * rowSize;
+
+                for (size_t i = 0; i < rowSize; ++i)
+                {
+                    target[i] = static_cast<U8>(glm::clamp(source[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+                }
+
+                if (isNormal)
+                {
+                    for (size_t i = 0; i < rowSize; i += inComponents)
+                    {
+                        const F32 length = std::sqrt(source[i] * source[i] + source[i + 1] * source[i + 1] + source[i + 2] * source[i + 2]);
+                        const F32 scale = length > 1e-6f ? 0.5f / length : 0.0f;
+
+                        for (I32 c = 0; c < 3; ++c)
+                        {
+                            // a zero vector falls back to straight up
+                            const F32 value = length > 1e-6f ? source[i + c] * scale + 0.5f : (c == 2 ? 1.0f : 0.5f);
+                            target[i + c] = static_cast<U8>(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+                        }
+                    }
+                }
+                else if (isSRGB)
+                {
+                    for (size_t i = 0; i < rowSize; i += inComponents)
+                    {
+                        for (I32 c = 0; c < 3; ++c)
+                        {
+                            target[i + c] = srgb[static_cast<I32>(glm::clamp(source[i + c], 0.0f, 1.0f) * (kLinearToSRGBSize - 1) + 0.5f)];
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    bool GenerateMipChain(const Image &inImage, const MipOptions &inOptions, MipChain &outChain)
+    {
+        if (!inImage.Data || inImage.Width <= 0 || inImage.Height <= 0 || inImage.Components <= 0 || inImage.Components > 4)
+        {
+            return false;
+        }
+
+        Profile profile("GenerateMipChain", Profile::CPU);
+
+        U32 levelCount = MipLevelCount(inImage.Width, inImage.Height);
+        if (inOptions.MaxLevels > 0)
+        {
+            levelCount = std::min(levelCount, inOptions.MaxLevels);
+        }
+
+        outChain = MipChain();
+        outChain.Components = inImage.Components;
+
+        // every level starts 16 byte aligned
+        size_t offset = 0;
+
+        for (U32 i = 0; i < levelCount; ++i)
+        {
+            TextureLevel level;
+            level.Width = std::max(inImage.Width >> i, 1);
+            level.Height = std::max(inImage.Height >> i, 1);
+            level.Offset = offset;
+            level.Size = static_cast<size_t>(level.Width) * level.Height * inImage.Components;
+
+            outChain.Levels.push_back(level);
+            offset = (offset + level.Size + 15) & ~static_cast<size_t>(15);
+        }
+
+        outChain.Storage.resize(offset);
+        std::memcpy(outChain.Storage.data(), inImage.Data, outChain.Levels[0].Size);
+
+        if (levelCount == 1)
+        {
+            return true;
+        }
+
+        // levels are filtered from the float result of the previous one, so rounding does not accumulate
+        const MipKernel kernel = BuildMipKernel(inOptions.Filter);
+        std::vector< F32 > current;
+        std::vector< F32 > scratch;
+        std::vector< F32 > next;
+
+        DecodeMipSource(inImage, inOptions, current);
+
+        for (U32 i = 1; i < levelCount; ++i)
+        {
+            const TextureLevel &previous = outChain.Levels[i - 1];
+            const TextureLevel &level = outChain.Levels[i];
+
+            DownsampleMip(current, previous.Width, previous.Height, inImage.Components, kernel, scratch, next);
+
+            if (inOptions.NormalMap && inImage.Components >= 3)
+            {
+                // keep filtering unit vectors, otherwise the small levels flatten out
+                for (size_t t = 0; t < next.size(); t += inImage.Components)
+                {
+                    const F32 length = std::sqrt(next[t] * next[t] + next[t + 1] * next[t + 1] + next[t + 2] * next[t + 2]);
+                    if (length > 1e-6f)
+                    {
+                        next[t] /= length;
+                        next[t + 1] /= length;
+                        next[t + 2] /= length;
+                    }
+                }
+            }
+
+            EncodeMipLevel(next, level.Width, level.Height, inImage.Components, inOptions, outChain.Storage.data() + level.Offset);
+            current.swap(next);
+        }
+
+        return true;
+    }
+
+    /* Texture container */
+
+    static constexpr U32 kTextureContainerMagic = 0x54465047; // "GPFT"
+    static constexpr U32 kTextureContainerVersion = 3;
+    static constexpr I32 kMaxTextureContainerSize = 1 << 16;
+
+    struct TextureContainerHeader
+    {
+        U32 Magic;
+        U32 Version;
+        U64 SourceSize;
+        I64 SourceTime;
+        U64 SourceHash;
+        I32 Width;
+        I32 Height;
+        I32 Components;
+        U32 Compression;
+        U32 InternalFormat;
+        U32 Format;
+        U32 Type;
+        U32 SRGB;
+        U32 LevelCount;
+        U32 Reserved;
+    };
+
+    struct TextureContainerLevel
+    {
+        I32 Width;
+        I32 Height;
+        U64 Offset;
+        U64 Size;
+    };
+
+    bool BuildTextureData(const Image &inImage, const TextureLoadOptions &inOptions, TextureData &outData)
+    {
+        if (!inImage.Data || inImage.Width <= 0 || inImage.Height <= 0)
+        {
+            return false;
+        }
+
+        Profile profile("BuildTextureData", Profile::CPU);
+
+        MipOptions mipOptions;
+        mipOptions.Filter = inOptions.Filter;
+        mipOptions.SRGB = inOptions.SRGB;
+        mipOptions.NormalMap = inOptions.NormalMap;
+        mipOptions.MaxLevels = inOptions.GenerateMipMaps ? 0 : 1;
+
+        MipChain chain;
+        if (!GenerateMipChain(inImage, mipOptions, chain))
+        {
+            return false;
+        }
+
+        const bool isCompressed = inOptions.Compression != TextureCompression::None;
+
+        outData = TextureData();
+        outData.Width = inImage.Width;
+        outData.Height = inImage.Height;
+        outData.Components = inImage.Components;
+        outData.Compression = inOptions.Compression;
+        outData.SRGB = inOptions.SRGB;
+        outData.Format = ComponentsToFormat(inImage.Components);
+        outData.Type = GL_UNSIGNED_BYTE;
+        outData.InternalFormat = isCompressed ? CompressionToGL(inOptions.Compression, inOptions.SRGB) : SizedInternalFormat(inImage.Components, inOptions.SRGB);
+
+        if (!isCompressed)
+        {
+            outData.Levels = std::move(chain.Levels);
+            outData.Storage = std::move(chain.Storage);
+            return true;
+        }
+
+        // compressed levels keep the 16 byte alignment of the chain
+        size_t offset = 0;
+
+        for (const auto &source : chain.Levels)
+        {
+            TextureLevel level;
+            level.Width = source.Width;
+            level.Height = source.Height;
+            level.Offset = offset;
+            level.Size = CompressedImageSize(inOptions.Compression, source.Width, source.Height);
+
+            outData.Levels.push_back(level);
+            offset = (offset + level.Size + 15) & ~static_cast<size_t>(15);
+        }
+
+        outData.Storage.resize(offset);
+
+        for (U32 i = 0; i < outData.Levels.size(); ++i)
+        {
+            const TextureLevel &level = outData.Levels[i];
+            CompressImage(chain.Storage.data() + chain.Levels[i].Offset, level.Width, level.Height, inImage.Components,
+                          inOptions.Compression, outData.Storage.data() + level.Offset);
+        }
+
+        return true;
+    }
+
+    std::string TextureContainerPath(const std::string &inSourceFile, const TextureLoadOptions &inOptions)
+    {
+        static const char *kFormats[] = { "raw", "bc1", "bc3", "bc4", "bc5", "bc7" };
+
+        std::string path = inSourceFile + "." + kFormats[static_cast<U32>(inOptions.Compression)];
+        path += inOptions.SRGB ? "s" : "";
+        path += inOptions.NormalMap ? "n" : "";
+        path += inOptions.GenerateMipMaps ? (inOptions.Filter == MipFilter::Box ? "b" : "m") : "";
+        path += ".gpftex";
+
+        return path;
+    }
+
+    bool SaveTextureContainer(const std::string &inFileName, const TextureData &inData, U64 inSourceSize, I64 inSourceTime, U64 inSourceHash)
+    {
+        TextureContainerHeader header = {};
+        header.Magic = kTextureContainerMagic;
+        header.Version = kTextureContainerVersion;
+        header.SourceSize = inSourceSize;
+        header.SourceTime = inSourceTime;
+        header.SourceHash = inSourceHash;
+        header.Width = inData.Width;
+        header.Height = inData.Height;
+        header.Components = inData.Components;
+        header.Compression = static_cast<U32>(inData.Compression);
+        header.InternalFormat = inData.InternalFormat;
+        header.Format = inData.Format;
+        header.Type = inData.Type;
+        header.SRGB = inData.SRGB ? 1 : 0;
+        header.LevelCount = static_cast<U32>(inData.Levels.size());
+
+        const size_t tableSize = sizeof(TextureContainerHeader) + sizeof(TextureContainerLevel) * inData.Levels.size();
+        const size_t dataStart = (tableSize + 15) & ~static_cast<size_t>(15);
+
+        // write next to the target and rename, so concurrent loads never see a partial file
+        const std::string temporary = TemporaryFileName(inFileName);
+        std::ofstream file(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const auto &level : inData.Levels)
+        {
+            TextureContainerLevel entry = {};
+            entry.Width = level.Width;
+            entry.Height = level.Height;
+            entry.Offset = dataStart + level.Offset;
+            entry.Size = level.Size;
+            file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        }
+
+        const char padding[16] = {};
+        file.write(padding, static_cast<std::streamsize>(dataStart - tableSize));
+
+        size_t written = 0;
+
+        for (U32 i = 0; i < inData.Levels.size(); ++i)
+        {
+            const TextureLevel &level = inData.Levels[i];
+
+            file.write(padding, static_cast<std::streamsize>(level.Offset - written));
+            file.write(reinterpret_cast<const char*>(inData.LevelData(i)), static_cast<std::streamsize>(level.Size));
+            written = level.Offset + level.Size;
+        }
+
+        file.close();
+
+        std::error_code error;
+
+        if (file.fail())
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+
+        std::filesystem::rename(temporary, inFileName, error);
+
+        if (error)
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LoadTextureContainer(const std::string &inFileName, TextureData &outData, U64 *outSourceSize, I64 *outSourceTime, U64 *outSourceHash)
+    {
+        MappedFile file;
+        if (!MapFile(inFileName, file, MapHint::WillNeed))
+        {
+            return false;
+        }
+
+        TextureContainerHeader header;
+
+        if (file.Size < sizeof(header))
+        {
+            return false;
+        }
+
+        std::memcpy(&header, file.Data, sizeof(header));
+
+        if (header.Magic != kTextureContainerMagic || header.Version != kTextureContainerVersion || header.LevelCount == 0 ||
+            file.Size < sizeof(header) + sizeof(TextureContainerLevel) * static_cast<U64>(header.LevelCount))
+        {
+            return false;
+        }
+
+        // everything the upload trusts, sizes are bounded so the products below stay far from overflowing
+        if (header.Compression > static_cast<U32>(TextureCompression::BC7) || header.Width <= 0 || header.Height <= 0 ||
+            header.Width > kMaxTextureContainerSize || header.Height > kMaxTextureContainerSize ||
+            header.Components < 1 || header.Components > 4 || header.LevelCount > MipLevelCount(header.Width, header.Height) || header.SRGB > 1)
+        {
+            std::cerr << "Warning: invalid texture container - " << inFileName << "\n";
+            return false;
+        }
+
+        // the enums go to GL unchecked, so they have to be exactly what BuildTextureData produces for the header
+        const TextureCompression compression = static_cast<TextureCompression>(header.Compression);
+        const bool isSRGB = header.SRGB != 0;
+        const GLenum internalFormat = compression != TextureCompression::None ? CompressionToGL(compression, isSRGB) : SizedInternalFormat(header.Components, isSRGB);
+
+        if (header.InternalFormat != internalFormat || header.Format != ComponentsToFormat(header.Components) || header.Type != GL_UNSIGNED_BYTE)
+        {
+            std::cerr << "Warning: invalid texture container format - " << inFileName << "\n";
+            return false;
+        }
+
+        outData = TextureData();
+        outData.Width = header.Width;
+        outData.Height = header.Height;
+        outData.Components = header.Components;
+        outData.Compression = static_cast<TextureCompression>(header.Compression);
+        outData.SRGB = header.SRGB != 0;
+        outData.InternalFormat = header.InternalFormat;
+        outData.Format = header.Format;
+        outData.Type = header.Type;
+
+        for (U32 i = 0; i < header.LevelCount; ++i)
+        {
+            TextureContainerLevel entry;
+            std::memcpy(&entry, file.Data + sizeof(header) + sizeof(entry) * i, sizeof(entry));
+
+            const I32 width = std::max(header.Width >> i, 1);
+            const I32 height = std::max(header.Height >> i, 1);
+            const U64 size = header.Compression != static_cast<U32>(TextureCompression::None) ?
+                CompressedImageSize(static_cast<TextureCompression>(header.Compression), width, height) :
+                static_cast<U64>(width) * height * header.Components * TypeSize(header.Type);
+
+            if (entry.Width != width || entry.Height != height || entry.Size < size || entry.Offset > file.Size || entry.Size > file.Size - entry.Offset)
+            {
+                std::cerr << "Warning: invalid texture container level " << i << " - " << inFileName << "\n";
+                return false;
+            }
+
+            TextureLevel level;
+            level.Width = entry.Width;
+            level.Height = entry.Height;
+            level.Offset = static_cast<size_t>(entry.Offset);
+            level.Size = static_cast<size_t>(entry.Size);
+            outData.Levels.push_back(level);
+        }
+
+        if (outSourceSize)
+        {
+            *outSourceSize = header.SourceSize;
+        }
+
+        if (outSourceTime)
+        {
+            *outSourceTime = header.SourceTime;
+        }
+
+        if (outSourceHash)
+        {
+            *outSourceHash = header.SourceHash;
+        }
+
+        outData.Mapping = std::move(file);
+        return true;
+    }
+
+    bool LoadTextureData(const std::string &inFileName, const TextureLoadOptions &inOptions, TextureData &outData)
+    {
+        U64 sourceSize = 0;
+        I64 sourceTime = 0;
+        const bool hasSource = SourceFileInfo(inFileName, sourceSize, sourceTime);
+        const std::string containerPath = TextureContainerPath(inFileName, inOptions);
+
+        // the source is read in full at most once, to check a touched container or to stamp a new one
+        U64 sourceHash = 0;
+        bool isHashed = false;
+
+        auto hashSource = [&]()
+        {
+            MappedFile source;
+            if (!isHashed && MapFile(inFileName, source, MapHint::Sequential))
+            {
+                sourceHash = HashFileContents(source.Data, source.Size);
+                isHashed = true;
+            }
+            return isHashed;
+        };
+
+        if (inOptions.UseContainer)
+        {
+            U64 containerSourceSize = 0;
+            I64 containerSourceTime = 0;
+            U64 containerSourceHash = 0;
+
+            if (LoadTextureContainer(containerPath, outData, &containerSourceSize, &containerSourceTime, &containerSourceHash))
+            {
+                // without the source a shipped container is used as is
+                if (!hasSource || (containerSourceSize == sourceSize && containerSourceTime == sourceTime))
+                {
+                    return true;
+                }
+
+                // touched but maybe not changed
+                if (containerSourceSize == sourceSize && hashSource() && sourceHash == containerSourceHash)
+                {
+                    // remember the new time so the next load skips the hash
+                    std::fstream file(containerPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+
+                    if (file.is_open())
+                    {
+                        file.seekp(offsetof(TextureContainerHeader, SourceTime));
+                        file.write(reinterpret_cast<const char*>(&sourceTime), sizeof(sourceTime));
+                    }
+
+                    return true;
+                }
+            }
+        }
+
+        // uncompressed RGB is stored as RGBA, 3 byte texels take the slow upload path
+        ImageLoadOptions imageOptions;
+        imageOptions.ExpandRGB = inOptions.Compression == TextureCompression::None;
+
+        Image image = {};
+        if (!LoadImage(inFileName, image, imageOptions))
+        {
+            return false;
+        }
+
+        const bool isBuilt = BuildTextureData(image, inOptions, outData);
+        FreeImage(image);
+
+        if (isBuilt && inOptions.UseContainer && hasSource && hashSource() && !SaveTextureContainer(containerPath, outData, sourceSize, sourceTime, sourceHash))
+        {
+            std::cerr << "Warning: failed to write texture container - " << containerPath << "\n";
+        }
+
+        return isBuilt;
+    }
+
+    void UploadTextureData(const TextureData &inData, U32 &outTextureID)
+    {
+        const bool isCompressed = inData.Compression != TextureCompression::None;
+
+        EnsureTextureStorage(outTextureID, inData.Width, inData.Height, static_cast<U32>(inData.Levels.size()), inData.InternalFormat);
+
+        ScopedUnpackAlignment unpackAlignment(1);
+
+        for (U32 i = 0; i < inData.Levels.size(); ++i)
+        {
+            const TextureLevel &level = inData.Levels[i];
+
+            if (isCompressed)
+            {
+                UpdateCompressedTextureData(outTextureID, i, level.Width, level.Height, inData.InternalFormat, inData.LevelData(i), level.Size);
+            }
+            else
+            {
+                UpdateTextureData(outTextureID, i, 0, 0, level.Width, level.Height, inData.Format, inData.Type, inData.LevelData(i));
+            }
+        }
+    }
+
+    /* Texture cache */
+
+    static std::string TextureCacheKey(const std::string &inFileName, const TextureLoadOptions &inOptions)
+    {
+        std::error_code error;
+        std::string key = std::filesystem::weakly_canonical(std::filesystem::path(inFileName), error).generic_string();
+
+        if (error)
+        {
+            key = inFileName;
+        }
+
+        key += "|" + std::to_string(static_cast<U32>(inOptions.Compression));
+        key += inOptions.SRGB ? "|srgb" : "|linear";
+        key += inOptions.NormalMap ? "|normal" : "";
+        key += inOptions.GenerateMipMaps ? "|mips" + std::to_string(static_cast<U32>(inOptions.Filter)) : "|nomips";
+        return key;
+    }
+
+    TextureHandle TextureCache::Acquire(const std::string &inFileName, const TextureLoadOptions &inOptions)
+    {
+        const std::string key = TextureCacheKey(inFileName, inOptions);
+        const auto founded = Entries.find(key);
+
+        if (founded != std::end(Entries))
+        {
+            Stats.Hits++;
+            Usage.splice(Usage.begin(), Usage, founded->second.Usage);
+            return founded->second.Handle;
+        }
+
+        Stats.Misses++;
+
+        TextureData data;
+        if (!LoadTextureData(inFileName, inOptions, data))
+        {
+            Stats.Failures++;
+            return nullptr;
+        }
+
+        auto texture = std::make_shared<Texture>();
+        texture->ID = GenerateTexture();
+        texture->Width = data.Width;
+        texture->Height = data.Height;
+        texture->Components = data.Components;
+        texture->Path = inFileName;
+        texture->SizeInBytes = data.SizeInBytes();
+
+        UploadTextureData(data, texture->ID);
+
+        Usage.push_front(key);
+
+        Entry entry;
+        entry.Handle = texture;
+        entry.Usage = Usage.begin();
+        Entries.emplace(key, entry);
+
+        Stats.ResidentBytes += texture->SizeInBytes;
+        Stats.ResidentTextures++;
+
+        Trim();
+
+        return texture;
+    }
+
+    void TextureCache::Trim()
+    {
+        auto it = Usage.end();
+
+        while (Stats.ResidentBytes > BudgetInBytes && it != Usage.begin())
+        {
+            --it;
+
+            const auto founded = Entries.find(*it);
+            Entry &entry = founded->second;
+
+            if (entry.Handle.use_count() > 1)
+            {
+                // still referenced outside the cache
+                continue;
+            }
+
+            Stats.ResidentBytes -= entry.Handle->SizeInBytes;
+            Stats.ResidentTextures--;
+            Stats.Evictions++;
+
+            DeleteTexture(entry.Handle->ID);
+            Entries.erase(founded);
+            it = Usage.erase(it);
+        }
+    }
+
+    void TextureCache::Clear()
+    {
+        for (auto &entry : Entries)
+        {
+            DeleteTexture(entry.second.Handle->ID);
+        }
+
+        Entries.clear();
+        Usage.clear();
+
+        Stats.ResidentBytes = 0;
+        Stats.ResidentTextures = 0;
+    }
+
+    MaterialTextures LoadMaterialTextures(const MaterialInfo &inMaterial, TextureCache &outCache, const std::string &inBaseDirectory)
+    {
+        auto load = [&outCache, &inBaseDirectory](const std::string &inName) -> TextureHandle
+        {
+            if (inName.empty())
+            {
+                return nullptr;
+            }
+
+            const std::filesystem::path path = inBaseDirectory.empty() ? std::filesystem::path(inName) : std::filesystem::path(inBaseDirectory) / inName;
+            return outCache.Acquire(path.generic_string());
+        };
+
+        MaterialTextures result;
+        result.Ambient = load(inMaterial.AmbientTextureName);
+        result.Diffuse = load(inMaterial.DiffuseTextureName);
+        result.Specular = load(inMaterial.SpecularTextureName);
+        result.Highlight = load(inMaterial.HighlightTextureName);
+        result.Bump = load(inMaterial.BumpTextureName);
+        result.Displacement = load(inMaterial.DisplacementTextureName);
+        result.Alpha = load(inMaterial.AlphaTextureName);
+        result.Reflection = load(inMaterial.ReflectionTextureName);
+
+        return result;
+    }
+
+    void DumpTextureCacheStats(const TextureCache &inCache)
+    {
+        const TextureCacheStats &stats = inCache.Stats;
+
+        std::cout << "Texture cache - " << stats.ResidentTextures << " textures, "
+                  << (stats.ResidentBytes >> 20) << " / " << (inCache.BudgetInBytes >> 20) << " MB, "
+                  << stats.Hits << " hits, " << stats.Misses << " misses, "
+                  << stats.Evictions << " evictions, " << stats.Failures << " failures\n";
+    }
+
+    /* Texture atlas */
+
+    void SkylinePacker::Reset(I32 inWidth, I32 inHeight)
+    {
+        Width = inWidth;
+        Height = inHeight;
+        Skyline.clear();
+
+        Node node;
+        node.Width = inWidth;
+        Skyline.push_back(node);
+    }
+
+    bool SkylinePacker::Insert(I32 inWidth, I32 inHeight, I32 &outX, I32 &outY)
+    {
+        I32 bestIndex = -1;
+        I32 bestY = std::numeric_limits<I32>::max();
+        I32 bestWidth = std::numeric_limits<I32>::max();
+
+        for (size_t i = 0; i < Skyline.size(); ++i)
+        {
+            const I32 x = Skyline[i].X;
+
+            if (x + inWidth > Width)
+            {
+                break;
+            }
+
+            // the rectangle rests on the highest segment it spans
+            I32 y = 0;
+            I32 remaining = inWidth;
+
+            for (size_t j = i; remaining > 0 && j < Skyline.size(); ++j)
+            {
+                y = std::max(y, Skyline[j].Y);
+                remaining -= Skyline[j].Width;
+            }
+
+            if (y + inHeight > Height)
+            {
+                continue;
+            }
+
+            if (y < bestY || (y == bestY && Skyline[i].Width < bestWidth))
+            {
+                bestIndex = static_cast<I32>(i);
+                bestY = y;
+                bestWidth = Skyline[i].Width;
+            }
+        }
+
+        if (bestIndex < 0)
+        {
+            return false;
+        }
+
+        outX = Skyline[bestIndex].X;
+        outY = bestY;
+
+        Node node;
+        node.X = outX;
+        node.Y = bestY + inHeight;
+        node.Width = inWidth;
+        Skyline.insert(Skyline.begin() + bestIndex, node);
+
+        // shrink or drop the segments now covered by the new one
+        for (size_t i = bestIndex + 1; i < Skyline.size();)
+        {
+            const I32 end = Skyline[i - 1].X + Skyline[i - 1].Width;
+
+            if (Skyline[i].X >= end)
+            {
+                break;
+            }
+
+            const I32 shrink = end - Skyline[i].X;
+            Skyline[i].X += shrink;
+            Skyline[i].Width -= shrink;
+
+            if (Skyline[i].Width > 0)
+            {
+                break;
+            }
+
+            Skyline.erase(Skyline.begin() + i);
+        }
+
+        for (size_t i = 0; i + 1 < Skyline.size();)
+        {
+            if (Skyline[i].Y == Skyline[i + 1].Y)
+            {
+                Skyline[i].Width += Skyline[i + 1].Width;
+                Skyline.erase(Skyline.begin() + i + 1);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        return true;
+    }
+
+    // Copies the image into the layer and repeats its edge texels over the padding.
+    static void BlitAtlasImage(const Image &inImage, I32 inX, I32 inY, I32 inPadding, I32 inLayerWidth, I32 inLayerHeight, U8 *outLayer)
+    {
+        const I32 components = inImage.Components;
+
+        for (I32 y = -inPadding; y < inImage.Height + inPadding; ++y)
+        {
+            const I32 targetY = inY + y;
+            if (targetY < 0 || targetY >= inLayerHeight)
+            {
+                continue;
+            }
+
+            const I32 sourceY = glm::clamp(y, 0, inImage.Height - 1);
+            const U8 *source = inImage.Data + static_cast<size_t>(sourceY) * inImage.Width * components;
+            U8 *target = outLayer + static_cast<size_t>(targetY) * inLayerWidth * components;
+
+            for (I32 x = -inPadding; x < inImage.Width + inPadding; ++x)
+            {
+                const I32 targetX = inX + x;
+                if (targetX < 0 || targetX >= inLayerWidth)
+                {
+                    continue;
+                }
+
+                const I32 sourceX = glm::clamp(x, 0, inImage.Width - 1);
+                std::memcpy(target + static_cast<size_t>(targetX) * components, source + static_cast<size_t>(sourceX) * components, components);
+            }
+        }
+    }
+
+    bool BuildTextureAtlas( const std::vector< std::string > &inNames,
+                            const std::vector< Image > &inImages,
+                            const TextureAtlasOptions &inOptions,
+                            TextureAtlas &outAtlas )
+    {
+        if (inImages.empty() || inNames.size() != inImages.size())
+        {
+            std::cerr << "Error: texture atlas needs one name per image\n";
+            return false;
+        }
+
+        Profile profile("BuildTextureAtlas", Profile::CPU);
+
+        const I32 components = inImages[0].Components;
+        const bool isLayers = inOptions.Mode == AtlasMode::Layers;
+
+        for (size_t i = 0; i < inImages.size(); ++i)
+        {
+            const Image &image = inImages[i];
+
+            if (!image.Data || image.Components != components)
+            {
+                std::cerr << "Error: atlas image " << inNames[i] << " is missing or has a different format\n";
+                return false;
+            }
+
+            if (isLayers && (image.Width != inImages[0].Width || image.Height != inImages[0].Height))
+            {
+                std::cerr << "Error: atlas layer " << inNames[i] << " does not match the size of the first image\n";
+                return false;
+            }
+        }
+
+        const I32 padding = isLayers ? 0 : std::max(inOptions.Padding, 0);
+        const I32 width = isLayers ? inImages[0].Width : inOptions.Size;
+        const I32 height = isLayers ? inImages[0].Height : inOptions.Size;
+
+        // placements snap to the padding so every kept mip level starts on a texel boundary
+        I32 alignment = 1;
+        U32 levels = inOptions.GenerateMipMaps ? MipLevelCount(width, height) : 1;
+
+        if (!isLayers && inOptions.GenerateMipMaps)
+        {
+            U32 paddingLevels = 1;
+            while ((2 << (paddingLevels - 1)) <= padding)
+            {
+                paddingLevels++;
+            }
+
+            levels = std::min(levels, paddingLevels);
+            alignment = 1 << (levels - 1);
+        }
+
+        auto alignUp = [alignment](I32 inValue)
+        {
+            return (inValue + alignment - 1) / alignment * alignment;
+        };
+
+        // tallest first keeps the skyline flat
+        std::vector< size_t > order(inImages.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&inImages](size_t inLhs, size_t inRhs)
+        {
+            return inImages[inLhs].Height != inImages[inRhs].Height ? inImages[inLhs].Height > inImages[inRhs].Height
+                                                                    : inImages[inLhs].Width > inImages[inRhs].Width;
+        });
+
+        std::vector< SkylinePacker > packers;
+        std::vector< AtlasRegion > regions(inImages.size());
+
+        for (size_t index : order)
+        {
+            const Image &image = inImages[index];
+            AtlasRegion &region = regions[index];
+
+            region.Width = image.Width;
+            region.Height = image.Height;
+
+            if (isLayers)
+            {
+                region.Layer = static_cast<U32>(index);
+                continue;
+            }
+
+            const I32 packedWidth = alignUp(image.Width + padding * 2);
+            const I32 packedHeight = alignUp(image.Height + padding * 2);
+
+            if (packedWidth > width || packedHeight > height)
+            {
+                std::cerr << "Error: atlas image " << inNames[index] << " does not fit a " << width << "x" << height << " layer\n";
+                return false;
+            }
+
+            bool isPlaced = false;
+
+            for (size_t layer = 0; layer < packers.size() && !isPlaced; ++layer)
+            {
+                I32 x = 0;
+                I32 y = 0;
+
+                if (packers[layer].Insert(packedWidth, packedHeight, x, y))
+                {
+                    region.Layer = static_cast<U32>(layer);
+                    region.X = x + padding;
+                    region.Y = y + padding;
+                    isPlaced = true;
+                }
+            }
+
+            if (!isPlaced)
+            {
+                packers.emplace_back();
+                packers.back().Reset(width, height);
+
+                I32 x = 0;
+                I32 y = 0;
+                packers.back().Insert(packedWidth, packedHeight, x, y);
+
+                region.Layer = static_cast<U32>(packers.size() - 1);
+                region.X = x + padding;
+                region.Y = y + padding;
+            }
+        }
+
+        const U32 layerCount = isLayers ? static_cast<U32>(inImages.size()) : static_cast<U32>(packers.size());
+        const GLenum format = ComponentsToFormat(components);
+
+        DeleteTextureAtlas(outAtlas);
+
+        outAtlas.Width = width;
+        outAtlas.Height = height;
+        outAtlas.Layers = layerCount;
+        outAtlas.Levels = levels;
+        outAtlas.Components = components;
+        outAtlas.TextureID = GenerateTexture(GL_TEXTURE_2D_ARRAY);
+
+        AllocateTextureArrayStorage(outAtlas.TextureID, width, height, layerCount, levels, SizedInternalFormat(components, inOptions.SRGB));
+
+        // layers are composed, filtered and uploaded one at a time to bound memory
+        std::vector< U8 > layerData(static_cast<size_t>(width) * height * components);
+        MipOptions mipOptions;
+        mipOptions.SRGB = inOptions.SRGB;
+        mipOptions.MaxLevels = levels;
+
+        // a box texel of the last kept level covers one aligned block inside a packed rectangle, the wider
+        // Kaiser kernel would reach across the padding into the neighbouring image
+        mipOptions.Filter = isLayers ? MipFilter::Kaiser : MipFilter::Box;
+
+        ScopedUnpackAlignment unpackAlignment(1);
+
+        for (U32 layer = 0; layer < layerCount; ++layer)
+        {
+            std::fill(layerData.begin(), layerData.end(), static_cast<U8>(0));
+
+            for (size_t i = 0; i < inImages.size(); ++i)
+            {
+                if (regions[i].Layer == layer)
+                {
+                    BlitAtlasImage(inImages[i], regions[i].X, regions[i].Y, padding, width, height, layerData.data());
+                }
+            }
+
+            MipChain chain;
+            GenerateMipChain({ layerData.data(), width, height, components }, mipOptions, chain);
+
+            for (U32 level = 0; level < chain.Levels.size(); ++level)
+            {
+                const TextureLevel &info = chain.Levels[level];
+                UpdateTextureArrayData(outAtlas.TextureID, level, layer, 0, 0, info.Width, info.Height, format, GL_UNSIGNED_BYTE, chain.Storage.data() + info.Offset);
+            }
+        }
+
+        for (size_t i = 0; i < inImages.size(); ++i)
+        {
+            AtlasRegion &region = regions[i];
+            region.Offset = glm::vec2(static_cast<F32>(region.X) / width, static_cast<F32>(region.Y) / height);
+            region.Scale = glm::vec2(static_cast<F32>(region.Width) / width, static_cast<F32>(region.Height) / height);
+
+            outAtlas.Regions[inNames[i]] = region;
+        }
+
+        return true;
+    }
+
+    bool LoadMaterialAtlas( const Geometry &inGeometry,
+                            const std::string &inBaseDirectory,
+                            const TextureAtlasOptions &inOptions,
+                            TextureAtlas &outAtlas )
+    {
+        std::vector< std::string > names;
+        std::vector< Image > images;
+        std::unordered_map< std::string, size_t > loaded;
+
+        for (const auto &entry : inGeometry.Materials)
+        {
+            const std::string &name = entry.second.DiffuseTextureName;
+
+            if (name.empty() || loaded.count(name))
+            {
+                continue;
+            }
+
+            const std::filesystem::path path = inBaseDirectory.empty() ? std::filesystem::path(name) : std::filesystem::path(inBaseDirectory) / name;
+
+            Image image = {};
+            if (!LoadImage(path.generic_string(), image))
+            {
+                continue;
+            }
+
+            loaded[name] = images.size();
+            names.push_back(name);
+            images.push_back(image);
+        }
+
+        const bool isBuilt = !images.empty() && BuildTextureAtlas(names, images, inOptions, outAtlas);
+
+        for (auto &image : images)
+        {
+            FreeImage(image);
+        }
+
+        if (!isBuilt)
+        {
+            return false;
+        }
+
+        for (const auto &entry : inGeometry.Materials)
+        {
+            const auto founded = outAtlas.Regions.find(entry.second.DiffuseTextureName);
+
+            if (founded != outAtlas.Regions.end())
+            {
+                outAtlas.MaterialRegions[entry.first] = founded->second;
+            }
+        }
+
+        return true;
+    }
+
+    void BuildAtlasRegionTable(const TextureAtlas &inAtlas, const std::vector< std::string > &inNames, std::vector< glm::vec4 > &outTable)
+    {
+        outTable.clear();
+        outTable.reserve(inNames.size() * 2);
+
+        for (const auto &name : inNames)
+        {
+            const auto founded = inAtlas.Regions.find(name);
+            const AtlasRegion region = founded != inAtlas.Regions.end() ? founded->second : AtlasRegion();
+
+            outTable.push_back(glm::vec4(region.Offset.x, region.Offset.y, region.Scale.x, region.Scale.y));
+            outTable.push_back(glm::vec4(static_cast<F32>(region.Layer), 0.0f, 0.0f, 0.0f));
+        }
+    }
+
+    void RemapTexCoords(Geometry &outGeometry, const AtlasRegion &inRegion)
+    {
+        for (auto &vertex : outGeometry.Vertices_1P1N1UV1T1BT)
+        {
+            vertex.TexCoord = inRegion.Offset + vertex.TexCoord * inRegion.Scale;
+        }
+
+        for (auto &vertex : outGeometry.Vertices_1P1N1UV)
+        {
+            vertex.TexCoord = inRegion.Offset + vertex.TexCoord * inRegion.Scale;
         }
-        return GL_ARRAY_BUFFER;
-    }
 
-    static constexpr GLenum BufferUsageToGlBufferUsage(BufferUsage inUsage)
-    {
-        switch (inUsage)
+        for (auto &vertex : outGeometry.Vertices_1P1UV)
         {
-        case BufferUsage::DynamicCopy: return GL_DYNAMIC_COPY;
-        case BufferUsage::DynamicDraw: return GL_DYNAMIC_DRAW;
-        case BufferUsage::DynamicRead: return GL_DYNAMIC_READ;
-        case BufferUsage::StaticCopy: return GL_STATIC_COPY;
-        case BufferUsage::StaticDraw: return GL_STATIC_DRAW;
-        case BufferUsage::StaticRead: return GL_STATIC_READ;
-        case BufferUsage::StreamCopy: return GL_STREAM_COPY;
-        case BufferUsage::StreamDraw: return GL_STREAM_DRAW;
-        case BufferUsage::StreamRead: return GL_STREAM_READ;
+            vertex.TexCoord = inRegion.Offset + vertex.TexCoord * inRegion.Scale;
         }
-        return GL_STATIC_DRAW;
     }
 
-    /* IO */
+    void DeleteTextureAtlas(TextureAtlas &outAtlas)
+    {
+        DeleteTexture(outAtlas.TextureID);
+        outAtlas = TextureAtlas();
+    }
 
-    bool LoadFile(const std::string &inFileName, std::string &outData)
+    /* Mip streaming */
+
+    // Coarsest levels, up to inResidentSize, stay uploaded for the whole lifetime of the texture.
+    static U32 StreamedBaseLevel(const StreamedTexture &inTexture, I32 inResidentSize)
     {
-        std::ifstream file(inFileName.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+        U32 level = 0;
 
-        if (file.bad())
+        while (level + 1 < inTexture.LevelCount && std::max(inTexture.Width >> level, inTexture.Height >> level) > inResidentSize)
         {
-            return false;
+            level++;
         }
 
-        file.seekg(0, std::ios::end);
-        const auto fileSize = file.tellg();
+        return level;
+    }
 
-        if (fileSize > 0)
+    // Streamed textures are specified per level instead of with immutable storage, which would commit every level up front.
+    static void UploadStreamedLevel(StreamedTexture &outTexture, U32 inLevel)
+    {
+        const TextureData &data = outTexture.Data;
+        const TextureLevel &level = data.Levels[inLevel];
+
+        glBindTexture(GL_TEXTURE_2D, outTexture.TextureID);
+
+        ScopedUnpackAlignment unpackAlignment(1);
+
+        if (data.Compression != TextureCompression::None)
         {
-            outData.resize( static_cast<size_t>(fileSize) );
-            file.seekg(0, std::ios::beg);
-            file.read(&outData.front(), fileSize);
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(inLevel), data.InternalFormat, level.Width, level.Height, 0,
+                                   static_cast<GLsizei>(level.Size), data.LevelData(inLevel));
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(inLevel), static_cast<GLint>(data.InternalFormat), level.Width, level.Height, 0,
+                         data.Format, data.Type, data.LevelData(inLevel));
         }
 
-        file.close();
-        return true;
-    }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(inLevel));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(outTexture.LevelCount) - 1);
 
-    /* Images */
+        outTexture.ResidentLevel = inLevel;
+        outTexture.ResidentBytes += level.Size;
+
+        GPF_GL_STAT(TextureBinds, 1);
+        GPF_GL_STAT(TextureUploads, 1);
+        GPF_GL_STAT(TextureBytesUploaded, level.Size);
+    }
 
-    bool LoadImage(const std::string &inFileName, Image &outImage)
+    // Clamps sampling to the next level first, then respecifies the dropped level as empty to free it.
+    static void DropStreamedLevel(StreamedTexture &outTexture)
     {
-        I32 x = 0;
-        I32 y = 0;
-        I32 comp = 0;
+        const TextureData &data = outTexture.Data;
+        const U32 level = outTexture.ResidentLevel;
 
-        stbi_set_flip_vertically_on_load(true);
-        outImage.Data = stbi_load(inFileName.c_str(), &x, &y, &comp, 0);
+        glBindTexture(GL_TEXTURE_2D, outTexture.TextureID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level + 1));
 
-        if (!glm::isPowerOfTwo(x) || !glm::isPowerOfTwo(y))
+        if (data.Compression != TextureCompression::None)
         {
-            std::cerr << "Warning: not vaid width or height - " << inFileName << "\n";
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), data.InternalFormat, 0, 0, 0, 0, nullptr);
         }
-
-        if (!outImage.Data)
+        else
         {
-			std::cerr << "Error: failed to load image - " << inFileName << "\n";
-            return false;
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), static_cast<GLint>(data.InternalFormat), 0, 0, 0, data.Format, data.Type, nullptr);
         }
 
-        outImage.Width = x;
-        outImage.Height = y;
-        outImage.Components = comp;
+        outTexture.ResidentLevel = level + 1;
+        outTexture.ResidentBytes -= data.Levels[level].Size;
 
-        return true;
+        GPF_GL_STAT(TextureBinds, 1);
     }
 
-    void FreeImage(Image &outImage)
+    StreamedTextureHandle MipStreamer::Load(const std::string &inFileName, const TextureLoadOptions &inOptions)
     {
-        if (!outImage.Data)
+        TextureLoadOptions options = inOptions;
+        options.GenerateMipMaps = true;
+
+        auto texture = std::make_shared<StreamedTexture>();
+
+        if (!LoadTextureData(inFileName, options, texture->Data))
         {
-            stbi_image_free(outImage.Data);
+            return nullptr;
+        }
 
-            outImage.Data = nullptr;
-            outImage.Width = 0;
-            outImage.Height = 0;
-            outImage.Components = 0;
+        texture->Path = inFileName;
+        texture->Width = texture->Data.Width;
+        texture->Height = texture->Data.Height;
+        texture->LevelCount = static_cast<U32>(texture->Data.Levels.size());
+        texture->ResidentLevel = texture->LevelCount;
+        texture->RequestedLevel = texture->LevelCount - 1;
+        texture->TextureID = GenerateTexture();
+
+        const U32 baseLevel = StreamedBaseLevel(*texture, ResidentSize);
+
+        for (U32 level = texture->LevelCount; level > baseLevel; --level)
+        {
+            UploadStreamedLevel(*texture, level - 1);
+            Stats.LevelsUploaded++;
         }
+
+        Stats.ResidentBytes += texture->ResidentBytes;
+        Textures.push_back(texture);
+
+        return texture;
     }
 
-    /* Load OBJ */
+    void MipStreamer::Request(const StreamedTextureHandle &inTexture, const AABB &inBounds, const glm::mat4 &inModel, const Camera &inCamera, F32 inViewportHeight)
+    {
+        Request(inTexture, ProjectedScreenSize(inBounds, inModel, inCamera, inViewportHeight));
+    }
 
-    inline void FetchMaterials(const std::vector<tinyobj::material_t> &inMatreials, Geometry &outGeometry)
+    void MipStreamer::Request(const StreamedTextureHandle &inTexture, F32 inScreenSize)
     {
-        for (const auto &material : inMatreials) 
+        if (!inTexture || inTexture->LevelCount == 0)
         {
-            // TODO: Get parameters from material.ambient_texopt and other textures ...
-            const auto founded = outGeometry.Materials.find(material.name);
-
-            if (founded == std::end(outGeometry.Materials))
-            {
-                MaterialInfo materialInfo;
+            return;
+        }
 
-                materialInfo.Name = material.name;
-                materialInfo.AmbientTextureName = material.ambient_texname;
-                materialInfo.DiffuseTextureName = material.diffuse_texname;
-                materialInfo.SpecularTextureName = material.specular_texname;
-                materialInfo.HighlightTextureName = material.specular_highlight_texname;
-                materialInfo.BumpTextureName = material.bump_texname;
-                materialInfo.DisplacementTextureName = material.displacement_texname;
-                materialInfo.AlphaTextureName = material.alpha_texname;
-                materialInfo.ReflectionTextureName = material.reflection_texname;
+        // assumes the texture spans the mesh once, one texel per covered pixel
+        const F32 texels = static_cast<F32>(std::max(inTexture->Width, inTexture->Height));
+        const F32 ratio = texels / std::max(inScreenSize, 1.0f);
+        const F32 level = std::floor(std::log2(std::max(ratio, 1.0f)) + LevelBias);
+        const U32 wanted = static_cast<U32>(glm::clamp(level, 0.0f, static_cast<F32>(inTexture->LevelCount - 1)));
 
-                outGeometry.Materials.emplace( material.name, materialInfo );
-            }
+        if (inTexture->LastRequestFrame != Frame)
+        {
+            inTexture->RequestedLevel = wanted;
+            inTexture->ScreenSize = inScreenSize;
         }
+        else
+        {
+            inTexture->RequestedLevel = std::min(inTexture->RequestedLevel, wanted);
+            inTexture->ScreenSize = std::max(inTexture->ScreenSize, inScreenSize);
+        }
+
+        inTexture->LastRequestFrame = Frame;
     }
 
-    bool LoadOBJ(const std::string &inFileName, Geometry &outGeometry)
+    void MipStreamer::Update()
     {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string errs;
-        std::string warnings;
-        std::unordered_map<Vertex1P1N1UV1T1BT, U32> uniqueVertices = {};
+        Profile profile("MipStreamer::Update", Profile::CPU);
+
+        const size_t count = Textures.size();
+        std::vector< U32 > wanted(count);
+        std::vector< U32 > base(count);
 
-        if ( !tinyobj::LoadObj( &attrib, &shapes, &materials, &warnings, &errs, inFileName.c_str() ) ) 
+        // how far a resident level is from what the screen needs, larger gaps upload first
+        auto priority = [this](size_t inIndex, U32 inLevel)
         {
-            std::cerr << "Failed load mesh - " << inFileName << std::endl;
-            return false;
+            const StreamedTexture &texture = *Textures[inIndex];
+            const I32 size = std::max(std::max(texture.Width >> inLevel, texture.Height >> inLevel), 1);
+            return std::min(texture.ScreenSize, 1e6f) / static_cast<F32>(size);
+        };
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            StreamedTexture &texture = *Textures[i];
+            base[i] = StreamedBaseLevel(texture, ResidentSize);
+
+            const bool isRequested = Frame - texture.LastRequestFrame <= KeepFrames && texture.LastRequestFrame != 0;
+            wanted[i] = isRequested ? std::min(texture.RequestedLevel, base[i]) : base[i];
+
+            // nobody asked for a while, fall back to the resident levels
+            while (!isRequested && texture.ResidentLevel < base[i])
+            {
+                DropStreamedLevel(texture);
+                Stats.LevelsDropped++;
+            }
         }
 
-        if (!warnings.empty())
+        std::vector< size_t > order;
+        for (size_t i = 0; i < count; ++i)
         {
-            std::cerr << "Mesh loading - " << inFileName << " warning - " << warnings << ".\n";
+            if (wanted[i] < Textures[i]->ResidentLevel)
+            {
+                order.push_back(i);
+            }
         }
 
-        if (!errs.empty())
+        std::sort(order.begin(), order.end(), [&](size_t inLhs, size_t inRhs)
         {
-            std::cerr << "Mesh loading - " << errs << std::endl;
-            return false;
+            return priority(inLhs, Textures[inLhs]->ResidentLevel) > priority(inRhs, Textures[inRhs]->ResidentLevel);
+        });
+
+        size_t residentBytes = 0;
+        for (const auto &texture : Textures)
+        {
+            residentBytes += texture->ResidentBytes;
         }
 
-        FetchMaterials( materials, outGeometry );
+        // Frees inBytes by dropping the finest levels of less needed textures, levels above what is wanted go first.
+        // Runs on a copy of the resident levels and only touches GL when the upload fits in the end.
+        std::vector< U32 > levels(count);
 
-        for (const auto& shape : shapes) 
+        auto makeRoom = [&](size_t inCandidate, size_t inBytes) -> bool
         {
-            for (const auto& index : shape.mesh.indices) 
+            for (size_t i = 0; i < count; ++i)
             {
-                Vertex1P1N1UV1T1BT vertex = {};
+                levels[i] = Textures[i]->ResidentLevel;
+            }
 
-                // position
-                vertex.Position = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2]
-                };
+            const F32 candidatePriority = priority(inCandidate, levels[inCandidate]);
+            size_t bytes = residentBytes;
 
-                // texcoords
-                vertex.TexCoord = { 1.0, 1.0 };
+            while (bytes + inBytes > BudgetInBytes)
+            {
+                I32 victim = -1;
+                bool isVictimExcess = false;
 
-                if (index.texcoord_index > 0)
+                for (size_t i = 0; i < count; ++i)
                 {
-                    vertex.TexCoord = {
-                        attrib.texcoords[2 * index.texcoord_index + 0],
-                        1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                    };
+                    if (i == inCandidate || levels[i] >= base[i])
+                    {
+                        continue;
+                    }
+
+                    const bool isExcess = levels[i] < wanted[i];
+
+                    if (!isExcess && priority(i, levels[i]) >= candidatePriority)
+                    {
+                        continue;
+                    }
+
+                    if (victim < 0 || (isExcess && !isVictimExcess) ||
+                        (isExcess == isVictimExcess && priority(i, levels[i]) < priority(victim, levels[victim])))
+                    {
+                        victim = static_cast<I32>(i);
+                        isVictimExcess = isExcess;
+                    }
                 }
 
-                // normals
-                vertex.Normal = { 1.0f, 1.0f, 1.0f };
-
-                if (!attrib.normals.empty())
+                if (victim < 0)
                 {
-					if (index.normal_index >= 0)
-					{
-						vertex.Normal = {
-							attrib.normals[3 * index.normal_index + 0],
-							attrib.normals[3 * index.normal_index + 1],
-							attrib.normals[3 * index.normal_index + 2]
-						};
-					}
+                    return false;
                 }
 
-                if (uniqueVertices.count(vertex) == 0)
+                bytes -= Textures[victim]->Data.Levels[levels[victim]].Size;
+                levels[victim]++;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                while (Textures[i]->ResidentLevel < levels[i])
                 {
-                    uniqueVertices[vertex] = static_cast<U32>(outGeometry.Vertices_1P1N1UV1T1BT.size());
-                    outGeometry.Vertices_1P1N1UV1T1BT.push_back(vertex);
+                    DropStreamedLevel(*Textures[i]);
+                    Stats.LevelsDropped++;
                 }
+            }
+
+            residentBytes = bytes;
+            return true;
+        };
 
-                outGeometry.Indices.push_back(uniqueVertices[vertex]);
+        U32 uploads = 0;
 
-                outGeometry.Bounds.Min = glm::min(outGeometry.Bounds.Min, vertex.Position);
-			    outGeometry.Bounds.Max = glm::max(outGeometry.Bounds.Max, vertex.Position);
+        for (size_t index : order)
+        {
+            if (uploads >= MaxUploadsPerFrame)
+            {
+                break;
             }
-        }
 
-		// compute tangent / bitangent
-		for (size_t i = 0; i < outGeometry.Vertices_1P1N1UV1T1BT.size() - 1; i += 3)
-		{
-			Vertex1P1N1UV1T1BT& v0 = outGeometry.Vertices_1P1N1UV1T1BT[i + 0];
-			Vertex1P1N1UV1T1BT& v1 = outGeometry.Vertices_1P1N1UV1T1BT[i + 1];
-			Vertex1P1N1UV1T1BT& v2 = outGeometry.Vertices_1P1N1UV1T1BT[i + 2];
+            StreamedTexture &texture = *Textures[index];
+            const U32 level = texture.ResidentLevel - 1;
+            const size_t size = texture.Data.Levels[level].Size;
 
-			glm::vec3 edge1 = v1.Position - v0.Position;
-			glm::vec3 edge2 = v2.Position - v1.Position;
-
-			glm::vec2 deltaUV1 = v1.TexCoord - v0.TexCoord;
-			glm::vec2 deltaUV2 = v2.TexCoord - v1.TexCoord;
+            if (!makeRoom(index, size))
+            {
+                Stats.BudgetMisses++;
+                continue;
+            }
 
-			float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-			glm::vec3 tangent1;
-			glm::vec3 bitangent1;
-
-			tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-			tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-			tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-			tangent1 = glm::normalize(tangent1);
-
-			bitangent1.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-			bitangent1.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-			bitangent1.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-			bitangent1 = glm::normalize(bitangent1);
+            UploadStreamedLevel(texture, level);
+            residentBytes += size;
+            uploads++;
+            Stats.LevelsUploaded++;
+        }
 
-			v0.Tangent = tangent1;
-			v1.Tangent = tangent1;
-			v2.Tangent = tangent1;
+        Stats.ResidentBytes = residentBytes;
+        Frame++;
+    }
 
-			v0.Bitangent = bitangent1;
-			v1.Bitangent = bitangent1;
-			v2.Bitangent = bitangent1;
-		}
-		
-        outGeometry.VertexCount = static_cast<U32>(outGeometry.Vertices_1P1N1UV1T1BT.size());
-        outGeometry.IndexCount = static_cast<U32>(outGeometry.Indices.size());
+    void MipStreamer::Release(const StreamedTextureHandle &inTexture)
+    {
+        const auto founded = std::find(Textures.begin(), Textures.end(), inTexture);
 
-        outGeometry.Bounds.Dimensions = outGeometry.Bounds.Max - outGeometry.Bounds.Min;
-	    outGeometry.Bounds.Center = (outGeometry.Bounds.Max + outGeometry.Bounds.Min) / 2.0f;
+        if (founded == Textures.end())
+        {
+            return;
+        }
 
-        return true;
+        Stats.ResidentBytes -= (*founded)->ResidentBytes;
+        DeleteTexture((*founded)->TextureID);
+        Textures.erase(founded);
     }
 
-    /* Primitives */
+    void MipStreamer::Clear()
+    {
+        for (auto &texture : Textures)
+        {
+            DeleteTexture(texture->TextureID);
+        }
 
-    Geometry Primitive_Plane()
+        Textures.clear();
+        Stats.ResidentBytes = 0;
+    }
+
+    void DumpMipStreamerStats(const MipStreamer &inStreamer)
     {
-        Geometry result;
+        const MipStreamerStats &stats = inStreamer.Stats;
 
-		Vertex1P1N1UV vertex;
-        vertex.Position = glm::vec3(-1.0f, 0.0f, 0.f);
-        vertex.TexCoord = glm::vec2(0.0f, 0.0f);
-        result.Vertices_1P1N1UV.push_back( vertex );
+        std::cout << "Mip streaming - " << inStreamer.Textures.size() << " textures, "
+                  << (stats.ResidentBytes >> 20) << " / " << (inStreamer.BudgetInBytes >> 20) << " MB, "
+                  << stats.LevelsUploaded << " levels uploaded, " << stats.LevelsDropped << " dropped, "
+                  << stats.BudgetMisses << " budget misses\n";
+    }
 
-        vertex.Position = glm::vec3(1.0f, 1.0f, 0.f);
-        vertex.TexCoord = glm::vec2(1.0f, 0.0f);
-        result.Vertices_1P1N1UV.push_back( vertex );
+    /* Pixel buffer ring */
 
-        vertex.Position = glm::vec3(1.0f,-1.0f, 0.f);
-        vertex.TexCoord = glm::vec2(1.0f, 1.0f);
-        result.Vertices_1P1N1UV.push_back( vertex );
+    bool PixelBufferRing::Create(BufferType inType, size_t inSlotSize, U32 inSlotCount)
+    {
+        Destroy();
 
-        vertex.Position = glm::vec3(-1.0f,-1.0f, 0.f);
-        vertex.TexCoord = glm::vec2(0.0f, 1.0f);
-        result.Vertices_1P1N1UV.push_back( vertex );
+        if (inSlotSize == 0 || inSlotCount == 0 || (inType != BufferType::PixelUnpack && inType != BufferType::PixelPack))
+        {
+            std::cerr << "Error: pixel buffer ring needs a pixel buffer type and a non empty slot size\n";
+            return false;
+        }
 
-        result.Indices = {
-			0, 1, 2,
-			2, 3, 0
-		};
+        // keep every slot at a mapping friendly alignment
+        Type = inType;
+        SlotSize = (inSlotSize + 255) & ~static_cast<size_t>(255);
+        SlotCount = inSlotCount;
+        Next = 0;
+        Fences.assign(inSlotCount, nullptr);
 
-        result.IndexCount = static_cast<U32>(result.Indices.size());
-        result.VertexCount = static_cast<U32>(result.Vertices_1P1N1UV.size());
+        const GLsizeiptr size = static_cast<GLsizeiptr>(SlotSize * SlotCount);
 
-        return result;
-    }
+        #ifdef __APPLE__
+            const GLenum target = BufferToGlBuffer(Type);
 
-    Geometry Primitive_ScreenQuad()
-    {
-        Geometry result;
+            glGenBuffers(1, &BufferID);
+            glBindBuffer(target, BufferID);
+            glBufferData(target, size, nullptr, Type == BufferType::PixelUnpack ? GL_STREAM_DRAW : GL_STREAM_READ);
+            glBindBuffer(target, 0);
+            GPF_GL_STAT(BufferBinds, 2);
 
-		Vertex1P1N1UV topLeft;
-        topLeft.Position = glm::vec3(-1.0f, -1.0f, 0.0f);
-        topLeft.TexCoord = glm::vec2(0.0f, 0.0f);
+            Staging.resize(SlotSize * SlotCount);
+            Mapped = Staging.data();
+        #else
+            const GLbitfield access = Type == BufferType::PixelUnpack ? GL_MAP_WRITE_BIT : GL_MAP_READ_BIT;
+            const GLbitfield flags = access | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 
-		Vertex1P1N1UV topRight;
-        topRight.Position = glm::vec3(1.0f, -1.0f, 0.0f);
-        topRight.TexCoord = glm::vec2(1.0f, 0.0f);
+            glCreateBuffers(1, &BufferID);
+            glNamedBufferStorage(BufferID, size, nullptr, flags);
+            Mapped = static_cast<U8*>(glMapNamedBufferRange(BufferID, 0, size, flags));
+        #endif
 
-		Vertex1P1N1UV bottomRight;
-        bottomRight.Position = glm::vec3(1.0f, 1.0f, 0.0f);
-        bottomRight.TexCoord = glm::vec2(1.0f, 1.0f);
+        if (!Mapped)
+        {
+            std::cerr << "Error: failed to map pixel buffer ring\n";
+            Destroy();
+            return false;
+        }
 
-		Vertex1P1N1UV bottomLeft;
-        bottomLeft.Position = glm::vec3(-1.0f, 1.0f, 0.0f);
-        bottomLeft.TexCoord = glm::vec2(0.0f, 1.0f);
+        return true;
+    }
 
-        result.Vertices_1P1N1UV = {
-            topLeft, topRight, bottomRight, bottomLeft
-        };
+    void PixelBufferRing::Destroy()
+    {
+        for (auto &fence : Fences)
+        {
+            if (fence)
+            {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
 
-        result.Indices = {
-            0, 1, 2,
-            2, 3, 0
-		};
+        if (BufferID)
+        {
+            #ifndef __APPLE__
+                if (Mapped)
+                {
+                    glUnmapNamedBuffer(BufferID);
+                }
+            #endif
 
-        result.IndexCount = static_cast<U32>(result.Indices.size());
-        result.VertexCount = static_cast<U32>(result.Vertices_1P1N1UV.size());
+            glDeleteBuffers(1, &BufferID);
+            BufferID = 0;
+        }
 
-        return result;
+        Mapped = nullptr;
+        SlotSize = 0;
+        SlotCount = 0;
+        Next = 0;
+        Fences.clear();
+        Staging.clear();
     }
 
-     /* Camera */
-
-    glm::mat4 GetProjectionMatrix(const Camera &inCamera)
+    bool PixelBufferRing::IsSlotAvailable(U32 inSlot)
     {
-        return glm::perspective( glm::radians(inCamera.Fov) , inCamera.Aspect, inCamera.Near, inCamera.Far );
+        return WaitSlot(inSlot, 0);
     }
 
-    glm::mat4 GetViewMatrix(Camera &outCamera)
+    bool PixelBufferRing::WaitSlot(U32 inSlot, U64 inTimeoutNs)
     {
-        glm::vec3 front;
-        front.x = glm::cos(glm::radians(outCamera.Yaw)) * glm::cos(glm::radians(outCamera.Pitch));
-        front.y = glm::sin(glm::radians(outCamera.Pitch));
-        front.z = glm::sin(glm::radians(outCamera.Yaw)) * glm::cos(glm::radians(outCamera.Pitch));
-        outCamera.Front = glm::normalize(front);
+        GLsync &fence = Fences[inSlot];
 
-        outCamera.Right = glm::normalize(glm::cross(outCamera.Front, outCamera.WorldUp));
-        outCamera.Up = glm::normalize(glm::cross(outCamera.Right, outCamera.Front));
+        if (!fence)
+        {
+            return true;
+        }
 
-        return glm::lookAt( outCamera.Position, 
-                            outCamera.Position + outCamera.Front, 
-                            outCamera.Up );
-    }
+        const GLenum result = glClientWaitSync(fence, inTimeoutNs ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, inTimeoutNs);
 
-    void MoveForward(Camera &outCamera, F64 inDt)
-    {
-	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
-	    outCamera.Position += outCamera.Front * velocity;
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+            return true;
+        }
+
+        if (result == GL_WAIT_FAILED)
+        {
+            std::cerr << "Error: wait on pixel buffer fence failed\n";
+        }
+
+        return false;
     }
 
-    void MoveBackward(Camera &outCamera, F64 inDt)
+    U8* PixelBufferRing::AcquireSlot(U32 &outSlot, bool inWait)
     {
-	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
-	    outCamera.Position -= outCamera.Front * velocity;
-    }
+        if (!Mapped)
+        {
+            return nullptr;
+        }
+
+        const U32 slot = Next;
+
+        if (!(inWait ? WaitSlot(slot) : IsSlotAvailable(slot)))
+        {
+            return nullptr;
+        }
 
-    void MoveLeft(Camera &outCamera, F64 inDt)
-    {
-	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
-	    outCamera.Position -= outCamera.Right * velocity;
+        Next = (Next + 1) % SlotCount;
+        outSlot = slot;
+
+        return SlotData(slot);
     }
 
-    void MoveRight(Camera &outCamera, F64 inDt)
+    void PixelBufferRing::FenceSlot(U32 inSlot)
     {
-	    const F32 velocity = static_cast<F32>(inDt) * outCamera.MovementSpeed;
-	    outCamera.Position += outCamera.Right * velocity;
+        if (Fences[inSlot])
+        {
+            glDeleteSync(Fences[inSlot]);
+        }
+
+        Fences[inSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
     }
 
-    void Rotate(Camera &outCamera, F64 inDeltaVertical, F64 inDeltaHorizontal)
+    /* Texture streaming */
+
+    void StreamTextureData( PixelBufferRing &inRing,
+                            U32 inSlot,
+                            U32 inTextureID,
+                            U32 inLevel,
+                            I32 inX,
+                            I32 inY,
+                            U32 inWidth,
+                            U32 inHeight,
+                            GLenum inFormat,
+                            GLenum inType )
     {
-        F32 fX = static_cast<F32>(inDeltaVertical);
-        F32 fY = static_cast<F32>(inDeltaHorizontal);
+        const size_t size = static_cast<size_t>(inWidth) * inHeight * PixelComponents(inFormat) * TypeSize(inType);
 
-        F32 xOffset = fX - outCamera.LastX;
-        F32 yOffset = outCamera.LastY - fY;
+        if (inRing.Type != BufferType::PixelUnpack || inSlot >= inRing.SlotCount || size > inRing.SlotSize)
+        {
+            std::cerr << "Error: texture stream update does not fit the pixel unpack slot\n";
+            return;
+        }
 
-        outCamera.LastX = fX;
-        outCamera.LastY = fY;
+        BindBuffer(BufferType::PixelUnpack, inRing.BufferID);
 
-        xOffset *= outCamera.MouseSpeed;
-        yOffset *= outCamera.MouseSpeed;
+        #ifdef __APPLE__
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLintptr>(inRing.SlotOffset(inSlot)), static_cast<GLsizeiptr>(size), inRing.SlotData(inSlot));
+        #endif
 
-        outCamera.Yaw += xOffset;
-        outCamera.Pitch += yOffset;
-        outCamera.Pitch = glm::clamp(outCamera.Pitch, -89.0f, 89.0f);
+        // the data pointer is an offset into the bound unpack buffer
+        const void *offset = static_cast<const char*>(nullptr) + inRing.SlotOffset(inSlot);
+
+        {
+            ScopedUnpackAlignment unpackAlignment(1);
+            UpdateTextureData(inTextureID, inLevel, inX, inY, inWidth, inHeight, inFormat, inType, offset);
+        }
+
+        BindBuffer(BufferType::PixelUnpack, 0);
+
+        inRing.FenceSlot(inSlot);
     }
 
-    /* Vertex Array Object */
+    /* Readback */
 
-    U32 GenerateVAO()
+    bool ReadbackQueue::Create(size_t inMaxBytes, U32 inSlotCount)
     {
-        U32 vao = 0;
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-        return vao;
+        InFlight.clear();
+        return Ring.Create(BufferType::PixelPack, inMaxBytes, inSlotCount);
     }
 
-    void BindVAO(U32 inID)
+    void ReadbackQueue::Destroy()
     {
-        glBindVertexArray(inID);
+        InFlight.clear();
+        Ring.Destroy();
     }
 
-    void DeleteVAO(U32& outVAO)
+    bool ReadbackQueue::Read( U32 inFramebufferID,
+                              GLenum inAttachment,
+                              I32 inX,
+                              I32 inY,
+                              U32 inWidth,
+                              U32 inHeight,
+                              GLenum inFormat,
+                              GLenum inType,
+                              U64 inTag )
     {
-        if (outVAO)
+        const size_t size = static_cast<size_t>(inWidth) * inHeight * PixelComponents(inFormat) * TypeSize(inType);
+
+        if (size > Ring.SlotSize)
         {
-            glDeleteVertexArrays(1, &outVAO);
-            outVAO = 0;
+            std::cerr << "Error: readback of " << size << " bytes does not fit the pixel pack slot\n";
+            return false;
         }
-    }
 
-    /* Buffer Object */
+        // every slot holds a result that has not been polled yet
+        if (InFlight.size() >= Ring.SlotCount)
+        {
+            return false;
+        }
 
-    U32 GenerateBuffer(BufferType inType)
-    {
-        U32 bufferID = 0;
-        glGenBuffers(1, &bufferID);
-        glBindBuffer(BufferToGlBuffer(inType), bufferID);
-        return bufferID;
-    }
+        U32 slot = 0;
+        if (!Ring.AcquireSlot(slot))
+        {
+            return false;
+        }
 
-    void BindBuffer(BufferType inType, U32 inID)
-    {
-        glBindBuffer(BufferToGlBuffer(inType), inID);
-    }
+        // the caller's read framebuffer, and the read buffer of inFramebufferID, are put back afterwards
+        GLint previousFramebuffer = 0;
+        GLint previousReadBuffer = GL_NONE;
+        GLint previousAlignment = 4;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_PACK_ALIGNMENT, &previousAlignment);
 
-    void UploadData(BufferType inType, BufferUsage inUsage, const void* inData, size_t inSize)
-    {
-        const auto target = BufferToGlBuffer(inType);
-        const auto usage = BufferUsageToGlBufferUsage(inUsage);
-        const auto size = static_cast<GLsizeiptr>( inSize );
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, inFramebufferID);
+        glGetIntegerv(GL_READ_BUFFER, &previousReadBuffer);
 
-        glBufferData(target, size, inData, usage);
-    }
+        const bool isColor = inAttachment != GL_DEPTH_ATTACHMENT && inAttachment != GL_STENCIL_ATTACHMENT && inAttachment != GL_DEPTH_STENCIL_ATTACHMENT;
 
-    void UploadDataImmutable(BufferType inType, const void* inData, size_t inSize)
-    {
-        const auto target = BufferToGlBuffer(inType);
-        const auto size = static_cast<GLsizeiptr>( inSize );
+        if (isColor)
+        {
+            glReadBuffer(inAttachment);
+        }
 
-        const auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
-        glBufferStorage(target, size, NULL, flags);
+        BindBuffer(BufferType::PixelPack, Ring.BufferID);
 
-        void* gpu = glMapBuffer(target, GL_WRITE_ONLY);
-        memcpy(gpu, inData, size);
-        glUnmapBuffer(target);
-    }
+        // the data pointer is an offset into the bound pack buffer
+        void *offset = static_cast<char*>(nullptr) + Ring.SlotOffset(slot);
 
-    void InvalidateBuffer(U32 inBufferID)
-    {
-        glInvalidateBufferData(inBufferID);
-    }
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(inX, inY, static_cast<GLsizei>(inWidth), static_cast<GLsizei>(inHeight), inFormat, inType, offset);
+        glPixelStorei(GL_PACK_ALIGNMENT, previousAlignment);
 
-    void DeleteBuffer(U32& outBuffer)
-    {
-        if (outBuffer)
+        BindBuffer(BufferType::PixelPack, 0);
+
+        if (isColor)
         {
-            glDeleteBuffers(1, &outBuffer);
-            outBuffer = 0;
+            glReadBuffer(static_cast<GLenum>(previousReadBuffer));
         }
-	}
 
-    /* Textures */
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<U32>(previousFramebuffer));
 
-    U32 GenerateTexture()
-    {
-        U32 textureID = 0;
-        glGenTextures(1, &textureID);
-        return textureID;
+        GPF_GL_STAT(FramebufferBinds, 2);
+
+        Ring.FenceSlot(slot);
+
+        Request request;
+        request.Slot = slot;
+        request.Size = size;
+        request.Width = inWidth;
+        request.Height = inHeight;
+        request.Format = inFormat;
+        request.Type = inType;
+        request.Tag = inTag;
+        InFlight.push_back(request);
+
+        return true;
     }
 
-    void UploadTextureData( const Image &inImage, U32 &outTextureID, bool inGenerateMipMaps )
+    bool ReadbackQueue::Poll(ReadbackResult &outResult)
     {
-        GLenum format = GL_RGB;
+        if (InFlight.empty())
+        {
+            return false;
+        }
 
-	    if (inImage.Components == 1) format = GL_RED;
-	    else if (inImage.Components == 3) format = GL_RGB;
-	    else if (inImage.Components == 4) format = GL_RGBA;
+        const Request request = InFlight.front();
 
-        glBindTexture(GL_TEXTURE_2D, outTextureID);
-	    glTexImage2D(GL_TEXTURE_2D, 0, format, inImage.Width, inImage.Height, 0, format, GL_UNSIGNED_BYTE, inImage.Data);
+        if (!Ring.IsSlotAvailable(request.Slot))
+        {
+            return false;
+        }
+
+        InFlight.pop_front();
+
+        #ifdef __APPLE__
+            BindBuffer(BufferType::PixelPack, Ring.BufferID);
+            glGetBufferSubData(GL_PIXEL_PACK_BUFFER, static_cast<GLintptr>(Ring.SlotOffset(request.Slot)), static_cast<GLsizeiptr>(request.Size), Ring.SlotData(request.Slot));
+            BindBuffer(BufferType::PixelPack, 0);
+        #endif
 
-		if (inGenerateMipMaps)
-		{
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
+        outResult.Data = Ring.SlotData(request.Slot);
+        outResult.Size = request.Size;
+        outResult.Width = request.Width;
+        outResult.Height = request.Height;
+        outResult.Format = request.Format;
+        outResult.Type = request.Type;
+        outResult.Tag = request.Tag;
+
+        return true;
     }
 
-    void UploadTextureData( const void * inData,
-                            U32 inWidth, 
-                            U32 inHeight, 
-                            U32 &outTextureID, 
-                            GLenum inType,
-                            GLenum inInternalFormat, 
-                            GLenum inFormat )
+    /* Draw */
+
+    void DrawArrays(GLenum inMode, U32 inFirst, U32 inCount)
     {
-        glBindTexture(GL_TEXTURE_2D, outTextureID);
-	    glTexImage2D(GL_TEXTURE_2D, 0, inInternalFormat, inWidth, inHeight, 0, inFormat, inType, inData);
+        glDrawArrays(inMode, static_cast<GLint>(inFirst), static_cast<GLsizei>(inCount));
+        GPF_GL_STAT(DrawCalls, 1);
     }
 
-    void DeleteTexture(U32 &outID)
+    void DrawElements(GLenum inMode, U32 inCount, GLenum inType, size_t inOffset)
     {
-        if (outID)
-        {
-            glDeleteTextures(1, &outID);
-            outID = 0;
-        }
-    }
+        const GLvoid* offset = static_cast<const char*>(0) + inOffset;
 
-    /* Samplers */
+        glDrawElements(inMode, static_cast<GLsizei>(inCount), inType, offset);
+        GPF_GL_STAT(DrawCalls, 1);
+    }
 
-    U32 GenerateSampler()
+    void DrawElementsInstanced(GLenum inMode, U32 inCount, U32 inInstanceCount, GLenum inType, size_t inOffset)
     {
-        U32 samplerID = 0;
-        glGenSamplers(1, &samplerID);
-        return samplerID;
+        const GLvoid* offset = static_cast<const char*>(0) + inOffset;
+
+        glDrawElementsInstanced(inMode, static_cast<GLsizei>(inCount), inType, offset, static_cast<GLsizei>(inInstanceCount));
+        GPF_GL_STAT(DrawCalls, 1);
     }
 
-    void SetupSamplerParameters(const SamplerParameters &inParameters, U32 inSamplerID)
+    void DrawSubMesh(const Geometry &inGeometry, const SubMesh &inSubMesh, GLenum inMode)
     {
-        glSamplerParameteri(inSamplerID, GL_TEXTURE_WRAP_S, inParameters.WrapS);
-        glSamplerParameteri(inSamplerID, GL_TEXTURE_WRAP_T, inParameters.WrapT);
-        glSamplerParameteri(inSamplerID, GL_TEXTURE_MAG_FILTER, inParameters.MagFilter);
-        glSamplerParameteri(inSamplerID, GL_TEXTURE_MIN_FILTER, inParameters.MinFilter);
-        glSamplerParameterf(inSamplerID, GL_TEXTURE_MAX_ANISOTROPY_EXT, inParameters.MaxAnisotropy);
+        DrawElements(inMode, inSubMesh.IndexCount, inGeometry.IndexType, TypeSize(inGeometry.IndexType) * static_cast<size_t>(inSubMesh.FirstIndex));
     }
 
-    void BindSampler( U32 inSamplerID, U32 inTextureUnit )
+    void DrawGeometry(const Geometry &inGeometry, const std::function<void(const SubMesh&)> &inBindMaterial, GLenum inMode)
     {
-        glBindSampler(inTextureUnit, inSamplerID);
+        DrawGeometryLOD(inGeometry, 0, inBindMaterial, inMode);
     }
 
-    void UnbindSampler( U32 inTextureUnit )
+    void DrawGeometryLOD(const Geometry &inGeometry, U32 inLOD, const std::function<void(const SubMesh&)> &inBindMaterial, GLenum inMode)
     {
-        glBindSampler(inTextureUnit, 0);
+        BindVAO(inGeometry.VAO);
+
+        if (inGeometry.SubMeshes.empty())
+        {
+            DrawElements(inMode, inGeometry.IndexCount, inGeometry.IndexType);
+            return;
+        }
+
+        const U32 lod = std::min<U32>(inLOD, static_cast<U32>(inGeometry.LODs.size()));
+        const std::vector< SubMesh > &subMeshes = lod == 0 ? inGeometry.SubMeshes : inGeometry.LODs[lod - 1].SubMeshes;
+
+        for (const SubMesh &subMesh : subMeshes)
+        {
+            if (inBindMaterial)
+            {
+                inBindMaterial(subMesh);
+            }
+
+            DrawSubMesh(inGeometry, subMesh, inMode);
+        }
     }
 
-    void DeleteSampler(U32 &outSampler)
+    void DrawMeshlets(const Geometry &inGeometry, const std::vector< U32 > &inVisible, const std::function<void(const SubMesh&)> &inBindMaterial, GLenum inMode)
     {
-        if (outSampler != 0)
+        BindVAO(inGeometry.VAO);
+
+        const size_t indexSize = TypeSize(inGeometry.IndexType);
+        std::vector< GLsizei > counts;
+        std::vector< const GLvoid* > offsets;
+        size_t i = 0;
+
+        while (i < inVisible.size())
         {
-            glDeleteSamplers(1, &outSampler);
-            outSampler = 0;
+            const U32 subMeshIndex = inGeometry.Meshlets[inVisible[i]].SubMeshIndex;
+            U32 end = 0;
+
+            counts.clear();
+            offsets.clear();
+
+            for (; i < inVisible.size() && inGeometry.Meshlets[inVisible[i]].SubMeshIndex == subMeshIndex; ++i)
+            {
+                const Meshlet &meshlet = inGeometry.Meshlets[inVisible[i]];
+
+                if (!counts.empty() && meshlet.FirstIndex == end)
+                {
+                    counts.back() += static_cast<GLsizei>(meshlet.IndexCount);
+                }
+                else
+                {
+                    counts.push_back(static_cast<GLsizei>(meshlet.IndexCount));
+                    offsets.push_back(static_cast<const char*>(0) + indexSize * meshlet.FirstIndex);
+                }
+
+                end = meshlet.FirstIndex + meshlet.IndexCount;
+            }
+
+            if (inBindMaterial && subMeshIndex < inGeometry.SubMeshes.size())
+            {
+                inBindMaterial(inGeometry.SubMeshes[subMeshIndex]);
+            }
+
+            glMultiDrawElements(inMode, counts.data(), inGeometry.IndexType, offsets.data(), static_cast<GLsizei>(counts.size()));
+            GPF_GL_STAT(DrawCalls, 1);
         }
     }
 
@@ -640,18 +8887,24 @@ namespace GPF
 
     bool LoadShader(const std::string &inFileName, GLenum inType, ShaderList &outList)
     {
-        std::string content;
-        if (!LoadFile(inFileName, content))
+        MappedFile file;
+        if (!MapFile(inFileName, file, MapHint::Sequential))
         {
             std::cerr << "Failed to load shader - " << inFileName << "\n";
             return false;
         }
 
-        if (!content.empty())
+        return CompileShaderSource(file.Chars(), file.Size, inType, inFileName, outList);
+    }
+
+    bool CompileShaderSource(const char *inSource, size_t inLength, GLenum inType, const std::string &inName, ShaderList &outList)
+    {
+        if (inLength > 0)
         {
-            const char *shaderCode = content.c_str();
+            const char *shaderCode = inSource;
+            const GLint shaderLength = static_cast<GLint>(inLength);
             U32 shaderID = glCreateShader(inType);
-            glShaderSource(shaderID, 1, &shaderCode, NULL);
+            glShaderSource(shaderID, 1, &shaderCode, &shaderLength);
             glCompileShader(shaderID);
 
             I32 infoLogLen = 0;
@@ -668,7 +8921,7 @@ namespace GPF
                 return false;
             }
 
-			std::cout << "Loaded shader - " << inFileName << "\n";
+			std::cout << "Loaded shader - " << inName << "\n";
             outList.push_back( shaderID );
             return true;
         }
@@ -721,6 +8974,12 @@ namespace GPF
         return true;
     }
 
+    void UseProgram(U32 inProgramID)
+    {
+        glUseProgram(inProgramID);
+        GPF_GL_STAT(ProgramBinds, 1);
+    }
+
     void DeleteShaderProgram(U32 &outProgramID)
     {
         if (outProgramID != 0)
@@ -764,119 +9023,298 @@ namespace GPF
 	{
 		const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
 		glUniform3fv(uniformID, static_cast<I32>( inValues.size() ), &(inValues[0])[0] );
+		GPF_GL_STAT(UniformUpdates, 1);
 	}
 
 	void SetVec3Array(const char* inUniformName, const std::vector< glm::vec3 >& inValues, U32 inProgramID)
 	{
 		const I32 uniformID = GetUniform(inUniformName, inProgramID);
 		glUniform3fv(uniformID, static_cast<I32>(inValues.size()), &(inValues[0])[0]);
+		GPF_GL_STAT(UniformUpdates, 1);
 	}
 
     void SetMat4(const char * inUniformName, const glm::mat4 &inMat, U32 inProgramID, UniformCache &outCache )
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniformMatrix4fv( uniformID, 1, GL_FALSE, &inMat[0][0] );
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetMat4(const char * inUniformName, const glm::mat4 &inMat, U32 inProgramID)
     {
         const I32 uniformID = GetUniform(inUniformName, inProgramID);
         glUniformMatrix4fv( uniformID, 1, GL_FALSE, &inMat[0][0] );
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetMat3(const char * inUniformName, const glm::mat3 &inMat, U32 inProgramID, UniformCache &outCache)
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniformMatrix3fv( uniformID, 1, GL_FALSE, &inMat[0][0] );
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
 	void SetMat3(const char* inUniformName, const glm::mat3& inMat, U32 inProgramID)
 	{
 		const I32 uniformID = GetUniform(inUniformName, inProgramID);
 		glUniformMatrix3fv(uniformID, 1, GL_FALSE, &inMat[0][0]);
+		GPF_GL_STAT(UniformUpdates, 1);
 	}
 
     void SetVec4(const char * inUniformName, const glm::vec4 &inVec, U32 inProgramID, UniformCache &outCache)
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniform4fv(uniformID, 1, &inVec[0]);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetVec4(const char * inUniformName, const glm::vec4 &inVec, U32 inProgramID)
     {
         const I32 uniformID = GetUniform(inUniformName, inProgramID);
         glUniform4fv(uniformID, 1, &inVec[0]);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetVec3(const char * inUniformName, const glm::vec3 &inVec, U32 inProgramID, UniformCache &outCache)
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniform3fv(uniformID, 1, &inVec[0]);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetVec3(const char * inUniformName, const glm::vec3 &inVec, U32 inProgramID)
     {
         const I32 uniformID = GetUniform(inUniformName, inProgramID);
         glUniform3fv(uniformID, 1, &inVec[0]);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetVec2(const char * inUniformName, const glm::vec2 &inVec, U32 inProgramID, UniformCache &outCache)
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniform2fv(uniformID, 1, &inVec[0]);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetVec2(const char * inUniformName, const glm::vec2 &inVec, U32 inProgramID)
     {
         const I32 uniformID = GetUniform(inUniformName, inProgramID);
         glUniform2fv(uniformID, 1, &inVec[0]);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetDouble( const char * inUniformName, F64 inValue, U32 inProgramID, UniformCache &outCache )
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniform1d(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetDouble( const char * inUniformName, F64 inValue, U32 inProgramID)
     {
         const I32 uniformID = GetUniform( inUniformName, inProgramID );
         glUniform1d(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetFloat( const char * inUniformName, F32 inValue, U32 inProgramID, UniformCache &outCache )
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniform1f(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetFloat( const char * inUniformName, F32 inValue, U32 inProgramID)
     {
         const I32 uniformID = GetUniform( inUniformName, inProgramID );
         glUniform1f(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetInt( const char * inUniformName, I32 inValue, U32 inProgramID, UniformCache &outCache )
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniform1i(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetInt( const char * inUniformName, I32 inValue, U32 inProgramID )
     {
         const I32 uniformID = GetUniform(inUniformName, inProgramID);
         glUniform1i(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetUInt( const char * inUniformName, U32 inValue, U32 inProgramID, UniformCache &outCache )
     {
         const I32 uniformID = GetCachedUniform(inUniformName, inProgramID, outCache);
         glUniform1ui(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
     }
 
     void SetUInt( const char * inUniformName, U32 inValue, U32 inProgramID )
     {
         const I32 uniformID = GetUniform(inUniformName, inProgramID);
         glUniform1ui(uniformID, inValue);
+        GPF_GL_STAT(UniformUpdates, 1);
+    }
+
+    /* Async loading */
+
+    static std::deque< std::function<void()> > s_Uploads;
+    static std::mutex s_UploadsMutex;
+
+    void EnqueueUpload(std::function<void()> inUpload)
+    {
+        std::lock_guard<std::mutex> lock(s_UploadsMutex);
+        s_Uploads.push_back( std::move(inUpload) );
+    }
+
+    size_t ProcessUploads(F64 inBudgetMs)
+    {
+        Profile profile("ProcessUploads", Profile::CPU);
+
+        const F64 start = ProfilerManager::Now();
+
+        while (true)
+        {
+            std::function<void()> upload;
+            {
+                std::lock_guard<std::mutex> lock(s_UploadsMutex);
+
+                if (s_Uploads.empty())
+                {
+                    return 0;
+                }
+
+                upload = std::move(s_Uploads.front());
+                s_Uploads.pop_front();
+            }
+
+            upload();
+
+            if (ProfilerManager::Now() - start >= inBudgetMs)
+            {
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(s_UploadsMutex);
+        return s_Uploads.size();
+    }
+
+    AsyncTextureHandle LoadTextureAsync(const std::string &inFileName, const TextureLoadOptions &inOptions)
+    {
+        auto handle = std::make_shared<AsyncTexture>();
+
+        g_Jobs.Submit([handle, inFileName, inOptions]()
+        {
+            auto data = std::make_shared<TextureData>();
+
+            {
+                Profile profile("LoadTextureData", Profile::CPU);
+
+                if (!LoadTextureData(inFileName, inOptions, *data))
+                {
+                    handle->State.store(AsyncState::Failed, std::memory_order_release);
+                    return;
+                }
+            }
+
+            EnqueueUpload([handle, data]()
+            {
+                handle->TextureID = GenerateTexture();
+                handle->Width = data->Width;
+                handle->Height = data->Height;
+                handle->Components = data->Components;
+
+                UploadTextureData(*data, handle->TextureID);
+
+                handle->State.store(AsyncState::Ready, std::memory_order_release);
+            });
+        });
+
+        return handle;
+    }
+
+    AsyncGeometryHandle LoadOBJAsync(const std::string &inFileName, bool inUpload)
+    {
+        auto handle = std::make_shared<AsyncGeometry>();
+
+        g_Jobs.Submit([handle, inFileName, inUpload]()
+        {
+            if (inUpload)
+            {
+                auto cache = std::make_shared<MeshCache>();
+
+                if (LoadValidMeshCache(inFileName, *cache))
+                {
+                    // vertices go straight from the mapping to the GPU, never copied CPU side
+                    EnqueueUpload([handle, cache]()
+                    {
+                        UploadMeshCache(*cache, handle->Data);
+                        handle->State.store(AsyncState::Ready, std::memory_order_release);
+                    });
+                    return;
+                }
+            }
+
+            {
+                Profile profile("LoadOBJ", Profile::CPU);
+
+                if (!LoadOBJ(inFileName, handle->Data))
+                {
+                    handle->State.store(AsyncState::Failed, std::memory_order_release);
+                    return;
+                }
+            }
+
+            if (!inUpload)
+            {
+                handle->State.store(AsyncState::Ready, std::memory_order_release);
+                return;
+            }
+
+            EnqueueUpload([handle]()
+            {
+                UploadGeometry(handle->Data);
+                handle->State.store(AsyncState::Ready, std::memory_order_release);
+            });
+        });
+
+        return handle;
     }
-}
\ No newline at end of file
+
+    AsyncShaderHandle LoadShaderAsync(const std::string &inFileName, GLenum inType)
+    {
+        auto handle = std::make_shared<AsyncShader>();
+
+        g_Jobs.Submit([handle, inFileName, inType]()
+        {
+            auto file = std::make_shared<MappedFile>();
+
+            if (!MapFile(inFileName, *file, MapHint::WillNeed))
+            {
+                std::cerr << "Failed to load shader - " << inFileName << "\n";
+                handle->State.store(AsyncState::Failed, std::memory_order_release);
+                return;
+            }
+
+            EnqueueUpload([handle, file, inFileName, inType]()
+            {
+                ShaderList shaders;
+
+                if (!CompileShaderSource(file->Chars(), file->Size, inType, inFileName, shaders))
+                {
+                    handle->State.store(AsyncState::Failed, std::memory_order_release);
+                    return;
+                }
+
+                handle->ShaderID = shaders.front();
+                handle->State.store(AsyncState::Ready, std::memory_order_release);
+            });
+        });
+
+        return handle;
+    }
+}
@@ -14,6 +14,14 @@
 #include <limits>
 #include <cstdint>
 #include <cassert>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -147,7 +155,40 @@ namespace GPF
         }
     };
 
-    // TODO: add internal texture cache and load materials 
+    // Storage of one GL_HALF_FLOAT component, only used to pick the attribute type.
+    struct Half
+    {
+        U16 Bits;
+    };
+
+    // x, y, z and w of a GL_INT_2_10_10_10_REV attribute in one word.
+    struct PackedInt2101010
+    {
+        U32 Bits;
+    };
+
+    enum class PositionEncoding : U32
+    {
+        Unorm16,    // (p - Offset) / Scale with Offset = Bounds.Min and Scale = Bounds.Dimensions
+        Half        // p - Offset with Offset = Bounds.Center and Scale = 1
+    };
+
+    // Shaders rebuild the position as Offset + Scale * attribute.xyz.
+    struct VertexQuantization
+    {
+        PositionEncoding Encoding = PositionEncoding::Unorm16;
+        glm::vec3 Offset = glm::vec3(0.0f);
+        glm::vec3 Scale = glm::vec3(1.0f);
+    };
+
+    // 20 bytes against 56 for Vertex1P1N1UV1T1BT. The bitangent is cross(normal, tangent.xyz) * tangent.w.
+    struct VertexQuantized
+    {
+        U16 Position[4];            // see VertexQuantization, w is padding
+        I16 Normal[2];              // octahedral, snorm16
+        U16 TexCoord[2];            // half
+        PackedInt2101010 Tangent;   // snorm10 xyz, w is the handedness, -1 or 1
+    };
 
     struct MaterialInfo
     {
@@ -168,14 +209,54 @@ namespace GPF
         return inLhs.Name == inRhs.Name;
     }
 
+    // Index range drawn with one material.
+    struct SubMesh
+    {
+        U32 FirstIndex = 0;
+        U32 IndexCount = 0;
+        std::string Material;   // key into Geometry::Materials, empty for faces without usemtl
+        AABB Bounds;
+    };
+
+    // Simplified level of detail, its ranges live in Geometry::Indices after the full detail ones.
+    struct GeometryLOD
+    {
+        F32 Error = 0.0f;                   // geometric deviation from the full detail mesh, relative to its bounding box diagonal
+        std::vector< SubMesh > SubMeshes;   // one per full detail submesh, same order and materials
+    };
+
+    // Cluster of at most MeshletOptions::MaxVertices / MaxTriangles contiguous triangles of one submesh, see BuildMeshlets.
+    // Laid out as five vec4s so the array can go to an std430 buffer as is.
+    struct Meshlet
+    {
+        glm::vec3 Center = glm::vec3(0.0f);     // bounding sphere
+        F32 Radius = 0.0f;
+        glm::vec3 BoundsMin = glm::vec3(0.0f);
+        U32 FirstIndex = 0;
+        glm::vec3 BoundsMax = glm::vec3(0.0f);
+        U32 IndexCount = 0;
+        glm::vec3 ConeApex = glm::vec3(0.0f);   // backface cone, culled when dot(normalize(ConeApex - eye), ConeAxis) >= ConeCutoff
+        F32 ConeCutoff = 2.0f;                  // sine of the cone half angle, above 1 when the normals spread too far to ever cull
+        glm::vec3 ConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        U32 SubMeshIndex = 0;                   // into Geometry::SubMeshes
+    };
+
     struct Geometry
     {
         std::vector< Vertex1P1N1UV1T1BT > Vertices_1P1N1UV1T1BT;
 		std::vector< Vertex1P1N1UV > Vertices_1P1N1UV;
         std::vector< Vertex1P1UV > Vertices_1P1UV;
+        std::vector< VertexQuantized > Vertices_Quantized;  // preferred for upload and cache when filled, see QuantizeGeometry
+        VertexQuantization Quantization;
         std::vector< U32 > Indices;
 
         std::unordered_map< std::string, MaterialInfo > Materials;
+        // Contiguous and sorted by material. LoadOBJ, GenerateLODs and BuildMeshlets always leave at least one,
+        // an unnamed one covering everything when there are no materials. Primitives and hand built geometry may
+        // leave it empty, DrawGeometry then draws IndexCount indices as one range.
+        std::vector< SubMesh > SubMeshes;
+        std::vector< GeometryLOD > LODs;    // coarser levels, LODs[0] is level 1
+        std::vector< Meshlet > Meshlets;    // over the full detail submeshes, in index order
         AABB Bounds;
 
         U32 VAO;
@@ -184,6 +265,7 @@ namespace GPF
 
         U32 IndexCount;
         U32 VertexCount;
+        GLenum IndexType = GL_UNSIGNED_INT;     // of the uploaded IBO, GL_UNSIGNED_SHORT below 65536 vertices
     };
 
     struct SamplerParameters
@@ -198,15 +280,173 @@ namespace GPF
 
     /* Profiling */
 
-    static struct ProfilerManager
+    // Per-thread sample ring capacity, must be a power of two.
+    #ifndef GPF_PROFILER_RING_SIZE
+    #define GPF_PROFILER_RING_SIZE 4096
+    #endif
+
+    // Number of frames kept per scope for min / avg / percentile aggregation.
+    #ifndef GPF_PROFILER_HISTORY_SIZE
+    #define GPF_PROFILER_HISTORY_SIZE 256
+    #endif
+
+    #ifndef GPF_PROFILER_MAX_DEPTH
+    #define GPF_PROFILER_MAX_DEPTH 64
+    #endif
+
+    // Frames a GPU timer result is given to come back before its queries are reused.
+    #ifndef GPF_PROFILER_GPU_LATENCY
+    #define GPF_PROFILER_GPU_LATENCY 4
+    #endif
+
+    struct ProfileSample
+    {
+        const char *Tag;
+        U64 Path;           // hash of the full scope path (parent path + tag)
+        U64 ParentPath;     // 0 for root scopes
+        F64 StartTime;      // milliseconds since profiler start
+        F64 Duration;       // milliseconds
+        U32 Depth;
+        U32 Thread;
+        U32 Type;           // Profile::ProfilingType
+    };
+
+    // Single producer (owning thread) / single consumer (collector) ring,
+    // the owning thread never takes a lock to record a sample.
+    struct ProfileThread
+    {
+        ProfileSample Ring[ GPF_PROFILER_RING_SIZE ];
+        std::atomic<U32> Head{ 0 };
+        std::atomic<U32> Tail{ 0 };
+        std::atomic<U64> Dropped{ 0 };
+
+        U64 Stack[ GPF_PROFILER_MAX_DEPTH ] = {};
+        U32 Depth = 0;
+
+        // slots are recycled once their thread exits
+        std::atomic<bool> Active{ true };
+
+        U32 Index = 0;
+        std::string Name;
+    };
+
+    struct ProfileStats
+    {
+        std::string Tag;
+        U64 Path = 0;
+        U64 ParentPath = 0;
+        U32 Depth = 0;
+        U32 Type = 0;
+        std::string Thread;
+
+        U64 Calls = 0;
+        F64 FrameTime = 0.0;
+        U32 FrameCalls = 0;
+
+        std::vector< F64 > History;
+        U32 HistoryHead = 0;
+    };
+
+    struct GPUProfileScope
+    {
+        ProfileSample Sample;
+        U32 BeginQuery;
+        U32 EndQuery;
+        bool IsEnded = false; // EndQuery has been issued
+    };
+
+    struct GPUProfileFrame
+    {
+        std::vector< U32 > Queries;
+        std::vector< GPUProfileScope > Scopes;
+        U64 Frame = 0; // FrameIndex the scopes were begun in
+        U32 UsedQueries = 0;
+        bool Pending = false;
+    };
+
+    struct ProfileSummary
+    {
+        std::string Name;
+        std::string FullName;
+        std::string Thread;
+        U32 Depth;
+        U32 Type;
+        U64 Calls;
+        U32 Frames;
+
+        // per frame totals, milliseconds
+        F64 Min;
+        F64 Avg;
+        F64 P95;
+        F64 P99;
+        F64 Max;
+        F64 Last;
+    };
+
+    // Streams profiler samples to a chrome://tracing / Perfetto JSON file from a background thread.
+    struct TraceWriter;
+
+    struct ProfilerManager
     {
-        std::unordered_map< const char*, F64 > ProfilingMap;
+        std::vector< std::unique_ptr<ProfileThread> > Threads;
+        std::unordered_map< U64, ProfileStats > Stats;
+        std::vector< U64 > StatsOrder;
+
+        std::mutex ThreadsMutex;
+        std::mutex StatsMutex;
+
+        U64 FrameIndex = 0;
+
+        // GPU timestamps, only touched from the GL thread
+        GPUProfileFrame GPUFrames[ GPF_PROFILER_GPU_LATENCY ];
+        U64 GPUStack[ GPF_PROFILER_MAX_DEPTH ] = {};
+        U32 GPUDepth = 0;
+        F64 GPUTimeOffset = 0.0;
+        U64 GPUSkippedFrames = 0;
+        U64 GPUDroppedScopes = 0; // begun but never ended
+        bool GPUInitialized = false;
+
+        static constexpr U32 InvalidGPUScope = 0xFFFFFFFF;
+
+        std::unique_ptr< TraceWriter > Trace;
+        F64 FrameStartTime = 0.0;
+
+        ProfilerManager();
+        ~ProfilerManager();
+
+        static F64 Now();
+
+        ProfileThread& GetThread();
+        void SetThreadName(const char *inName);
+
+        void BeginScope(const char *inTag, ProfileSample &outSample);
+        void EndScope(ProfileSample &outSample);
 
         void Store( const char *inTag, F64 inTime );
+        void Submit( ProfileThread &outThread, const ProfileSample &inSample );
+
+        // Returns ((scope index << 8) | low frame bits) * GPF_PROFILER_GPU_LATENCY + frame slot, or InvalidGPUScope.
+        // A scope not ended within GPF_PROFILER_GPU_LATENCY - 1 frames is dropped and its slot recycled.
+        U32 BeginGPUScope(const char *inTag);
+        void EndGPUScope(U32 inScope);
+        void ResolveGPU();
+        void ShutdownGPU();
+
+        void Collect();
+        void EndFrame();
+        void Reset();
+
+        // Scope tags must stay valid until the capture ends, string literals are fine.
+        bool BeginTraceCapture(const std::string &inFileName, size_t inMaxPendingEvents = 1 << 16);
+        void EndTraceCapture();
+
+        std::vector< ProfileSummary > Summarize();
+
         void DumpToConsole();
         void DumpToCSV(const std::string &inFileName);
+    };
 
-    } g_Profiler;
+    extern ProfilerManager g_Profiler;
 
     struct Profile
     {
@@ -217,7 +457,7 @@ namespace GPF
 
         const char *Tag;
         U32 Query; 
-        F64 StartTime;
+        ProfileSample Sample;
         bool IsEnded;
 
         explicit Profile( const char *inTag, ProfilingType inType );
@@ -226,6 +466,71 @@ namespace GPF
         void EndProfiling();
     };
 
+    /* Statistics */
+
+    // Define GPF_ENABLE_GL_STATS for the whole project to count GL work done through the wrappers.
+    struct FrameStats
+    {
+        U32 DrawCalls = 0;
+        U32 ProgramBinds = 0;
+        U32 VAOBinds = 0;
+        U32 BufferBinds = 0;
+        U32 TextureBinds = 0;
+        U32 SamplerBinds = 0;
+        U32 FramebufferBinds = 0;
+        U32 UniformUpdates = 0;
+
+        U32 BufferUploads = 0;
+        U32 TextureUploads = 0;
+        U64 BufferBytesUploaded = 0;
+        U64 TextureBytesUploaded = 0;
+    };
+
+    // counters of the frame in flight
+    extern FrameStats g_FrameStats;
+
+    #ifdef GPF_ENABLE_GL_STATS
+        #define GPF_GL_STAT(inCounter, inValue) (::GPF::g_FrameStats.inCounter += (inValue))
+    #else
+        #define GPF_GL_STAT(inCounter, inValue) ((void)0)
+    #endif
+
+    // Counters of the last completed frame, all zero when GPF_ENABLE_GL_STATS is not defined.
+    const FrameStats& GetFrameStats();
+
+    // Call once per frame, after the last draw.
+    void EndFrameStats();
+
+    void DumpFrameStats(const FrameStats &inStats);
+
+    /* Jobs */
+
+    struct JobSystem
+    {
+        std::vector< std::thread > Workers;
+        std::deque< std::function<void()> > Queue;
+        std::mutex Mutex;
+        std::condition_variable Wakeup;
+        bool IsRunning = false;
+
+        ~JobSystem();
+
+        // 0 uses one worker per hardware thread except the calling one.
+        void Start(U32 inThreadCount = 0);
+        void Stop();
+
+        // Starts the workers on first use.
+        void Submit(std::function<void()> inJob);
+
+        U32 ThreadCount();
+    };
+
+    extern JobSystem g_Jobs;
+
+    // Splits [0, inCount) into ranges of at least inGrain items and runs them on g_Jobs,
+    // the calling thread takes ranges too, so nesting from a job does not deadlock.
+    void ParallelFor(size_t inCount, size_t inGrain, const std::function<void(size_t inBegin, size_t inEnd)> &inFunction);
+
     /* Converters */
 
     static constexpr GLenum BufferToGlBuffer(BufferType inBuffer);
@@ -254,21 +559,338 @@ namespace GPF
             return GL_UNSIGNED_BYTE;
         }
 
+        if (std::is_same<int, typename std::remove_cv<T>::type>())
+        {
+            return GL_INT;
+        }
+
+        if (std::is_same<unsigned short, typename std::remove_cv<T>::type>())
+        {
+            return GL_UNSIGNED_SHORT;
+        }
+
+        if (std::is_same<short, typename std::remove_cv<T>::type>())
+        {
+            return GL_SHORT;
+        }
+
+        if (std::is_same<signed char, typename std::remove_cv<T>::type>())
+        {
+            return GL_BYTE;
+        }
+
+        if (std::is_same<Half, typename std::remove_cv<T>::type>())
+        {
+            return GL_HALF_FLOAT;
+        }
+
+        if (std::is_same<PackedInt2101010, typename std::remove_cv<T>::type>())
+        {
+            return GL_INT_2_10_10_10_REV;
+        }
+
         return GL_FLOAT;
     }
 
+    // Bytes taken by inCount components of T, a packed type holds all of its components in one T.
+    template<typename T>
+    static constexpr U32 ElementSize(U32 inCount)
+    {
+        return std::is_same<PackedInt2101010, typename std::remove_cv<T>::type>() ? static_cast<U32>(sizeof(T)) : static_cast<U32>(sizeof(T) * inCount);
+    }
+
+    // Number of components of a pixel transfer format, e.g. GL_RGBA -> 4.
+    U32 PixelComponents(GLenum inFormat);
+
     /* IO */
 
     bool LoadFile(const std::string &inFileName, std::string &outData);
 
+    enum class MapHint
+    {
+        Normal,
+        Sequential,
+        WillNeed,
+        Random
+    };
+
+    // Read-only view of a memory mapped file, unmapped when destroyed.
+    struct MappedFile
+    {
+        const U8 *Data = nullptr;
+        size_t Size = 0;
+        bool IsMapped = false;
+
+    #ifdef _WIN32
+        void *FileHandle = nullptr;
+        void *MappingHandle = nullptr;
+    #endif
+
+        MappedFile() = default;
+        MappedFile(MappedFile &&outOther) noexcept;
+        MappedFile& operator=(MappedFile &&outOther) noexcept;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* Chars() const { return reinterpret_cast<const char*>(Data); }
+    };
+
+    bool MapFile(const std::string &inFileName, MappedFile &outFile, MapHint inHint = MapHint::Normal);
+    void UnmapFile(MappedFile &outFile);
+
     /* Images */
 
-    bool LoadImage(const std::string &inFileName, Image &outImage);
+    struct ImageLoadOptions
+    {
+        // bottom row first, as GL expects, done per call instead of through the global stb flag
+        bool FlipVertically = true;
+
+        // RGB becomes RGBA so uploads stay on 4 byte texels
+        bool ExpandRGB = false;
+    };
+
+    struct ImageBatchStats
+    {
+        U32 Loaded = 0;
+        U32 Failed = 0;
+        U64 SourceBytes = 0;
+        U64 DecodedBytes = 0;
+        F64 Milliseconds = 0.0;
+
+        // decoded output per wall clock second
+        F64 MegabytesPerSecond() const { return Milliseconds > 0.0 ? (DecodedBytes / (1024.0 * 1024.0)) / (Milliseconds / 1000.0) : 0.0; }
+    };
+
+    // Thread safe, can be called from any number of workers at once.
+    bool LoadImage(const std::string &inFileName, Image &outImage, const ImageLoadOptions &inOptions = ImageLoadOptions());
+
+    // Decodes every file on g_Jobs, failed entries are left empty. Returns false when any file failed.
+    bool LoadImages(const std::vector< std::string > &inFileNames, std::vector< Image > &outImages,
+                    const ImageLoadOptions &inOptions = ImageLoadOptions(), ImageBatchStats *outStats = nullptr);
+
+    void FlipImageRows(Image &outImage);
+
+    // Replaces 3 component data with RGBA, alpha 255.
+    bool ExpandImageToRGBA(Image &outImage);
+
+    void DumpImageBatchStats(const ImageBatchStats &inStats);
+
     void FreeImage(Image &outImage);
 
     /* Models */
 
-    bool LoadOBJ(const std::string &inFileName, Geometry &outGeometry);
+    // Reads <file>.gpfmesh when it matches the source, otherwise parses the OBJ and writes the cache.
+    bool LoadOBJ(const std::string &inFileName, Geometry &outGeometry, bool inUseCache = true);
+
+    // Creates VAO / VBO / IBO for Vertices_Quantized or else the richest vertex stream of the geometry, GL thread only.
+    // The IBO holds U16 indices when there are fewer than 65536 vertices, see Geometry::IndexType.
+    void UploadGeometry(Geometry &outGeometry);
+
+    // Recomputes the bounds of every submesh from the vertices its indices reference.
+    void UpdateSubMeshBounds(Geometry &outGeometry);
+
+    /* Tangent space */
+
+    // Per vertex tangent frames over the index buffer (a plain triangle list without one). Face tangents are projected
+    // onto each vertex normal, angle weighted and summed per handedness, then orthogonalized; degenerate UVs fall back
+    // to any tangent perpendicular to the normal. Vertices_1P1N1UV is promoted to Vertices_1P1N1UV1T1BT first.
+    bool GenerateTangents(Geometry &outGeometry);
+
+    /* Vertex quantization */
+
+    U16 FloatToHalf(F32 inValue);
+    F32 HalfToFloat(U16 inValue);
+
+    // Octahedral map of a unit vector to [-1, 1]^2 and back.
+    glm::vec2 EncodeOctahedral(const glm::vec3 &inNormal);
+    glm::vec3 DecodeOctahedral(const glm::vec2 &inEncoded);
+
+    // snorm10 x, y, z and snorm2 w in GL_INT_2_10_10_10_REV order, x in the low bits.
+    PackedInt2101010 PackSnorm2101010(const glm::vec4 &inValue);
+    glm::vec4 UnpackSnorm2101010(PackedInt2101010 inValue);
+
+    // Fills Vertices_Quantized and Quantization from the richest float stream, which stays for CPU side work.
+    // Missing normals become +Z, missing tangents any tangent perpendicular to the normal.
+    bool QuantizeGeometry(Geometry &outGeometry, PositionEncoding inEncoding = PositionEncoding::Unorm16);
+
+    glm::vec3 DequantizePosition(const VertexQuantized &inVertex, const VertexQuantization &inQuantization);
+
+    /* Mesh optimization */
+
+    struct MeshOptimizeOptions
+    {
+        U32 CacheSize = 16;                 // FIFO post transform cache simulated by Tipsify and the stats
+        bool OptimizeOverdraw = false;      // sorts the Tipsify clusters of each submesh outward facing first
+        bool OptimizeVertexFetch = true;    // renumbers vertices in order of first use
+    };
+
+    struct VertexCacheStats
+    {
+        U32 Triangles = 0;
+        U32 Vertices = 0;       // distinct vertices referenced
+        U64 Transformed = 0;    // cache misses
+        F32 ACMR = 0.0f;        // transformed per triangle, 0.5 at best, 3 at worst
+        F32 ATVR = 0.0f;        // transformed per referenced vertex, 1 at best
+    };
+
+    struct MeshOptimizeReport
+    {
+        VertexCacheStats Before;
+        VertexCacheStats After;
+        U32 Clusters = 0;
+        F64 Milliseconds = 0.0;
+    };
+
+    VertexCacheStats AnalyzeVertexCache(const U32 *inIndices, size_t inIndexCount, size_t inVertexCount, U32 inCacheSize = 16);
+
+    // Tipsify triangle order per submesh (submesh ranges stay where they are), optional overdraw cluster order,
+    // then vertex reorder for fetch locality over every vertex array as long as the richest one.
+    bool OptimizeGeometry(Geometry &outGeometry, const MeshOptimizeOptions &inOptions = MeshOptimizeOptions(), MeshOptimizeReport *outReport = nullptr);
+
+    void DumpMeshOptimizeReport(const MeshOptimizeReport &inReport);
+
+    /* Mesh simplification */
+
+    struct SimplifyOptions
+    {
+        F32 MaxError = 0.02f;           // relative to the bounding box diagonal
+        F32 AttributeWeight = 0.01f;    // cost of normal / texcoord changes against squared relative distance
+        bool LockBorders = true;        // open borders stay in place, UV seams always do
+    };
+
+    // Quadric error edge collapse towards existing vertices, the result indexes the same vertex arrays.
+    // Stops at inTargetIndexCount or when the next collapse would exceed MaxError. Returns the positional error
+    // reached, the attribute cost only orders and bounds the collapses.
+    F32 SimplifyIndices(const Geometry &inGeometry, const U32 *inIndices, size_t inIndexCount, size_t inTargetIndexCount,
+                        std::vector< U32 > &outIndices, const SimplifyOptions &inOptions = SimplifyOptions());
+
+    struct LODOptions
+    {
+        U32 LevelCount = 4;
+        F32 Reduction = 0.5f;       // triangle ratio of every level to the one before
+        SimplifyOptions Simplify;
+    };
+
+    // Replaces the LOD chain, each level simplified from the previous one per submesh and appended to Indices.
+    // The chain ends early once a level stops shrinking. Run OptimizeGeometry afterwards, then upload.
+    // Invalid options, or fewer than one triangle, return false and leave the geometry untouched.
+    bool GenerateLODs(Geometry &outGeometry, const LODOptions &inOptions = LODOptions());
+
+    /* Meshlets */
+
+    struct MeshletOptions
+    {
+        U32 MaxVertices = 64;
+        U32 MaxTriangles = 124;
+    };
+
+    // Regroups the triangles of every full detail submesh into meshlets grown over shared vertices, rewriting the
+    // submesh index ranges in meshlet order, then fills Geometry::Meshlets. Run after OptimizeGeometry, which drops them.
+    bool BuildMeshlets(Geometry &outGeometry, const MeshletOptions &inOptions = MeshletOptions());
+
+    /* Vertex deduplication */
+
+    // Attribute indices of one face corner, -1 for a missing texcoord / normal.
+    struct VertexIndexKey
+    {
+        I32 Position = 0;
+        I32 TexCoord = -1;
+        I32 Normal = -1;
+
+        bool operator==(const VertexIndexKey &inOther) const
+        {
+            return Position == inOther.Position &&
+                   TexCoord == inOther.TexCoord &&
+                   Normal == inOther.Normal;
+        }
+    };
+
+    // Flat open addressing map from VertexIndexKey to U32, linear probing over a power of two table.
+    struct VertexIndexMap
+    {
+        struct Slot
+        {
+            VertexIndexKey Key;
+            U32 Value;
+        };
+
+        static constexpr U32 kEmpty = 0xFFFFFFFF;
+
+        std::vector< Slot > Slots;
+        size_t Size = 0;
+
+        // Sizes the table so inCount keys fit without growing.
+        void Reserve(size_t inCount);
+        void Clear();
+
+        // Returns the value already stored for inKey, or stores inValue and returns it.
+        U32 Insert(const VertexIndexKey &inKey, U32 inValue);
+
+        static U32 Hash(const VertexIndexKey &inKey);
+    };
+
+    // Numbers unique keys in order of first appearance, outIndices[i] is the vertex of inKeys[i] and
+    // outFirstKeys[v] the first key of vertex v. inExpectedVertices presizes the tables.
+    // The parallel path shards keys by hash and produces exactly the same result.
+    U32 DeduplicateVertexKeys(const std::vector< VertexIndexKey > &inKeys, std::vector< U32 > &outIndices, std::vector< U32 > &outFirstKeys,
+                              size_t inExpectedVertices = 0, bool inParallel = true);
+
+    /* Mesh cache */
+
+    enum class VertexFormat : U32
+    {
+        P1N1UV1T1BT,
+        P1N1UV,
+        P1UV,
+        Quantized
+    };
+
+    // Mapped .gpfmesh, vertex and index spans point into the mapping.
+    struct MeshCache
+    {
+        MappedFile Mapping;
+
+        VertexFormat Format = VertexFormat::P1N1UV1T1BT;
+        const U8 *Vertices = nullptr;
+        U32 VertexStride = 0;
+        U32 VertexCount = 0;
+
+        const void *Indices = nullptr;
+        U32 IndexCount = 0;
+        GLenum IndexType = GL_UNSIGNED_INT;     // GL_UNSIGNED_SHORT below 65536 vertices
+        VertexQuantization Quantization;        // for VertexFormat::Quantized
+
+        AABB Bounds;
+        std::unordered_map< std::string, MaterialInfo > Materials;
+        std::vector< SubMesh > SubMeshes;
+        std::vector< GeometryLOD > LODs;
+        std::vector< Meshlet > Meshlets;
+        U32 DetailIndexCount = 0;   // IndexCount covers the LOD ranges too
+
+        U64 SourceSize = 0;
+        I64 SourceTime = 0;
+        U64 SourceHash = 0;
+    };
+
+    std::string MeshCachePath(const std::string &inSourceFile);
+
+    bool SaveMeshCache(const std::string &inFileName, const Geometry &inGeometry, U64 inSourceSize, I64 inSourceTime, U64 inSourceHash);
+
+    bool LoadMeshCache(const std::string &inFileName, MeshCache &outCache);
+
+    // Maps the cache of inSourceFile when its size and mtime match, or when only the mtime moved and the content hash still matches.
+    bool LoadValidMeshCache(const std::string &inSourceFile, MeshCache &outCache);
+
+    // Copies the spans into the vectors of the geometry.
+    void MeshCacheToGeometry(const MeshCache &inCache, Geometry &outGeometry);
+
+    // VAO / VBO / IBO straight from the mapped spans, the geometry keeps no CPU copy. GL thread only.
+    void UploadMeshCache(const MeshCache &inCache, Geometry &outGeometry);
+
+    // Uploads from a valid cache without touching the vertex vectors, falls back to LoadOBJ + UploadGeometry. GL thread only.
+    bool LoadOBJToGPU(const std::string &inFileName, Geometry &outGeometry);
 
     /* Primitives */
 
@@ -308,6 +930,27 @@ namespace GPF
     void MoveRight(Camera &outCamera, F64 inDt);
     void Rotate(Camera &outCamera, F64 inDeltaVertical, F64 inDeltaHorizontal);
 
+    // Height in pixels covered by the bounding sphere of inBounds, FLT_MAX when the camera is inside it.
+    F32 ProjectedScreenSize(const AABB &inBounds, const glm::mat4 &inModel, const Camera &inCamera, F32 inViewportHeight);
+
+    // Coarsest level whose error stays under inPixelError on screen, 0 is the full detail mesh.
+    U32 SelectLOD(const Geometry &inGeometry, const glm::mat4 &inModel, const Camera &inCamera, F32 inViewportHeight, F32 inPixelError = 1.0f);
+
+    // Normalized planes, xyz inward, of the space inMatrix projects from: left, right, bottom, top, near, far.
+    struct Frustum
+    {
+        glm::vec4 Planes[6];
+    };
+
+    Frustum ExtractFrustum(const glm::mat4 &inMatrix);
+
+    // Frustum and backface cone test, both in the space of the meshlet.
+    bool IsMeshletVisible(const Meshlet &inMeshlet, const Frustum &inFrustum, const glm::vec3 &inEye);
+
+    // Indices of the visible meshlets, ascending. Returns their count.
+    U32 CullMeshlets(const Geometry &inGeometry, const glm::mat4 &inModel, const glm::mat4 &inViewProjection, const glm::vec3 &inEye,
+                     std::vector< U32 > &outVisible);
+
     /* Vertex Array Object */
 
     U32 GenerateVAO();
@@ -338,7 +981,7 @@ namespace GPF
             glVertexAttribPointer(inSlot, inCount, type, normalized, inVertexSize, offset);
         }
         
-        const auto newOffset = inOffset + (static_cast<U32>(sizeof(T) * inCount));
+        const auto newOffset = inOffset + ElementSize<T>(inCount);
 
         return newOffset;
     }
@@ -362,19 +1005,16 @@ namespace GPF
         UploadData( inType, inUsage, data, size);
     }
 
+    // glBufferStorage where available, glBufferData with StaticDraw on Apple.
     void UploadDataImmutable(BufferType inType, const void* inData, size_t inSize);
 
     template<typename T>
     static inline void UploadDataImmutable(BufferType inType, const std::vector<T>& inData)
     {
-        #ifdef __APPLE__
-            UploadData<T>(inType, BufferUsage::StaticDraw, inData);
-        #else 
-            const auto size = sizeof(T) * inData.size();
-            const auto data = inData.data();
+        const auto size = sizeof(T) * inData.size();
+        const auto data = inData.data();
 
-            UploadDataImmutable( inType, data, size );
-        #endif
+        UploadDataImmutable( inType, data, size );
     }
 
     void InvalidateBuffer(U32 inBufferID);
@@ -383,9 +1023,36 @@ namespace GPF
 
     /* Textures */
 
-    U32 GenerateTexture();
+    // GL 4.5 or ARB_direct_state_access on the current context, always false on Apple. Call after glewInit.
+    bool HasDirectStateAccess();
+
+    // Creates the texture object up front (glCreateTextures) so storage and uploads can go through DSA.
+    U32 GenerateTexture(GLenum inTarget = GL_TEXTURE_2D);
+
+    GLenum ComponentsToFormat(I32 inComponents);
+
+    // GL_R8 / GL_RG8 / GL_RGB8 / GL_RGBA8, or the sRGB variants, for 8 bit images
+    GLenum SizedInternalFormat(I32 inComponents, bool inSRGB = false);
 
-    void UploadTextureData( const Image &inImage, U32 &outTextureID, bool inGenerateMipMaps = false);
+    // Maps unsized formats such as GL_RGB to the sized format for inType, sized formats pass through
+    GLenum SizedInternalFormat(GLenum inInternalFormat, GLenum inType);
+
+    // Immutable storage for every level, size and format can not change afterwards. Mutable levels without DSA.
+    void AllocateTextureStorage(U32 inTextureID, U32 inWidth, U32 inHeight, U32 inLevels, GLenum inInternalFormat);
+
+    // Writes a region of an allocated level without touching the texture bindings.
+    void UpdateTextureData(U32 inTextureID, U32 inLevel, I32 inX, I32 inY, U32 inWidth, U32 inHeight, GLenum inFormat, GLenum inType, const void *inData);
+
+    void UpdateCompressedTextureData(U32 inTextureID, U32 inLevel, U32 inWidth, U32 inHeight, GLenum inInternalFormat, const void *inData, size_t inSize);
+
+    // GL_TEXTURE_2D_ARRAY counterparts, the texture has to come from GenerateTexture(GL_TEXTURE_2D_ARRAY).
+    void AllocateTextureArrayStorage(U32 inTextureID, U32 inWidth, U32 inHeight, U32 inLayers, U32 inLevels, GLenum inInternalFormat);
+
+    void UpdateTextureArrayData(U32 inTextureID, U32 inLevel, U32 inLayer, I32 inX, I32 inY, U32 inWidth, U32 inHeight, GLenum inFormat, GLenum inType, const void *inData);
+
+    // Allocates storage and uploads, mips come from GenerateMipChain. Uploading again keeps the texture when size, format
+    // and level count match, otherwise outTextureID is replaced by a new texture (0 creates one).
+    void UploadTextureData( const Image &inImage, U32 &outTextureID, bool inGenerateMipMaps = false, bool inSRGB = false);
 
     void UploadTextureData( const void * inData,
                             U32 inWidth, 
@@ -405,10 +1072,11 @@ namespace GPF
 	{
 		const auto type = ElementToGL<T>();
 
-		glBindTexture(GL_TEXTURE_2D, outTextureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, inInternalFormat, inWidth, inHeight, 0, inFormat, type, inData);
+		UploadTextureData(inData, inWidth, inHeight, outTextureID, type, inInternalFormat, inFormat);
 	}
 
+    void BindTexture(U32 inTextureID, U32 inTextureUnit = 0, GLenum inTarget = GL_TEXTURE_2D);
+
     void DeleteTexture(U32 &outID);
 
     /* Samplers */
@@ -423,6 +1091,443 @@ namespace GPF
 
     void DeleteSampler(U32 &outSampler);
 
+    /* Texture compression */
+
+    enum class TextureCompression : U32
+    {
+        None,
+        BC1,    // RGB, 4 bpp
+        BC3,    // RGBA, 8 bpp
+        BC4,    // R, 4 bpp
+        BC5,    // RG, 8 bpp
+        BC7     // RGBA, 8 bpp
+    };
+
+    enum class TextureUsage : U32
+    {
+        Albedo,
+        AlbedoAlpha,
+        Normal,     // X / Y go to BC5, Z is reconstructed in the shader
+        Mask
+    };
+
+    struct CompressedImage
+    {
+        std::vector< U8 > Data;
+        I32 Width = 0;
+        I32 Height = 0;
+        TextureCompression Format = TextureCompression::None;
+    };
+
+    TextureCompression ChooseCompression(TextureUsage inUsage, bool inHighQuality = false);
+
+    GLenum CompressionToGL(TextureCompression inFormat, bool inSRGB = false);
+
+    size_t CompressedBlockSize(TextureCompression inFormat);
+
+    size_t CompressedImageSize(TextureCompression inFormat, I32 inWidth, I32 inHeight);
+
+    // Encodes blocks in parallel on g_Jobs, partial edge blocks repeat the border texels.
+    bool CompressImage(const Image &inImage, TextureCompression inFormat, CompressedImage &outImage);
+
+    void CompressImage(const U8 *inData, I32 inWidth, I32 inHeight, I32 inComponents, TextureCompression inFormat, U8 *outData);
+
+    // Uploads one level. With DSA, level 0 allocates immutable storage for the whole chain and later levels fill it,
+    // GL_TEXTURE_MAX_LEVEL follows the deepest uploaded level. Complete chains go through TextureData.
+    void UploadCompressedTextureData(const CompressedImage &inImage, U32 &outTextureID, U32 inLevel = 0, bool inSRGB = false);
+
+    /* Mip generation */
+
+    enum class MipFilter : U32
+    {
+        Box,
+        Kaiser      // windowed sinc, sharper than box with less aliasing
+    };
+
+    struct MipOptions
+    {
+        MipFilter Filter = MipFilter::Kaiser;
+
+        // RGB is filtered in linear space and stored back as sRGB
+        bool SRGB = false;
+
+        // XYZ is decoded to [-1, 1] and renormalized after filtering
+        bool NormalMap = false;
+
+        // 0 builds the full chain down to 1x1
+        U32 MaxLevels = 0;
+    };
+
+    struct TextureLevel
+    {
+        I32 Width = 0;
+        I32 Height = 0;
+        size_t Offset = 0;
+        size_t Size = 0;
+    };
+
+    struct MipChain
+    {
+        I32 Components = 0;
+        std::vector< TextureLevel > Levels;
+        std::vector< U8 > Storage;
+
+        // Image view into Storage, not to be passed to FreeImage
+        Image Level(U32 inLevel) const
+        {
+            const TextureLevel &level = Levels[inLevel];
+            return { const_cast<U8*>(Storage.data() + level.Offset), level.Width, level.Height, Components };
+        }
+    };
+
+    U32 MipLevelCount(I32 inWidth, I32 inHeight);
+
+    // Level 0 is a copy of the source, every level is filtered from a float copy of the previous one on g_Jobs.
+    bool GenerateMipChain(const Image &inImage, const MipOptions &inOptions, MipChain &outChain);
+
+    /* Texture container */
+
+    struct TextureLoadOptions
+    {
+        bool GenerateMipMaps = true;
+        bool SRGB = false;
+        bool NormalMap = false;
+        MipFilter Filter = MipFilter::Kaiser;
+        TextureCompression Compression = TextureCompression::None;
+
+        // read <file>.<format>.gpftex when it matches the source, write it otherwise
+        bool UseContainer = true;
+    };
+
+    // Texture in its final GL format with every mip level, either built in memory or mapped from a .gpftex file.
+    struct TextureData
+    {
+        I32 Width = 0;
+        I32 Height = 0;
+        I32 Components = 0;
+        TextureCompression Compression = TextureCompression::None;
+        bool SRGB = false;
+
+        GLenum InternalFormat = GL_NONE;
+        GLenum Format = GL_NONE;
+        GLenum Type = GL_UNSIGNED_BYTE;
+
+        std::vector< TextureLevel > Levels;
+        std::vector< U8 > Storage;
+        MappedFile Mapping;
+
+        const U8* LevelData(U32 inLevel) const
+        {
+            const U8 *base = Mapping.IsMapped ? Mapping.Data : Storage.data();
+            return base + Levels[inLevel].Offset;
+        }
+
+        size_t SizeInBytes() const
+        {
+            size_t size = 0;
+            for (const auto &level : Levels)
+            {
+                size += level.Size;
+            }
+            return size;
+        }
+    };
+
+    bool BuildTextureData(const Image &inImage, const TextureLoadOptions &inOptions, TextureData &outData);
+
+    std::string TextureContainerPath(const std::string &inSourceFile, const TextureLoadOptions &inOptions);
+
+    bool SaveTextureContainer(const std::string &inFileName, const TextureData &inData, U64 inSourceSize, I64 inSourceTime, U64 inSourceHash);
+
+    // Maps the container, level data stays in the mapping until outData is destroyed. Containers whose formats
+    // BuildTextureData could not have written are rejected.
+    bool LoadTextureContainer(const std::string &inFileName, TextureData &outData, U64 *outSourceSize = nullptr, I64 *outSourceTime = nullptr,
+                              U64 *outSourceHash = nullptr);
+
+    // Uses an up to date container when there is one, otherwise decodes the source and writes the container.
+    // A source with a new time but the same size is hashed, and an unchanged one keeps its container.
+    bool LoadTextureData(const std::string &inFileName, const TextureLoadOptions &inOptions, TextureData &outData);
+
+    void UploadTextureData(const TextureData &inData, U32 &outTextureID);
+
+    /* Texture cache */
+
+    struct Texture
+    {
+        U32 ID = 0;
+        I32 Width = 0;
+        I32 Height = 0;
+        I32 Components = 0;
+        size_t SizeInBytes = 0;
+        std::string Path;
+    };
+
+    using TextureHandle = std::shared_ptr< Texture >;
+
+    struct TextureCacheStats
+    {
+        U64 Hits = 0;
+        U64 Misses = 0;
+        U64 Evictions = 0;
+        U64 Failures = 0;
+        size_t ResidentBytes = 0;
+        U32 ResidentTextures = 0;
+    };
+
+    // Deduplicates textures by canonical path and load options, GL thread only.
+    // Least recently used textures nobody else holds are evicted once BudgetInBytes is exceeded.
+    struct TextureCache
+    {
+        struct Entry
+        {
+            TextureHandle Handle;
+            std::list< std::string >::iterator Usage;
+        };
+
+        std::unordered_map< std::string, Entry > Entries;
+        std::list< std::string > Usage;    // most recently used first
+        size_t BudgetInBytes = static_cast<size_t>(512) << 20;
+        TextureCacheStats Stats;
+
+        TextureHandle Acquire(const std::string &inFileName, const TextureLoadOptions &inOptions = TextureLoadOptions());
+
+        // Evicts unreferenced textures until the cache fits its budget.
+        void Trim();
+
+        // Deletes every texture, call before the GL context goes away.
+        void Clear();
+    };
+
+    struct MaterialTextures
+    {
+        TextureHandle Ambient;
+        TextureHandle Diffuse;
+        TextureHandle Specular;
+        TextureHandle Highlight;
+        TextureHandle Bump;
+        TextureHandle Displacement;
+        TextureHandle Alpha;
+        TextureHandle Reflection;
+    };
+
+    // Texture names are resolved relative to inBaseDirectory, usually the folder of the OBJ file.
+    MaterialTextures LoadMaterialTextures(const MaterialInfo &inMaterial, TextureCache &outCache, const std::string &inBaseDirectory = "");
+
+    void DumpTextureCacheStats(const TextureCache &inCache);
+
+    /* Texture atlas */
+
+    // Bottom-left skyline rectangle packer.
+    struct SkylinePacker
+    {
+        struct Node
+        {
+            I32 X = 0;
+            I32 Y = 0;
+            I32 Width = 0;
+        };
+
+        I32 Width = 0;
+        I32 Height = 0;
+        std::vector< Node > Skyline;
+
+        void Reset(I32 inWidth, I32 inHeight);
+
+        bool Insert(I32 inWidth, I32 inHeight, I32 &outX, I32 &outY);
+    };
+
+    enum class AtlasMode : U32
+    {
+        Skyline,    // images packed into as many Size x Size layers as needed, UVs must stay in [0, 1]
+        Layers      // one image per layer, all images share one size, keeps repeat wrapping
+    };
+
+    struct TextureAtlasOptions
+    {
+        AtlasMode Mode = AtlasMode::Skyline;
+        I32 Size = 2048;
+
+        // edge texels repeated around every image, mips are box filtered and stop at log2(Padding) so levels never bleed
+        I32 Padding = 8;
+
+        bool GenerateMipMaps = true;
+        bool SRGB = false;
+    };
+
+    // uv' = Offset + uv * Scale, sampled from layer Layer of the array
+    struct AtlasRegion
+    {
+        U32 Layer = 0;
+        glm::vec2 Offset = glm::vec2(0.0f);
+        glm::vec2 Scale = glm::vec2(1.0f);
+
+        I32 X = 0;
+        I32 Y = 0;
+        I32 Width = 0;
+        I32 Height = 0;
+    };
+
+    struct TextureAtlas
+    {
+        U32 TextureID = 0;
+        I32 Width = 0;
+        I32 Height = 0;
+        U32 Layers = 0;
+        U32 Levels = 0;
+        I32 Components = 0;
+
+        // keyed by the names passed to BuildTextureAtlas
+        std::unordered_map< std::string, AtlasRegion > Regions;
+
+        // filled by LoadMaterialAtlas, keyed by material name
+        std::unordered_map< std::string, AtlasRegion > MaterialRegions;
+    };
+
+    // Packs same-format images into one GL_TEXTURE_2D_ARRAY, so every packed image can be drawn without rebinding.
+    bool BuildTextureAtlas( const std::vector< std::string > &inNames,
+                            const std::vector< Image > &inImages,
+                            const TextureAtlasOptions &inOptions,
+                            TextureAtlas &outAtlas );
+
+    // Packs the diffuse textures of every material of the geometry.
+    bool LoadMaterialAtlas( const Geometry &inGeometry,
+                            const std::string &inBaseDirectory,
+                            const TextureAtlasOptions &inOptions,
+                            TextureAtlas &outAtlas );
+
+    // Two vec4 per region, (offset.xy, scale.xy) and (layer, 0, 0, 0), in inNames order for a uniform or storage buffer.
+    void BuildAtlasRegionTable(const TextureAtlas &inAtlas, const std::vector< std::string > &inNames, std::vector< glm::vec4 > &outTable);
+
+    // Moves every texcoord of the geometry into the region, for meshes drawn with a single atlas image.
+    void RemapTexCoords(Geometry &outGeometry, const AtlasRegion &inRegion);
+
+    void DeleteTextureAtlas(TextureAtlas &outAtlas);
+
+    /* Mip streaming */
+
+    // Texture whose finest levels are uploaded on demand, resident levels are clamped with GL_TEXTURE_BASE_LEVEL / MAX_LEVEL.
+    struct StreamedTexture
+    {
+        U32 TextureID = 0;
+        I32 Width = 0;
+        I32 Height = 0;
+        U32 LevelCount = 0;
+        std::string Path;
+
+        // source of the levels, usually a mapped .gpftex so unused levels stay on disk
+        TextureData Data;
+
+        // finest uploaded level, LevelCount when nothing is resident
+        U32 ResidentLevel = 0;
+        size_t ResidentBytes = 0;
+
+        // finest level asked for this frame and the screen size it came from
+        U32 RequestedLevel = 0;
+        F32 ScreenSize = 0.0f;
+        U64 LastRequestFrame = 0;
+    };
+
+    using StreamedTextureHandle = std::shared_ptr< StreamedTexture >;
+
+    struct MipStreamerStats
+    {
+        U64 LevelsUploaded = 0;
+        U64 LevelsDropped = 0;
+        U64 BudgetMisses = 0;
+        size_t ResidentBytes = 0;
+    };
+
+    struct MipStreamer
+    {
+        std::vector< StreamedTextureHandle > Textures;
+
+        size_t BudgetInBytes = 256ull << 20;
+
+        // levels up to this size are uploaded by Load and never dropped
+        I32 ResidentSize = 64;
+
+        // finer levels are added one per texture per frame, at most this many in total
+        U32 MaxUploadsPerFrame = 8;
+
+        // frames without a request before a texture falls back to its resident levels
+        U32 KeepFrames = 120;
+
+        // > 0 picks coarser levels, < 0 sharper ones
+        F32 LevelBias = 0.0f;
+
+        U64 Frame = 1;
+        MipStreamerStats Stats;
+
+        StreamedTextureHandle Load(const std::string &inFileName, const TextureLoadOptions &inOptions = TextureLoadOptions());
+
+        // Asks for the level a mesh with these bounds needs this frame, the finest request of the frame wins.
+        void Request(const StreamedTextureHandle &inTexture, const AABB &inBounds, const glm::mat4 &inModel, const Camera &inCamera, F32 inViewportHeight);
+
+        void Request(const StreamedTextureHandle &inTexture, F32 inScreenSize);
+
+        // Uploads wanted levels by priority inside the budget and drops levels nobody asked for, call once per frame.
+        void Update();
+
+        void Release(const StreamedTextureHandle &inTexture);
+
+        void Clear();
+    };
+
+    void DumpMipStreamerStats(const MipStreamer &inStreamer);
+
+    /* Pixel buffer ring */
+
+    // Slots of one persistently mapped pixel buffer, each slot guarded by the fence of the last GL command using it.
+    struct PixelBufferRing
+    {
+        BufferType Type = BufferType::PixelUnpack;
+        U32 BufferID = 0;
+        U8 *Mapped = nullptr;
+        size_t SlotSize = 0;
+        U32 SlotCount = 0;
+        U32 Next = 0;
+        std::vector< GLsync > Fences;
+
+        // backs Mapped where persistent mapping is not available (macOS)
+        std::vector< U8 > Staging;
+
+        // PixelUnpack rings are mapped for writing, PixelPack rings for reading
+        bool Create(BufferType inType, size_t inSlotSize, U32 inSlotCount = 3);
+
+        void Destroy();
+
+        // Non-blocking, true once the GPU finished with the slot
+        bool IsSlotAvailable(U32 inSlot);
+
+        // Blocks until the slot is free or inTimeoutNs passes
+        bool WaitSlot(U32 inSlot, U64 inTimeoutNs = ~0ull);
+
+        // Takes the next slot in order, nullptr when it is still in use and inWait is false
+        U8* AcquireSlot(U32 &outSlot, bool inWait = false);
+
+        // Fences the commands issued on the slot so far
+        void FenceSlot(U32 inSlot);
+
+        U8* SlotData(U32 inSlot) const { return Mapped ? Mapped + inSlot * SlotSize : nullptr; }
+
+        size_t SlotOffset(U32 inSlot) const { return inSlot * SlotSize; }
+    };
+
+    /* Texture streaming */
+
+    // Writes the texels placed in a slot of a PixelUnpack ring into the texture and fences the slot.
+    // The copy runs on the GPU timeline, the slot can be written again once IsSlotAvailable returns true.
+    void StreamTextureData( PixelBufferRing &inRing,
+                            U32 inSlot,
+                            U32 inTextureID,
+                            U32 inLevel,
+                            I32 inX,
+                            I32 inY,
+                            U32 inWidth,
+                            U32 inHeight,
+                            GLenum inFormat = GL_RGBA,
+                            GLenum inType = GL_UNSIGNED_BYTE );
+
     /* Framebuffers */
 
 	static inline void BlitFramebuffers(U32 inBufferFrom, U32 inBufferTo, U32 inWidth, U32 inHeight)
@@ -430,6 +1535,8 @@ namespace GPF
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, inBufferFrom);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, inBufferTo);
 		glBlitFramebuffer(0, 0, inWidth, inHeight, 0, 0, inWidth, inHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+		GPF_GL_STAT(FramebufferBinds, 2);
 	}
 
     static inline U32 GenerateFramebuffer()
@@ -520,6 +1627,83 @@ namespace GPF
         }
     }
 
+    /* Readback */
+
+    struct ReadbackResult
+    {
+        const U8 *Data = nullptr;
+        size_t Size = 0;
+        U32 Width = 0;
+        U32 Height = 0;
+        GLenum Format = GL_NONE;
+        GLenum Type = GL_NONE;
+        U64 Tag = 0;
+    };
+
+    // Framebuffer reads into a PixelPack ring, results come back a few frames later without stalling.
+    struct ReadbackQueue
+    {
+        struct Request
+        {
+            U32 Slot = 0;
+            size_t Size = 0;
+            U32 Width = 0;
+            U32 Height = 0;
+            GLenum Format = GL_NONE;
+            GLenum Type = GL_NONE;
+            U64 Tag = 0;
+        };
+
+        PixelBufferRing Ring;
+        std::deque< Request > InFlight;
+
+        // inMaxBytes is the largest single read, e.g. width * height * 4 for RGBA8
+        bool Create(size_t inMaxBytes, U32 inSlotCount = 3);
+
+        void Destroy();
+
+        // Attachment is GL_COLOR_ATTACHMENT0 + i, GL_DEPTH_ATTACHMENT (with GL_DEPTH_COMPONENT) or GL_BACK for framebuffer 0.
+        // False when every slot is still in flight, the caller drops or retries the read.
+        bool Read( U32 inFramebufferID,
+                   GLenum inAttachment,
+                   I32 inX,
+                   I32 inY,
+                   U32 inWidth,
+                   U32 inHeight,
+                   GLenum inFormat = GL_RGBA,
+                   GLenum inType = GL_UNSIGNED_BYTE,
+                   U64 inTag = 0 );
+
+        // Oldest finished read in submission order, outResult.Data stays valid until the next Read.
+        bool Poll(ReadbackResult &outResult);
+
+        size_t PendingCount() const { return InFlight.size(); }
+    };
+
+    /* Draw */
+
+    void DrawArrays(GLenum inMode, U32 inFirst, U32 inCount);
+
+    // inType has to match the bound IBO. UploadGeometry and UploadMeshCache store GL_UNSIGNED_SHORT indices below
+    // 65536 vertices, pass Geometry::IndexType for those, the default only fits U32 indices uploaded by hand.
+    void DrawElements(GLenum inMode, U32 inCount, GLenum inType = GL_UNSIGNED_INT, size_t inOffset = 0);
+
+    void DrawElementsInstanced(GLenum inMode, U32 inCount, U32 inInstanceCount, GLenum inType = GL_UNSIGNED_INT, size_t inOffset = 0);
+
+    // Draws the index range of the submesh from the bound VAO, index type and offset follow inGeometry.IndexType.
+    void DrawSubMesh(const Geometry &inGeometry, const SubMesh &inSubMesh, GLenum inMode = GL_TRIANGLES);
+
+    // Binds the VAO, then per submesh calls inBindMaterial and draws its range. Submeshes are one per material,
+    // so that is one material bind and one glDrawElements each. Geometry without submeshes is drawn whole.
+    void DrawGeometry(const Geometry &inGeometry, const std::function<void(const SubMesh&)> &inBindMaterial = nullptr, GLenum inMode = GL_TRIANGLES);
+
+    // DrawGeometry for one level of the LOD chain, see SelectLOD.
+    void DrawGeometryLOD(const Geometry &inGeometry, U32 inLOD, const std::function<void(const SubMesh&)> &inBindMaterial = nullptr, GLenum inMode = GL_TRIANGLES);
+
+    // One glMultiDrawElements per submesh over the meshlets in inVisible (ascending, see CullMeshlets), adjacent ones merged.
+    void DrawMeshlets(const Geometry &inGeometry, const std::vector< U32 > &inVisible, const std::function<void(const SubMesh&)> &inBindMaterial = nullptr,
+                      GLenum inMode = GL_TRIANGLES);
+
     /* Shaders */
 
     using ShaderList = std::vector< U32 >;
@@ -527,8 +1711,12 @@ namespace GPF
 
     bool LoadShader(const std::string &inFileName, GLenum inType, ShaderList &outList);
 
+    bool CompileShaderSource(const char *inSource, size_t inLength, GLenum inType, const std::string &inName, ShaderList &outList);
+
     bool CompileShaderList( ShaderList &outShaders, U32 &outProgramID, bool inDeleteShaders = true );
 
+    void UseProgram(U32 inProgramID);
+
     void DeleteShaderProgram(U32 &outProgramID);
 
     I32 GetUniform(const char* inUniformName, U32 inProgramID);
@@ -564,6 +1752,61 @@ namespace GPF
 
     void SetUInt( const char * inUniformName, U32 inValue, U32 inProgramID, UniformCache &outCache );
     void SetUInt( const char * inUniformName, U32 inValue, U32 inProgramID );
+
+    /* Async loading */
+
+    // File IO, decoding and parsing run on g_Jobs, GL work is queued for ProcessUploads on the GL thread.
+    enum class AsyncState : U32
+    {
+        Pending,
+        Ready,
+        Failed
+    };
+
+    struct AsyncTexture
+    {
+        std::atomic<AsyncState> State{ AsyncState::Pending };
+        U32 TextureID = 0;
+        I32 Width = 0;
+        I32 Height = 0;
+        I32 Components = 0;
+
+        bool IsReady() const { return State.load(std::memory_order_acquire) == AsyncState::Ready; }
+    };
+
+    struct AsyncGeometry
+    {
+        std::atomic<AsyncState> State{ AsyncState::Pending };
+        Geometry Data;
+
+        bool IsReady() const { return State.load(std::memory_order_acquire) == AsyncState::Ready; }
+    };
+
+    struct AsyncShader
+    {
+        std::atomic<AsyncState> State{ AsyncState::Pending };
+        U32 ShaderID = 0;
+
+        bool IsReady() const { return State.load(std::memory_order_acquire) == AsyncState::Ready; }
+    };
+
+    using AsyncTextureHandle = std::shared_ptr< AsyncTexture >;
+    using AsyncGeometryHandle = std::shared_ptr< AsyncGeometry >;
+    using AsyncShaderHandle = std::shared_ptr< AsyncShader >;
+
+    AsyncTextureHandle LoadTextureAsync(const std::string &inFileName, const TextureLoadOptions &inOptions = TextureLoadOptions());
+
+    // inUpload = false keeps the geometry CPU side, useful for further processing.
+    // With inUpload and a valid mesh cache only the GPU buffers and metadata are filled in.
+    AsyncGeometryHandle LoadOBJAsync(const std::string &inFileName, bool inUpload = true);
+
+    AsyncShaderHandle LoadShaderAsync(const std::string &inFileName, GLenum inType);
+
+    // Thread safe, the upload runs on the next ProcessUploads call.
+    void EnqueueUpload(std::function<void()> inUpload);
+
+    // GL thread: runs queued uploads until inBudgetMs is spent (at least one), returns how many are still queued.
+    size_t ProcessUploads(F64 inBudgetMs);
 }
 
-#endif //_GPF_HPP_
\ No newline at end of file
+#endif //_GPF_HPP_
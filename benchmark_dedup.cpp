@@ -0,0 +1,180 @@
+#include "GPF.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace GPF;
+
+// The vertex hash LoadOBJ used before deduplication moved to index triples.
+struct LegacyVertexHash
+{
+    size_t operator()(const Vertex1P1N1UV1T1BT &inVertex) const
+    {
+        return ((std::hash<glm::vec3>()(inVertex.Position) ^
+                (std::hash<glm::vec3>()(inVertex.Normal) << 1)) >> 1) ^
+                (std::hash<glm::vec2>()(inVertex.TexCoord ) << 1);
+    }
+};
+
+struct BenchmarkMesh
+{
+    std::vector< glm::vec3 > Positions;
+    std::vector< glm::vec3 > Normals;
+    std::vector< glm::vec2 > TexCoords;
+    std::vector< VertexIndexKey > Corners;
+};
+
+// Grid of inSize x inSize quads, two triangles each, with a texcoord seam on every tenth column.
+static BenchmarkMesh BuildGrid(I32 inSize)
+{
+    BenchmarkMesh mesh;
+    const I32 row = inSize + 1;
+
+    for (I32 y = 0; y <= inSize; ++y)
+    {
+        for (I32 x = 0; x <= inSize; ++x)
+        {
+            mesh.Positions.push_back(glm::vec3(x * 0.1f, 0.0f, y * 0.1f));
+            mesh.Normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+            mesh.TexCoords.push_back(glm::vec2(x / static_cast<F32>(inSize), y / static_cast<F32>(inSize)));
+        }
+    }
+
+    const I32 seam = static_cast<I32>(mesh.TexCoords.size());
+    mesh.TexCoords.push_back(glm::vec2(0.0f));
+
+    for (I32 y = 0; y < inSize; ++y)
+    {
+        for (I32 x = 0; x < inSize; ++x)
+        {
+            const I32 a = y * row + x;
+            const I32 b = a + 1;
+            const I32 c = a + row;
+            const I32 d = c + 1;
+
+            auto corner = [&](I32 inIndex)
+            {
+                VertexIndexKey key;
+                key.Position = inIndex;
+                key.Normal = inIndex;
+                key.TexCoord = (x % 10 == 0 && inIndex == a) ? seam : inIndex;
+                mesh.Corners.push_back(key);
+            };
+
+            corner(a); corner(b); corner(d);
+            corner(a); corner(d); corner(c);
+        }
+    }
+
+    return mesh;
+}
+
+static Vertex1P1N1UV1T1BT MakeVertex(const BenchmarkMesh &inMesh, const VertexIndexKey &inKey)
+{
+    Vertex1P1N1UV1T1BT vertex = {};
+    vertex.Position = inMesh.Positions[inKey.Position];
+    vertex.Normal = inMesh.Normals[inKey.Normal];
+    vertex.TexCoord = { inMesh.TexCoords[inKey.TexCoord].x, 1.0f - inMesh.TexCoords[inKey.TexCoord].y };
+    return vertex;
+}
+
+static U32 DeduplicateLegacy(const BenchmarkMesh &inMesh, std::vector< U32 > &outIndices)
+{
+    std::unordered_map<Vertex1P1N1UV1T1BT, U32, LegacyVertexHash> uniqueVertices = {};
+    std::vector< Vertex1P1N1UV1T1BT > vertices;
+
+    outIndices.clear();
+
+    for (const auto &key : inMesh.Corners)
+    {
+        const Vertex1P1N1UV1T1BT vertex = MakeVertex(inMesh, key);
+
+        if (uniqueVertices.count(vertex) == 0)
+        {
+            uniqueVertices[vertex] = static_cast<U32>(vertices.size());
+            vertices.push_back(vertex);
+        }
+
+        outIndices.push_back(uniqueVertices[vertex]);
+    }
+
+    return static_cast<U32>(vertices.size());
+}
+
+static U32 DeduplicateFlat(const BenchmarkMesh &inMesh, std::vector< U32 > &outIndices, bool inParallel)
+{
+    std::vector< U32 > firstCorners;
+    const U32 vertexCount = DeduplicateVertexKeys(inMesh.Corners, outIndices, firstCorners, inMesh.Positions.size() * 9 / 8, inParallel);
+
+    std::vector< Vertex1P1N1UV1T1BT > vertices(vertexCount);
+
+    auto emit = [&](size_t inBegin, size_t inEnd)
+    {
+        for (size_t i = inBegin; i < inEnd; ++i)
+        {
+            vertices[i] = MakeVertex(inMesh, inMesh.Corners[firstCorners[i]]);
+        }
+    };
+
+    if (inParallel)
+    {
+        ParallelFor(vertexCount, 1 << 14, emit);
+    }
+    else
+    {
+        emit(0, vertexCount);
+    }
+
+    return vertexCount;
+}
+
+template< typename Function >
+static F64 Measure(I32 inRuns, Function inFunction)
+{
+    F64 best = std::numeric_limits<F64>::max();
+
+    for (I32 run = 0; run < inRuns; ++run)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        inFunction();
+        const auto end = std::chrono::steady_clock::now();
+
+        best = std::min(best, std::chrono::duration<F64, std::milli>(end - begin).count());
+    }
+
+    return best;
+}
+
+// Usage: benchmark_dedup [grid size = 1000] [runs = 3]
+int main(int argc, char **argv)
+{
+    const I32 size = argc > 1 ? std::atoi(argv[1]) : 1000;
+    const I32 runs = argc > 2 ? std::atoi(argv[2]) : 3;
+
+    const BenchmarkMesh mesh = BuildGrid(size);
+
+    std::printf("corners %zu, positions %zu, threads %u\n", mesh.Corners.size(), mesh.Positions.size(), g_Jobs.ThreadCount() + 1);
+
+    std::vector< U32 > legacyIndices;
+    std::vector< U32 > serialIndices;
+    std::vector< U32 > parallelIndices;
+    U32 legacyVertices = 0;
+    U32 serialVertices = 0;
+    U32 parallelVertices = 0;
+
+    const F64 legacy = Measure(runs, [&]() { legacyVertices = DeduplicateLegacy(mesh, legacyIndices); });
+    const F64 serial = Measure(runs, [&]() { serialVertices = DeduplicateFlat(mesh, serialIndices, false); });
+    const F64 parallel = Measure(runs, [&]() { parallelVertices = DeduplicateFlat(mesh, parallelIndices, true); });
+
+    std::printf("unordered_map  %10.2f ms  %u vertices\n", legacy, legacyVertices);
+    std::printf("flat serial    %10.2f ms  %u vertices  x%.1f\n", serial, serialVertices, legacy / serial);
+    std::printf("flat parallel  %10.2f ms  %u vertices  x%.1f\n", parallel, parallelVertices, legacy / parallel);
+
+    // the grid has no duplicate values under different index triples, so all three must agree
+    const bool isSame = legacyIndices == serialIndices && serialIndices == parallelIndices;
+    std::printf("indices %s\n", isSame ? "match" : "DIFFER");
+
+    g_Jobs.Stop();
+    return isSame ? 0 : 1;
+}
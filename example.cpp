@@ -81,29 +81,31 @@ int main()
         // Geometry pass
         glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(geomProg);
+        UseProgram(geomProg);
         SetMat4("uProjection", GetProjectionMatrix(cam), geomProg);
         SetMat4("uView", GetViewMatrix(cam), geomProg);
         glm::mat4 model(1.0f);
         SetMat4("uModel", model, geomProg);
         BindVAO(mesh.VAO);
-        glDrawElements(GL_TRIANGLES, mesh.IndexCount, GL_UNSIGNED_INT, 0);
+        DrawElements(GL_TRIANGLES, mesh.IndexCount);
 
         // Lighting pass
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(lightProg);
-        glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, gPosition);
-        glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, gNormal);
-        glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, gAlbedo);
+        UseProgram(lightProg);
+        BindTexture(gPosition, 0);
+        BindTexture(gNormal, 1);
+        BindTexture(gAlbedo, 2);
         SetVec3("lightPos", glm::vec3(10.0, 10.0, 10.0), lightProg);
         SetVec3("lightColor", glm::vec3(300.0, 300.0, 300.0), lightProg);
         SetVec3("camPos", cam.Position, lightProg);
         BindVAO(quadVAO);
-        glDrawElements(GL_TRIANGLES, quad.IndexCount, GL_UNSIGNED_INT, 0);
+        DrawElements(GL_TRIANGLES, quad.IndexCount);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        EndFrameStats();
     }
 
     glfwTerminate();
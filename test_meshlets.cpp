@@ -0,0 +1,159 @@
+#include "GPF.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace GPF;
+
+// inSize x inSize grid over [-1, 1]^2 in xz, heights from inHeight, two triangles per quad facing +y.
+template< typename Function >
+static Geometry BuildSurface(I32 inSize, bool inFlip, Function inHeight)
+{
+    Geometry geometry;
+    const I32 row = inSize + 1;
+
+    for (I32 y = 0; y <= inSize; ++y)
+    {
+        for (I32 x = 0; x <= inSize; ++x)
+        {
+            const F32 u = x * 2.0f / inSize - 1.0f;
+            const F32 v = y * 2.0f / inSize - 1.0f;
+
+            Vertex1P1N1UV1T1BT vertex = {};
+            vertex.Position = inHeight(u, v);
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            vertex.TexCoord = glm::vec2(u, v);
+            geometry.Vertices_1P1N1UV1T1BT.push_back(vertex);
+        }
+    }
+
+    for (I32 y = 0; y < inSize; ++y)
+    {
+        for (I32 x = 0; x < inSize; ++x)
+        {
+            const U32 a = static_cast<U32>(y * row + x);
+            const U32 b = a + 1;
+            const U32 c = a + static_cast<U32>(row);
+            const U32 d = c + 1;
+
+            const U32 triangles[6] = { a, c, d, a, d, b };
+
+            for (I32 i = 0; i < 6; i += 3)
+            {
+                geometry.Indices.push_back(triangles[i]);
+                geometry.Indices.push_back(triangles[i + (inFlip ? 2 : 1)]);
+                geometry.Indices.push_back(triangles[i + (inFlip ? 1 : 2)]);
+            }
+        }
+    }
+
+    return geometry;
+}
+
+// Planes that keep everything, so only the cone decides.
+static Frustum OpenFrustum()
+{
+    Frustum frustum;
+
+    for (glm::vec4 &plane : frustum.Planes)
+    {
+        plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    return frustum;
+}
+
+// Counts meshlets the cone test rejects although one of their triangles faces inEye.
+static U32 CountWronglyCulled(const Geometry &inGeometry, const glm::vec3 &inEye)
+{
+    const Frustum everything = OpenFrustum();
+    const auto &vertices = inGeometry.Vertices_1P1N1UV1T1BT;
+    U32 wrong = 0;
+
+    for (const Meshlet &meshlet : inGeometry.Meshlets)
+    {
+        if (IsMeshletVisible(meshlet, everything, inEye))
+        {
+            continue;
+        }
+
+        for (U32 i = meshlet.FirstIndex; i < meshlet.FirstIndex + meshlet.IndexCount; i += 3)
+        {
+            const glm::vec3 &p0 = vertices[inGeometry.Indices[i + 0]].Position;
+            const glm::vec3 &p1 = vertices[inGeometry.Indices[i + 1]].Position;
+            const glm::vec3 &p2 = vertices[inGeometry.Indices[i + 2]].Position;
+
+            if (glm::dot(glm::cross(p1 - p0, p2 - p0), inEye - p0) > 0.0f)
+            {
+                ++wrong;
+                break;
+            }
+        }
+    }
+
+    return wrong;
+}
+
+static bool Check(const char *inName, Geometry inGeometry, I32 inEyes)
+{
+    if (!BuildMeshlets(inGeometry))
+    {
+        std::printf("%-16s build failed\n", inName);
+        return false;
+    }
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<F32> distribution(-1.0f, 1.0f);
+
+    U32 cones = 0;
+    U32 wrong = 0;
+    size_t culled = 0;
+
+    for (const Meshlet &meshlet : inGeometry.Meshlets)
+    {
+        cones += meshlet.ConeCutoff <= 1.0f ? 1 : 0;
+    }
+
+    for (I32 i = 0; i < inEyes; ++i)
+    {
+        // eyes from right on the surface to well outside it
+        const glm::vec3 direction(distribution(random), distribution(random), distribution(random));
+        const glm::vec3 eye = glm::normalize(direction + glm::vec3(0.0f, 1e-3f, 0.0f)) * (0.05f + 3.0f * std::fabs(distribution(random)));
+
+        wrong += CountWronglyCulled(inGeometry, eye);
+
+        for (const Meshlet &meshlet : inGeometry.Meshlets)
+        {
+            culled += IsMeshletVisible(meshlet, OpenFrustum(), eye) ? 0 : 1;
+        }
+    }
+
+    std::printf("%-16s meshlets %5zu  cones %5u  culled avg %8.1f  wrongly culled %u\n", inName, inGeometry.Meshlets.size(), cones,
+                culled / static_cast<F64>(inEyes), wrong);
+
+    return wrong == 0;
+}
+
+// Usage: test_meshlets [grid size = 96] [eyes = 200]
+int main(int argc, char **argv)
+{
+    const I32 size = argc > 1 ? std::atoi(argv[1]) : 96;
+    const I32 eyes = argc > 2 ? std::atoi(argv[2]) : 200;
+
+    auto bowl = [](F32 inU, F32 inV) { return glm::vec3(inU, 0.5f * (inU * inU + inV * inV), inV); };
+    auto waves = [](F32 inU, F32 inV) { return glm::vec3(inU, 0.15f * std::sin(9.0f * inU) * std::cos(7.0f * inV), inV); };
+    auto flat = [](F32 inU, F32 inV) { return glm::vec3(inU, 0.0f, inV); };
+
+    bool isPassed = true;
+    isPassed &= Check("bowl inside", BuildSurface(size, false, bowl), eyes);
+    isPassed &= Check("bowl outside", BuildSurface(size, true, bowl), eyes);
+    isPassed &= Check("waves", BuildSurface(size, false, waves), eyes);
+    isPassed &= Check("flat", BuildSurface(size, false, flat), eyes);
+
+    std::printf("%s\n", isPassed ? "passed" : "FAILED");
+
+    g_Jobs.Stop();
+    return isPassed ? 0 : 1;
+}